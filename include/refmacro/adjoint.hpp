@@ -0,0 +1,353 @@
+#ifndef REFMACRO_ADJOINT_HPP
+#define REFMACRO_ADJOINT_HPP
+
+// Reverse-mode (adjoint) gradient compilation.
+//
+// compile_gradient<e>() returns a function computing e and its gradient
+// with respect to every free variable in one forward and one reverse sweep:
+//
+//   constexpr auto f = x * y + y / z;
+//   constexpr auto grad = compile_gradient<f>();
+//   auto r = grad(1.0, 2.0, 4.0); // r.value, r.grad[0..2] (x, y, z)
+//
+// The AST is a static DAG, so the adjoint program is built at compile time:
+// each reachable node gets one slot in a fixed local array, the forward
+// sweep fills the slots in dependency order, and the reverse sweep walks
+// them backwards accumulating adjoints. Both sweeps are unrolled into
+// straight-line code; there is no runtime tape.
+//
+// Arguments follow compile<e>() order. Derivative rules cover the built-in
+// arithmetic and transcendental functions, let bindings, cond (the taken
+// branch receives the adjoint; the other arm is evaluated but contributes
+// nothing, even where it is inf or NaN) and the comparison and logical
+// operators (zero derivative); any other tag is a compile error.
+
+#include <cmath>
+#include <cstddef>
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <utility>
+
+namespace refmacro {
+
+template <std::size_t N> struct GradResult {
+    double value{0.0};
+    double grad[N]{}; // in compile<e>() argument order
+};
+
+namespace detail {
+
+// --- Adjoint program: one instruction per slot ---
+
+enum class AdjOp {
+    var,
+    lit,
+    add,
+    sub,
+    mul,
+    div,
+    neg,
+    select,
+    eq,
+    lt,
+    gt,
+    le,
+    ge,
+    lnot,
+    land,
+    lor,
+    exp,
+    log,
+    sqrt,
+    sin,
+    cos,
+    tanh,
+    pow
+};
+
+struct AdjInstr {
+    AdjOp op{AdjOp::lit};
+    int a{-1}, b{-1}, c{-1}; // operand slots
+    int var{-1};             // argument index for AdjOp::var
+    double payload{0.0};     // constant for AdjOp::lit
+};
+
+template <std::size_t N> struct AdjProgram {
+    AdjInstr code[N]{};
+    int count{0};
+    int result{-1};
+    std::size_t arity{0};
+};
+
+struct AdjBinding {
+    char name[16]{};
+    int slot{-1};
+};
+
+// Builds the program in post-order. Nodes are memoized per let scope
+// instance, so a subtree shared within one scope is computed once.
+template <std::size_t Cap> struct AdjBuilder {
+    const AST<Cap>& ast;
+    VarMap<> vars;
+    AdjProgram<Cap * 2> prog{};
+    int memo[Cap]{};
+    int memo_env[Cap]{};
+    AdjBinding env[Scope::MaxLocals]{};
+    int env_count{0};
+    int env_id{0}; // current let scope instance
+    int next_env_id{1};
+
+    consteval AdjBuilder(const AST<Cap>& a, const VarMap<>& vm)
+        : ast(a), vars(vm) {
+        for (auto& m : memo)
+            m = -1;
+    }
+
+    consteval int emit(AdjInstr ins) {
+        if (prog.count >= static_cast<int>(Cap * 2))
+            throw "compile_gradient: program capacity exceeded";
+        prog.code[prog.count] = ins;
+        return prog.count++;
+    }
+
+    consteval int build(int id) {
+        if (memo[id] >= 0 && memo_env[id] == env_id)
+            return memo[id];
+        int slot = build_uncached(id);
+        memo[id] = slot;
+        memo_env[id] = env_id;
+        return slot;
+    }
+
+    consteval int build_uncached(int id) {
+        const auto& n = ast.nodes[id];
+        if (str_eq(n.tag, "var")) {
+            for (int i = env_count - 1; i >= 0; --i)
+                if (str_eq(env[i].name, n.name))
+                    return env[i].slot;
+            int idx = vars.index_of(n.name);
+            if (idx < 0)
+                throw "compile_gradient: unbound variable";
+            return emit({.op = AdjOp::var, .var = idx});
+        }
+        if (str_eq(n.tag, "lit"))
+            return emit({.op = AdjOp::lit, .payload = n.payload});
+
+        // apply(lambda(param, body), val): the body reads val's slot
+        if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+            str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+            const auto& fn = ast.nodes[n.children[0]];
+            int val = build(n.children[1]);
+            if (env_count >= static_cast<int>(Scope::MaxLocals))
+                throw "compile_gradient: too many nested let bindings";
+            copy_str(env[env_count].name, ast.nodes[fn.children[0]].name);
+            env[env_count++].slot = val;
+            int outer = env_id;
+            env_id = next_env_id++;
+            int body = build(fn.children[1]);
+            env_id = outer;
+            --env_count;
+            return body;
+        }
+        if (str_eq(n.tag, "progn") && n.child_count == 2) {
+            build(n.children[0]);
+            return build(n.children[1]);
+        }
+
+        struct Rule {
+            const char* tag;
+            int arity;
+            AdjOp op;
+        };
+        constexpr Rule rules[] = {
+            {"add", 2, AdjOp::add},
+            {"sub", 2, AdjOp::sub},
+            {"mul", 2, AdjOp::mul},
+            {"div", 2, AdjOp::div},
+            {"neg", 1, AdjOp::neg},
+            {"cond", 3, AdjOp::select},
+            {"eq", 2, AdjOp::eq},
+            {"lt", 2, AdjOp::lt},
+            {"gt", 2, AdjOp::gt},
+            {"le", 2, AdjOp::le},
+            {"ge", 2, AdjOp::ge},
+            {"lnot", 1, AdjOp::lnot},
+            {"land", 2, AdjOp::land},
+            {"lor", 2, AdjOp::lor},
+            {"exp", 1, AdjOp::exp},
+            {"log", 1, AdjOp::log},
+            {"sqrt", 1, AdjOp::sqrt},
+            {"sin", 1, AdjOp::sin},
+            {"cos", 1, AdjOp::cos},
+            {"tanh", 1, AdjOp::tanh},
+            {"pow", 2, AdjOp::pow},
+        };
+        for (const auto& r : rules) {
+            if (!str_eq(n.tag, r.tag) || n.child_count != r.arity)
+                continue;
+            AdjInstr ins{.op = r.op};
+            int* operands[] = {&ins.a, &ins.b, &ins.c};
+            for (int i = 0; i < n.child_count; ++i)
+                *operands[i] = build(n.children[i]);
+            return emit(ins);
+        }
+        throw "compile_gradient: no derivative rule for node";
+    }
+};
+
+template <std::size_t Cap>
+consteval AdjProgram<Cap * 2> make_adjoint_program(const AST<Cap>& ast,
+                                                   int root) {
+    auto vm = extract_var_map(ast, root);
+    AdjBuilder<Cap> b{ast, vm};
+    b.prog.result = b.build(root);
+    b.prog.arity = vm.count;
+    return b.prog;
+}
+
+// --- Sweeps: one unrolled step per instruction ---
+
+template <auto prog, int I>
+[[gnu::always_inline]] constexpr void adj_forward(double* v, const double* x) {
+    constexpr AdjInstr in = prog.code[I];
+    if constexpr (in.op == AdjOp::var)
+        v[I] = x[in.var];
+    else if constexpr (in.op == AdjOp::lit)
+        v[I] = in.payload;
+    else if constexpr (in.op == AdjOp::add)
+        v[I] = v[in.a] + v[in.b];
+    else if constexpr (in.op == AdjOp::sub)
+        v[I] = v[in.a] - v[in.b];
+    else if constexpr (in.op == AdjOp::mul)
+        v[I] = v[in.a] * v[in.b];
+    else if constexpr (in.op == AdjOp::div)
+        v[I] = v[in.a] / v[in.b];
+    else if constexpr (in.op == AdjOp::neg)
+        v[I] = -v[in.a];
+    else if constexpr (in.op == AdjOp::select)
+        v[I] = v[in.a] != 0.0 ? v[in.b] : v[in.c];
+    else if constexpr (in.op == AdjOp::eq)
+        v[I] = v[in.a] == v[in.b] ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::lt)
+        v[I] = v[in.a] < v[in.b] ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::gt)
+        v[I] = v[in.a] > v[in.b] ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::le)
+        v[I] = v[in.a] <= v[in.b] ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::ge)
+        v[I] = v[in.a] >= v[in.b] ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::lnot)
+        v[I] = v[in.a] == 0.0 ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::land)
+        v[I] = v[in.a] != 0.0 && v[in.b] != 0.0 ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::lor)
+        v[I] = v[in.a] != 0.0 || v[in.b] != 0.0 ? 1.0 : 0.0;
+    else if constexpr (in.op == AdjOp::exp)
+        v[I] = std::exp(v[in.a]);
+    else if constexpr (in.op == AdjOp::log)
+        v[I] = std::log(v[in.a]);
+    else if constexpr (in.op == AdjOp::sqrt)
+        v[I] = std::sqrt(v[in.a]);
+    else if constexpr (in.op == AdjOp::sin)
+        v[I] = std::sin(v[in.a]);
+    else if constexpr (in.op == AdjOp::cos)
+        v[I] = std::cos(v[in.a]);
+    else if constexpr (in.op == AdjOp::tanh)
+        v[I] = std::tanh(v[in.a]);
+    else if constexpr (in.op == AdjOp::pow)
+        v[I] = std::pow(v[in.a], v[in.b]);
+}
+
+// Comparisons and logical operators are piecewise constant: no adjoint.
+// A slot with a zero adjoint propagates nothing; skipping it keeps an
+// untaken cond arm's inf or NaN (1 / x at x == 0) out of the gradient,
+// where 0 * inf would otherwise turn it into NaN.
+template <auto prog, int I>
+[[gnu::always_inline]] constexpr void adj_reverse(const double* v, double* adj,
+                                                  double* grad) {
+    constexpr AdjInstr in = prog.code[I];
+    const double g = adj[I];
+    if (g == 0.0)
+        return;
+    if constexpr (in.op == AdjOp::var) {
+        grad[in.var] += g;
+    } else if constexpr (in.op == AdjOp::add) {
+        adj[in.a] += g;
+        adj[in.b] += g;
+    } else if constexpr (in.op == AdjOp::sub) {
+        adj[in.a] += g;
+        adj[in.b] -= g;
+    } else if constexpr (in.op == AdjOp::mul) {
+        adj[in.a] += g * v[in.b];
+        adj[in.b] += g * v[in.a];
+    } else if constexpr (in.op == AdjOp::div) {
+        adj[in.a] += g / v[in.b];
+        adj[in.b] -= g * v[I] / v[in.b];
+    } else if constexpr (in.op == AdjOp::neg) {
+        adj[in.a] -= g;
+    } else if constexpr (in.op == AdjOp::select) {
+        if (v[in.a] != 0.0)
+            adj[in.b] += g;
+        else
+            adj[in.c] += g;
+    } else if constexpr (in.op == AdjOp::exp) {
+        adj[in.a] += g * v[I];
+    } else if constexpr (in.op == AdjOp::log) {
+        adj[in.a] += g / v[in.a];
+    } else if constexpr (in.op == AdjOp::sqrt) {
+        adj[in.a] += g * 0.5 / v[I];
+    } else if constexpr (in.op == AdjOp::sin) {
+        adj[in.a] += g * std::cos(v[in.a]);
+    } else if constexpr (in.op == AdjOp::cos) {
+        adj[in.a] -= g * std::sin(v[in.a]);
+    } else if constexpr (in.op == AdjOp::tanh) {
+        adj[in.a] += g * (1.0 - v[I] * v[I]);
+    } else if constexpr (in.op == AdjOp::pow) {
+        adj[in.a] += g * v[in.b] * std::pow(v[in.a], v[in.b] - 1.0);
+        // A literal exponent needs no adjoint (and no log of the base)
+        if constexpr (prog.code[in.b].op != AdjOp::lit)
+            if (v[in.a] > 0.0)
+                adj[in.b] += g * v[I] * std::log(v[in.a]);
+    } else {
+        (void)g;
+    }
+}
+
+template <auto prog> struct gradient_fn {
+    static constexpr int slots = prog.count;
+    static constexpr std::size_t arity = prog.arity;
+
+    template <typename... Args>
+    [[gnu::flatten]] constexpr GradResult<arity>
+    operator()(Args... args) const {
+        static_assert(sizeof...(Args) == arity,
+                      "compile_gradient: one argument per free variable");
+        const double x[arity] = {static_cast<double>(args)...};
+        double v[slots]{};
+        double adj[slots]{};
+        GradResult<arity> out{};
+        [&]<int... Is>(std::integer_sequence<int, Is...>) {
+            (adj_forward<prog, Is>(v, x), ...);
+            adj[prog.result] = 1.0;
+            (adj_reverse<prog, slots - 1 - Is>(v, adj, out.grad), ...);
+        }(std::make_integer_sequence<int, slots>{});
+        out.value = v[prog.result];
+        return out;
+    }
+};
+
+} // namespace detail
+
+// --- Public API ---
+
+template <auto e> consteval auto compile_gradient() {
+    constexpr auto prog = detail::make_adjoint_program(e.ast, e.id);
+    static_assert(prog.arity > 0,
+                  "compile_gradient: expression has no free variables");
+    return detail::gradient_fn<prog>{};
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_ADJOINT_HPP
@@ -0,0 +1,283 @@
+#ifndef REFMACRO_ANALYZE_HPP
+#define REFMACRO_ANALYZE_HPP
+
+// Static cost model and expression metrics.
+//
+// analyze(e) summarizes an expression at compile time: size, depth, free
+// variables, per-tag operation counts, estimated work and critical-path
+// latency, and how much of the tree is repeated structure. Costs come from
+// a CostTable, by default built from the MacroInfo each macro declared in
+// defmacro; pass an explicit table to model a different target:
+//
+//   constexpr auto m = analyze(kernel);
+//   static_assert(m.flops <= 64, "kernel over budget");
+//   static_assert(m.ops_of("div") == 0);
+//
+//   constexpr auto costs = cost_table<MAdd, MMul>().set("mul", 1, 4);
+//   constexpr auto m4 = analyze(kernel, costs);
+//
+// A loop (sum, product, fold_range) stores its body once but runs it once
+// per trip: with literal bounds the body's work and latency count once per
+// trip, and with any other bounds the loop's cost is unbounded_cost, which
+// no budget passes.
+
+#include <limits>
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <refmacro/node_view.hpp>
+#include <refmacro/transforms.hpp>
+
+namespace refmacro {
+
+// The flops and latency of an expression whose trip counts are not known.
+inline constexpr int unbounded_cost = std::numeric_limits<int>::max();
+
+// --- CostTable: per-tag work and latency ---
+
+struct OpCost {
+    char tag[16]{};
+    int flops{1};
+    int latency{1};
+};
+
+template <std::size_t N = 32> struct CostTable {
+    OpCost entries[N]{};
+    std::size_t count{0};
+    // Cost of operations with no entry. var and lit are always free.
+    int default_flops{1};
+    int default_latency{1};
+
+    // Updates the entry in place and returns a copy, so calls chain.
+    consteval CostTable set(const char* tag, int flops, int latency) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (str_eq(entries[i].tag, tag)) {
+                entries[i].flops = flops;
+                entries[i].latency = latency;
+                return *this;
+            }
+        }
+        if (count >= N)
+            throw "CostTable capacity exceeded";
+        copy_str(entries[count].tag, tag);
+        entries[count].flops = flops;
+        entries[count].latency = latency;
+        ++count;
+        return *this;
+    }
+
+    consteval OpCost lookup(const char* tag) const {
+        for (std::size_t i = 0; i < count; ++i)
+            if (str_eq(entries[i].tag, tag))
+                return entries[i];
+        OpCost c{};
+        copy_str(c.tag, tag);
+        c.flops = default_flops;
+        c.latency = default_latency;
+        return c;
+    }
+};
+
+// Cost table from the MacroInfo declared by each macro: one evaluation
+// counts info.cost towards both work and latency.
+template <auto... Macros> consteval CostTable<> cost_table() {
+    CostTable<> t{};
+    [[maybe_unused]] auto add = [&](const auto& m) consteval {
+        if constexpr (requires { m.info; })
+            t.set(m.tag, m.info.cost, m.info.cost);
+        else
+            t.set(m.tag, 1, 1);
+    };
+    (add(Macros), ...);
+    // let bindings are free
+    t.set("apply", 0, 0);
+    t.set("lambda", 0, 0);
+    return t;
+}
+
+// --- ExprMetrics: result of analyze() ---
+
+struct OpCount {
+    char tag[16]{};
+    int count{0};
+};
+
+struct ExprMetrics {
+    int nodes{0};        // reachable nodes, leaves included
+    int depth{0};        // longest root-to-leaf path, in nodes
+    int vars{0};         // distinct free variables
+    int flops{0};        // total work: sum of op costs, times trip counts
+    int latency{0};      // critical path: longest chain of op latencies
+    int unique_nodes{0}; // nodes left after merging equal subtrees
+    OpCount ops[32]{};   // per-tag counts, leaves excluded
+    int op_kinds{0};
+
+    // Whether every loop has literal bounds, so flops and latency are finite.
+    consteval bool bounded() const { return flops < unbounded_cost; }
+
+    consteval int ops_of(const char* tag) const {
+        for (int i = 0; i < op_kinds; ++i)
+            if (str_eq(ops[i].tag, tag))
+                return ops[i].count;
+        return 0;
+    }
+
+    // Fraction of nodes that repeat an earlier subtree (what CSE removes).
+    consteval double duplicate_ratio() const {
+        return nodes == 0 ? 0.0
+                          : static_cast<double>(nodes - unique_nodes) / nodes;
+    }
+};
+
+namespace detail {
+
+struct SubtreeStats {
+    int nodes{0};
+    int depth{0};
+    int flops{0};
+    int latency{0};
+    int klass{0}; // structural equivalence class (hash-consing id)
+};
+
+// Hash-consing table: one entry per structurally distinct subtree.
+template <std::size_t Cap> struct ClassTable {
+    int rep[Cap]{};
+    int children[Cap][8]{};
+    int count{0};
+
+    consteval int intern(const AST<Cap>& ast, int id,
+                         const FoldChildren<SubtreeStats>& cs) {
+        const auto& n = ast.nodes[id];
+        for (int k = 0; k < count; ++k) {
+            const auto& r = ast.nodes[rep[k]];
+            if (!str_eq(r.tag, n.tag) || !str_eq(r.name, n.name) ||
+                r.payload != n.payload || r.child_count != n.child_count)
+                continue;
+            bool same = true;
+            for (int i = 0; i < n.child_count && same; ++i)
+                same = children[k][i] == cs[i].klass;
+            if (same)
+                return k;
+        }
+        rep[count] = id;
+        for (int i = 0; i < n.child_count; ++i)
+            children[count][i] = cs[i].klass;
+        return count++;
+    }
+};
+
+// Costs saturating at unbounded_cost.
+consteval int cost_add(int a, int b) {
+    return a > unbounded_cost - b ? unbounded_cost : a + b;
+}
+
+consteval int cost_times(int c, long long trips) {
+    if (trips < 0)
+        return unbounded_cost;
+    if (c == 0 || trips == 0)
+        return 0;
+    return trips > unbounded_cost / c ? unbounded_cost
+                                      : static_cast<int>(c * trips);
+}
+
+// Index of a loop node's body (its lambda child), or -1 for other nodes.
+consteval int loop_body(const ASTNode& n) {
+    if ((str_eq(n.tag, "sum") || str_eq(n.tag, "product")) &&
+        n.child_count == 3)
+        return 2;
+    if (str_eq(n.tag, "fold_range") && n.child_count == 4)
+        return 3;
+    return -1;
+}
+
+// Trip count of a loop whose bounds are the nodes lo and hi: -1 unless
+// both are literals, which are truncated as the loop truncates them.
+template <std::size_t Cap>
+consteval long long loop_trips(const AST<Cap>& ast, int lo, int hi) {
+    const auto& l = ast.nodes[lo];
+    const auto& h = ast.nodes[hi];
+    if (!str_eq(l.tag, "lit") || !str_eq(h.tag, "lit"))
+        return -1;
+    long long t = static_cast<long long>(h.payload) -
+                  static_cast<long long>(l.payload);
+    return t < 0 ? 0 : t;
+}
+
+consteval void count_op(ExprMetrics& m, const char* tag) {
+    for (int i = 0; i < m.op_kinds; ++i) {
+        if (str_eq(m.ops[i].tag, tag)) {
+            ++m.ops[i].count;
+            return;
+        }
+    }
+    if (m.op_kinds >= 32)
+        throw "analyze: too many distinct operation tags";
+    copy_str(m.ops[m.op_kinds].tag, tag);
+    m.ops[m.op_kinds++].count = 1;
+}
+
+} // namespace detail
+
+// --- Public API ---
+
+template <std::size_t Cap, auto... Ms, std::size_t N>
+consteval ExprMetrics analyze(const Expression<Cap, Ms...>& e,
+                              const CostTable<N>& costs) {
+    ExprMetrics m{};
+    detail::ClassTable<Cap> classes{};
+    auto root = fold(
+        e,
+        [&](NodeView<Cap> v, auto cs) consteval -> detail::SubtreeStats {
+            const auto& n = v.ast.nodes[v.id];
+            detail::SubtreeStats s{1, 0, 0, 0, 0};
+            int longest = 0;
+            // A loop's body runs after its bounds, once per trip
+            int body = detail::loop_body(n);
+            long long trips =
+                body < 0 ? 1
+                         : detail::loop_trips(v.ast, n.children[body - 2],
+                                              n.children[body - 1]);
+            for (int i = 0; i < cs.count; ++i) {
+                s.nodes += cs[i].nodes;
+                s.depth = cs[i].depth > s.depth ? cs[i].depth : s.depth;
+                if (i == body)
+                    continue;
+                s.flops = detail::cost_add(s.flops, cs[i].flops);
+                longest = cs[i].latency > longest ? cs[i].latency : longest;
+            }
+            if (body >= 0) {
+                s.flops = detail::cost_add(
+                    s.flops, detail::cost_times(cs[body].flops, trips));
+                longest = detail::cost_add(
+                    longest, detail::cost_times(cs[body].latency, trips));
+            }
+            s.depth += 1;
+            s.latency = longest;
+            if (!str_eq(n.tag, "var") && !str_eq(n.tag, "avar") &&
+                !str_eq(n.tag, "lit")) {
+                auto c = costs.lookup(n.tag);
+                s.flops = detail::cost_add(s.flops, c.flops);
+                s.latency = detail::cost_add(s.latency, c.latency);
+                detail::count_op(m, n.tag);
+            }
+            s.klass = classes.intern(v.ast, v.id, cs);
+            return s;
+        });
+    m.nodes = root.nodes;
+    m.depth = root.depth;
+    m.flops = root.flops;
+    m.latency = root.latency;
+    m.unique_nodes = classes.count;
+    m.vars = static_cast<int>(extract_var_map(e.ast, e.id).count);
+    return m;
+}
+
+template <std::size_t Cap, auto... Ms>
+consteval ExprMetrics analyze(const Expression<Cap, Ms...>& e) {
+    return analyze(e, cost_table<Ms...>());
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_ANALYZE_HPP
@@ -0,0 +1,97 @@
+#ifndef REFMACRO_ARRAY_HPP
+#define REFMACRO_ARRAY_HPP
+
+// Array-valued variables.
+//
+// avar("w", N) is an array argument holding N elements; index(w, i) reads
+// element i of it. compile binds an array variable to one argument, in
+// extract_var_map order like a scalar one: pass a std::array, std::span or
+// other contiguous range of at least N elements. A shorter one is a
+// compile error when its extent is static and throws std::out_of_range
+// otherwise. It reaches the nodes as a span, so it is not copied per node:
+//
+//   constexpr auto w = avar("w", 4);
+//   constexpr auto e = sum("i", 0, 4, index(w, Expr::var("i")) * x);
+//   compile<e>()(std::array{1.0, 2.0, 3.0, 4.0}, 2.0); // 20
+//
+// The index is truncated toward zero. index() builds a checked read, which
+// throws std::out_of_range unless 0 <= i < N; it may throw, so it is impure
+// and never evaluated speculatively. An "index_proven" node reads without
+// the check: reftype's elide_bounds_checks rewrites each access whose
+// bounds it proves from the index's refinements into one.
+
+#include <cstddef>
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <stdexcept>
+
+namespace refmacro {
+
+// --- Array variables ---
+
+template <std::size_t Cap = 64>
+consteval Expression<Cap> avar(const char* name, int size) {
+    if (size <= 0)
+        throw "avar: array size must be positive";
+    Expression<Cap> e;
+    ASTNode n{};
+    copy_str(n.tag, "avar");
+    copy_str(n.name, name);
+    n.payload = size;
+    e.id = e.ast.add_node(n);
+    return e;
+}
+
+// --- Index macros ---
+
+namespace detail {
+
+template <typename Node> consteval double array_extent() {
+    auto w = Node::child(0);
+    if (w.tag() != "avar")
+        throw "index: first operand must be an avar";
+    return w.payload();
+}
+
+template <typename Node, bool Checked>
+constexpr auto lower_index(auto w, auto i) {
+    constexpr double n = array_extent<Node>();
+    return [=](auto... a) constexpr {
+        double k = i(a...);
+        if constexpr (Checked)
+            if (!(k > -1.0 && k < n))
+                throw std::out_of_range("index: out of bounds");
+        return w(a...)[static_cast<std::size_t>(k)];
+    };
+}
+
+} // namespace detail
+
+inline constexpr auto MIndex = defmacro<"index", MacroInfo{.cost = 2}>(
+    [](NodeInfo auto node, auto w, auto i) {
+        return detail::lower_index<decltype(node), true>(w, i);
+    });
+
+inline constexpr auto MIndexProven = defmacro<"index_proven", pure_op>(
+    [](NodeInfo auto node, auto w, auto i) {
+        return detail::lower_index<decltype(node), false>(w, i);
+    });
+
+// --- Index sugar ---
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto index(Expression<Cap, Ms1...> w, Expression<Cap, Ms2...> i) {
+    if (!str_eq(w.ast.nodes[w.id].tag, "avar"))
+        throw "index: first operand must be an avar";
+    return MIndex(w, i);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto index(Expression<Cap, Ms...> w, int i) {
+    return index(w, Expression<Cap>::lit(i));
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_ARRAY_HPP
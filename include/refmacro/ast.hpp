@@ -66,6 +66,35 @@ template <std::size_t Cap = 64> struct AST {
     }
 };
 
+// --- Literal kinds ---
+//
+// A "lit" node holds its value in payload, as a double, and in name the
+// numeric kind it was written in: "int" for an integer literal, empty for a
+// real one. The kind only decides the type compile gives the literal (see
+// compile.hpp); eval and the solvers read the double.
+
+inline constexpr char int_lit_kind[] = "int";
+
+consteval bool is_int_lit(const ASTNode& n) {
+    return str_eq(n.tag, "lit") && str_eq(n.name, int_lit_kind);
+}
+
+consteval bool is_integral_value(double v) {
+    return v > -9.2e18 && v < 9.2e18 &&
+           static_cast<double>(static_cast<long long>(v)) == v;
+}
+
+// Whether folding n's literal operands yields an integer literal: they all
+// are integer ones. The fold must then be integral; integer evaluation
+// would truncate 7 / 2, so such a node is left unfolded.
+template <std::size_t Cap>
+consteval bool int_operands(const AST<Cap>& ast, const ASTNode& n) {
+    for (int i = 0; i < n.child_count; ++i)
+        if (!is_int_lit(ast.nodes[n.children[i]]))
+            return false;
+    return n.child_count > 0;
+}
+
 } // namespace refmacro
 
 #endif // REFMACRO_AST_HPP
@@ -1,9 +1,15 @@
 #ifndef REFMACRO_COMPILE_HPP
 #define REFMACRO_COMPILE_HPP
 
+#include <optional>
 #include <refmacro/ast.hpp>
 #include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <refmacro/node_view.hpp>
+#include <span>
+#include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace refmacro {
@@ -43,7 +49,7 @@ template <std::size_t Cap>
 consteval void collect_vars_dfs(const AST<Cap>& ast, int id, VarMap<>& vm,
                                 VarMap<> bound = {}) {
     const auto& n = ast.nodes[id];
-    if (str_eq(n.tag, "var")) {
+    if (str_eq(n.tag, "var") || str_eq(n.tag, "avar")) {
         if (!bound.contains(n.name))
             vm.add(n.name);
         return;
@@ -62,6 +68,13 @@ consteval void collect_vars_dfs(const AST<Cap>& ast, int id, VarMap<>& vm,
             return;
         }
     }
+    // lambda(param, body) elsewhere (a loop body): param is bound in body
+    if (str_eq(n.tag, "lambda") && n.child_count == 2) {
+        VarMap<> inner_bound = bound;
+        inner_bound.add(ast.nodes[n.children[0]].name);
+        collect_vars_dfs(ast, n.children[1], vm, inner_bound);
+        return;
+    }
     for (int i = 0; i < n.child_count; ++i) {
         if (n.children[i] >= 0)
             collect_vars_dfs(ast, n.children[i], vm, bound);
@@ -90,16 +103,19 @@ struct TagStr {
 
 // --- Scope: compile-time tracking of locally-bound variables ---
 
+// A lazy local is passed as a thunk that each use calls.
 struct Scope {
     static constexpr std::size_t MaxLocals = 8;
     TagStr names[MaxLocals]{};
+    bool lazy[MaxLocals]{};
     std::size_t count{0};
 
-    consteval Scope push(TagStr name) const {
+    consteval Scope push(TagStr name, bool by_name = false) const {
         if (count >= MaxLocals)
             throw "Scope capacity exceeded";
         Scope s = *this;
         s.names[s.count] = name;
+        s.lazy[s.count] = by_name;
         ++s.count;
         return s;
     }
@@ -113,32 +129,273 @@ struct Scope {
     }
 };
 
+// --- NodeRef: compile-time handle to the node being lowered ---
+//
+// A lowering may take a NodeRef before its child closures to specialize on
+// the node's shape. Everything on it is usable in constant expressions:
+//
+//   defmacro<"pow">([](NodeInfo auto node, auto base, auto exp) {
+//       if constexpr (node.child(1).tag() == "lit") { ... }
+//   });
+//
+// Lowerings are tried with the closures alone first, so constrain the first
+// parameter with NodeInfo when the arities would otherwise coincide.
+
+template <auto ast, int id> struct NodeRef {
+    static constexpr bool is_node_ref = true;
+
+    static consteval auto view() { return NodeView{ast, id}; }
+    static consteval auto tag() { return view().tag(); }
+    static consteval double payload() { return view().payload(); }
+    static consteval int child_count() { return view().child_count(); }
+    static consteval auto child(int i) { return view().child(i); }
+};
+
+template <typename T>
+concept NodeInfo = requires { requires T::is_node_ref; };
+
 // --- Macro dispatch: find macro by tag and apply ---
 
 namespace detail {
 
 // Apply the first macro whose tag matches. If none match, compile error.
-template <TagStr Tag, auto First, auto... Rest>
-consteval auto apply_macro(auto children_tuple) {
+// The macro's lowering for Backend is called with the child closures, or,
+// if it does not accept them alone, with the node's NodeRef followed by the
+// closures.
+template <typename Backend, TagStr Tag, auto First, auto... Rest>
+consteval auto apply_macro(auto children_tuple, auto node) {
     if constexpr (str_eq(Tag.data, First.tag)) {
-        return std::apply(First.fn, children_tuple);
+        constexpr auto fn = [] {
+            if constexpr (requires { First.template lowering<Backend>(); })
+                return First.template lowering<Backend>();
+            else
+                return First.fn;
+        }();
+        constexpr auto arity = std::tuple_size_v<decltype(children_tuple)>;
+        return [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+            if constexpr (requires { fn(std::get<Is>(children_tuple)...); })
+                return fn(std::get<Is>(children_tuple)...);
+            else
+                return fn(node, std::get<Is>(children_tuple)...);
+        }(std::make_index_sequence<arity>{});
     } else {
         static_assert(sizeof...(Rest) > 0, "no macro defined for AST tag");
-        return apply_macro<Tag, Rest...>(children_tuple);
+        return apply_macro<Backend, Tag, Rest...>(children_tuple, node);
+    }
+}
+
+// --- Cost model: static cost and purity of a subtree ---
+
+// Arms of a cond whose total cost stays within this budget (and which are
+// pure) are evaluated eagerly and selected without a branch.
+inline constexpr int select_arm_budget = 8;
+
+template <auto First, auto... Rest>
+consteval std::optional<MacroInfo> find_macro_info(const char* tag) {
+    if (str_eq(tag, First.tag)) {
+        if constexpr (requires { First.info; })
+            return First.info;
+        else
+            return MacroInfo{};
+    }
+    if constexpr (sizeof...(Rest) > 0)
+        return find_macro_info<Rest...>(tag);
+    else
+        return std::nullopt;
+}
+
+struct SubtreeCost {
+    int cost{0};
+    bool pure{true};
+};
+
+template <auto... Macros, std::size_t Cap>
+consteval SubtreeCost subtree_cost(const AST<Cap>& ast, int id) {
+    const auto& n = ast.nodes[id];
+    SubtreeCost c{};
+    if (str_eq(n.tag, "var") || str_eq(n.tag, "avar") || str_eq(n.tag, "lit"))
+        return c;
+    if (!str_eq(n.tag, "apply") && !str_eq(n.tag, "lambda")) {
+        std::optional<MacroInfo> info;
+        if constexpr (sizeof...(Macros) > 0)
+            info = find_macro_info<Macros...>(n.tag);
+        if (!info)
+            return {0, false};
+        c.cost = info->cost;
+        c.pure = info->pure;
+    }
+    for (int i = 0; i < n.child_count; ++i) {
+        auto child = subtree_cost<Macros...>(ast, n.children[i]);
+        c.cost += child.cost;
+        c.pure = c.pure && child.pure;
+    }
+    return c;
+}
+
+// Whether the subtree at id reads a local bound by name, whose value may
+// not be pure.
+template <std::size_t Cap>
+consteval bool reads_by_name(const AST<Cap>& ast, int id, const Scope& scope) {
+    const auto& n = ast.nodes[id];
+    if (str_eq(n.tag, "var")) {
+        int k = scope.find(n.name);
+        return k >= 0 && scope.lazy[k];
     }
+    for (int i = 0; i < n.child_count; ++i)
+        if (reads_by_name(ast, n.children[i], scope))
+            return true;
+    return false;
+}
+
+// Whether the subtree at id may run before, or without, any use of it.
+template <auto... Macros, std::size_t Cap>
+consteval bool speculable(const AST<Cap>& ast, int id, const Scope& scope) {
+    return subtree_cost<Macros...>(ast, id).pure &&
+           !reads_by_name(ast, id, scope);
+}
+
+template <auto... Macros, std::size_t Cap>
+consteval bool prefer_select(const AST<Cap>& ast, int then_id, int else_id,
+                             const Scope& scope = {}) {
+    return speculable<Macros...>(ast, then_id, scope) &&
+           speculable<Macros...>(ast, else_id, scope) &&
+           subtree_cost<Macros...>(ast, then_id).cost <= select_arm_budget &&
+           subtree_cost<Macros...>(ast, else_id).cost <= select_arm_budget;
+}
+
+template <int K> consteval auto nth_arg() {
+    return [](auto... v) constexpr { return std::get<K>(std::tuple{v...}); };
 }
 
 // --- Recursive compile ---
+//
+// Every node compiles to node_fn<...>, an empty type: its implementation is
+// a static constexpr closure, and children are reached through template
+// parameters, so no closure state is nested inside another. node_fn's call
+// operator is always_inline, and compile<e>() wraps the root in a flatten
+// function, so even unoptimized builds evaluate the tree in a single frame.
+
+template <typename Backend, auto ast, int id, auto var_map, auto scope,
+          auto... Macros>
+consteval auto lower_node();
+
+template <typename Backend, auto ast, int id, auto var_map, auto scope,
+          auto... Macros>
+struct node_fn {
+    static constexpr auto impl =
+        lower_node<Backend, ast, id, var_map, scope, Macros...>();
+
+    [[gnu::always_inline]] constexpr auto operator()(auto... args) const {
+        return impl(args...);
+    }
+};
+
+// Compiles node id of ast using each macro's lowering for Backend.
+template <typename Backend, auto ast, int id, auto var_map, auto scope,
+          auto... Macros>
+consteval auto compile_node() {
+    return node_fn<Backend, ast, id, var_map, scope, Macros...>{};
+}
 
 template <auto ast, int id, auto var_map, auto scope, auto... Macros>
-consteval auto compile_node(auto locals) {
+consteval auto compile_node() {
+    return node_fn<backend::generic, ast, id, var_map, scope, Macros...>{};
+}
+
+// Nodes take their arguments by value, so an argument bound to an array
+// variable is passed on as a span over the caller's array instead of being
+// copied at every node. Neither a checked nor a proven index read looks at
+// the argument's size, so it is checked once here: a static extent against
+// the avar's at compile time, a dynamic one on each call.
+template <std::size_t N, typename T> constexpr auto pass_arg(const T& a) {
+    if constexpr (N == 0) {
+        return a;
+    } else {
+        auto s = std::span{a};
+        if constexpr (decltype(s)::extent != std::dynamic_extent)
+            static_assert(decltype(s)::extent >= N,
+                          "compile: array argument shorter than its avar");
+        else if (s.size() < N)
+            throw std::out_of_range(
+                "compile: array argument shorter than its avar");
+        return s;
+    }
+}
+
+// Extent K of Extents, or 0 (a scalar) past their end.
+template <std::size_t K, std::size_t... Extents>
+consteval std::size_t nth_extent() {
+    constexpr std::size_t n[] = {Extents..., 0};
+    return K < sizeof...(Extents) ? n[K] : 0;
+}
+
+// Extents: per argument, the avar's size, or 0 for a scalar.
+template <typename Root, std::size_t... Extents> struct root_fn {
+    [[gnu::flatten]] constexpr auto operator()(const auto&... args) const {
+        return [&]<std::size_t... Ks>(std::index_sequence<Ks...>) {
+            return Root{}(pass_arg<nth_extent<Ks, Extents...>()>(args)...);
+        }(std::index_sequence_for<decltype(args)...>{});
+    }
+};
+
+// The extent of variable k of vm: its avar's size, or 0 for a scalar.
+template <std::size_t Cap>
+consteval std::size_t array_extent(const AST<Cap>& ast, const VarMap<>& vm,
+                                   std::size_t k) {
+    for (std::size_t id = 0; id < ast.count; ++id)
+        if (str_eq(ast.nodes[id].tag, "avar") &&
+            str_eq(ast.nodes[id].name, vm.names[k]))
+            return static_cast<std::size_t>(ast.nodes[id].payload);
+    return 0;
+}
+
+// --- Literal lowering ---
+//
+// A literal takes the evaluation type of the arguments it is called with:
+// the common type of the arithmetic ones, so float arguments keep a kernel
+// in float and integral ones keep it integral. An integer literal becomes
+// that type; a real one only a floating-point type, staying double next to
+// integral arguments. Without arithmetic arguments (none, or Duals, SIMD
+// lanes and spans only) a literal is a double.
+
+// Non-arithmetic arguments count as bool, which every arithmetic type
+// absorbs; a bool result means there were none.
+template <typename A>
+using arith_or_bool = std::conditional_t<
+    std::is_arithmetic_v<std::remove_cvref_t<A>>, std::remove_cvref_t<A>,
+    bool>;
+template <typename... A>
+using eval_type_t = std::common_type_t<bool, arith_or_bool<A>...>;
+
+template <bool Integral, typename T>
+constexpr auto literal_as(double v) {
+    if constexpr (std::is_same_v<T, bool>)
+        return v;
+    else if constexpr (Integral || std::is_floating_point_v<T>)
+        return static_cast<T>(v);
+    else
+        return v;
+}
+
+template <typename Backend, auto ast, int id, auto var_map, auto scope,
+          auto... Macros>
+consteval auto lower_node() {
     constexpr auto n = ast.nodes[id];
 
-    // Built-in: variable -> local binding or argument accessor
-    if constexpr (str_eq(n.tag, "var")) {
+    // Built-in: variable (scalar or array) -> local binding or argument
+    // accessor
+    if constexpr (str_eq(n.tag, "var") || str_eq(n.tag, "avar")) {
         constexpr int local_idx = scope.find(n.name);
         if constexpr (local_idx >= 0) {
-            return std::get<local_idx>(locals);
+            // Let-bound values trail the arguments, innermost last
+            return [](auto... args) constexpr {
+                auto local = std::get<sizeof...(args) - scope.count +
+                                      local_idx>(std::tuple{args...});
+                if constexpr (scope.lazy[local_idx])
+                    return local();
+                else
+                    return local;
+            };
         } else {
             constexpr int idx = var_map.index_of(n.name);
             static_assert(idx >= 0, "unbound variable in AST");
@@ -147,11 +404,20 @@ consteval auto compile_node(auto locals) {
             };
         }
     }
-    // Built-in: literal -> constant
+    // Built-in: literal -> constant in the evaluation type
     else if constexpr (str_eq(n.tag, "lit")) {
-        return [](auto...) constexpr { return n.payload; };
+        constexpr bool integral = is_int_lit(n);
+        return [](auto... a) constexpr {
+            return literal_as<integral, eval_type_t<decltype(a)...>>(
+                n.payload);
+        };
     }
-    // Built-in: apply(lambda(param, body), val) -> let binding
+    // Built-in: apply(lambda(param, body), val) -> let binding.
+    // A pure value is computed once and passed to the body as an extra
+    // trailing argument, so every use of the name shares it; computing it
+    // when no use runs changes nothing. Any other value is bound by name:
+    // the body gets a thunk and each use evaluates it, so a division or a
+    // checked read used only in an untaken cond arm never runs.
     else if constexpr (str_eq(n.tag, "apply") && n.child_count == 2 &&
                        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
         constexpr auto lambda_node = ast.nodes[n.children[0]];
@@ -159,26 +425,70 @@ consteval auto compile_node(auto locals) {
                       "malformed AST: lambda node must have 2 children "
                       "(param, body)");
         constexpr auto param_node = ast.nodes[lambda_node.children[0]];
-        // Compile value with current scope
-        auto val_fn =
-            compile_node<ast, n.children[1], var_map, scope, Macros...>(locals);
-        // Extend scope and locals
+        // Value in the current scope, body in the extended scope
+        constexpr bool by_value =
+            speculable<Macros...>(ast, n.children[1], scope);
+        constexpr auto new_scope =
+            scope.push(TagStr{param_node.name}, !by_value);
+        using Val = node_fn<Backend, ast, n.children[1], var_map, scope,
+                            Macros...>;
+        using Body = node_fn<Backend, ast, lambda_node.children[1], var_map,
+                             new_scope, Macros...>;
+        if constexpr (by_value)
+            return [](auto... a) constexpr {
+                return Body{}(a..., Val{}(a...));
+            };
+        else
+            return [](auto... a) constexpr {
+                return Body{}(a..., [=] { return Val{}(a...); });
+            };
+    }
+    // Built-in: lambda(param, body) anywhere else -> a function of the
+    // arguments returning a closure over param, for macros that call their
+    // operand repeatedly (sum, product, fold_range). param trails the
+    // arguments like a let-bound value.
+    else if constexpr (str_eq(n.tag, "lambda") && n.child_count == 2) {
+        constexpr auto param_node = ast.nodes[n.children[0]];
         constexpr auto new_scope = scope.push(TagStr{param_node.name});
-        auto new_locals = std::tuple_cat(locals, std::tuple{val_fn});
-        // Compile lambda body with extended scope
-        return compile_node<ast, lambda_node.children[1], var_map, new_scope,
-                            Macros...>(new_locals);
+        using Body = node_fn<Backend, ast, n.children[1], var_map, new_scope,
+                             Macros...>;
+        return [](auto... a) constexpr {
+            return [=](auto p) constexpr { return Body{}(a..., p); };
+        };
+    }
+    // Built-in: cond with cheap, pure arms -> branchless select.
+    // Both arms are evaluated up front and the cond macro is lowered over
+    // closures returning the precomputed values, so its ?: picks between
+    // two values (a conditional move / blend) instead of two calls.
+    else if constexpr (str_eq(n.tag, "cond") && n.child_count == 3 &&
+                       prefer_select<Macros...>(ast, n.children[1],
+                                                n.children[2], scope)) {
+        using Test = node_fn<Backend, ast, n.children[0], var_map, scope,
+                             Macros...>;
+        using Then = node_fn<Backend, ast, n.children[1], var_map, scope,
+                             Macros...>;
+        using Else = node_fn<Backend, ast, n.children[2], var_map, scope,
+                             Macros...>;
+        auto select = apply_macro<Backend, TagStr{n.tag}, Macros...>(
+            std::tuple{nth_arg<0>(), nth_arg<1>(), nth_arg<2>()},
+            NodeRef<ast, id>{});
+        return [select](auto... a) constexpr {
+            auto t = Test{}(a...);
+            auto x = Then{}(a...);
+            auto y = Else{}(a...);
+            return select(t, x, y);
+        };
     }
     // Everything else: dispatch to macros
     else {
-        // Compile children bottom-up, then dispatch to matching macro
+        // Hand the children's node_fns to the matching macro's lowering
         auto children = [&]<int... Cs>(std::integer_sequence<int, Cs...>) {
-            return std::tuple{
-                compile_node<ast, n.children[Cs], var_map, scope, Macros...>(
-                    locals)...};
+            return std::tuple{node_fn<Backend, ast, n.children[Cs], var_map,
+                                      scope, Macros...>{}...};
         }(std::make_integer_sequence<int, n.child_count>{});
 
-        return apply_macro<TagStr{n.tag}, Macros...>(children);
+        return apply_macro<Backend, TagStr{n.tag}, Macros...>(
+            children, NodeRef<ast, id>{});
     }
 }
 
@@ -188,22 +498,81 @@ consteval auto compile_node(auto locals) {
 
 namespace detail {
 
-template <auto e, typename ExprType, auto... ExtraMacros>
+template <auto e, typename ExprType, typename Backend, auto... ExtraMacros>
 struct unified_compiler;
 
-template <auto e, std::size_t Cap, auto... Embedded, auto... Extra>
-struct unified_compiler<e, Expression<Cap, Embedded...>, Extra...> {
+template <auto e, std::size_t Cap, auto... Embedded, typename Backend,
+          auto... Extra>
+struct unified_compiler<e, Expression<Cap, Embedded...>, Backend, Extra...> {
+    static constexpr auto vm = extract_var_map(e.ast, e.id);
+
+    template <std::size_t... Ks>
+    static consteval auto root(std::index_sequence<Ks...>) {
+        using Root = decltype(compile_node<Backend, e.ast, e.id, vm, Scope{},
+                                           Embedded..., Extra...>());
+        return root_fn<Root, array_extent(e.ast, vm, Ks)...>{};
+    }
+
     static consteval auto run() {
-        constexpr auto vm = extract_var_map(e.ast, e.id);
-        return compile_node<e.ast, e.id, vm, Scope{}, Embedded..., Extra...>(
-            std::tuple{});
+        return root(std::make_index_sequence<vm.count>{});
     }
 };
 
 } // namespace detail
 
 template <auto e, auto... ExtraMacros> consteval auto compile() {
-    return detail::unified_compiler<e, decltype(e), ExtraMacros...>::run();
+    return detail::unified_compiler<e, decltype(e), backend::generic,
+                                    ExtraMacros...>::run();
+}
+
+// compile<e, backend::batch>(): per node, the macro's lowering for the
+// backend if it declares one, else its generic lowering.
+template <auto e, typename Backend, auto... ExtraMacros>
+consteval auto compile() {
+    return detail::unified_compiler<e, decltype(e), Backend,
+                                    ExtraMacros...>::run();
+}
+
+// --- compile_fn: export as a plain function pointer ---
+//
+//   constexpr auto f = compile_fn<e, double(double, double)>();
+//   constexpr auto g = compile_fn<e, double(const double*)>();
+//   f(1.0, 2.0) == g(std::array{1.0, 2.0}.data());
+//
+// Arguments bind to free variables in compile<e>() order; the array form
+// reads one element per variable. The exported function is non-generic and
+// has the whole closure tree flattened into it.
+
+namespace detail {
+
+template <auto e, typename Sig> struct fn_export;
+
+template <auto e, typename R, typename... Args>
+struct fn_export<e, R(Args...)> {
+    static_assert(sizeof...(Args) == extract_var_map(e.ast, e.id).count,
+                  "compile_fn: one parameter per free variable expected");
+    static constexpr auto fn = compile<e>();
+
+    [[gnu::flatten]] static constexpr R call(Args... args) {
+        return static_cast<R>(fn(args...));
+    }
+};
+
+template <auto e, typename R, typename T> struct fn_export<e, R(const T*)> {
+    static constexpr std::size_t arity = extract_var_map(e.ast, e.id).count;
+    static constexpr auto fn = compile<e>();
+
+    [[gnu::flatten]] static constexpr R call(const T* args) {
+        return [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+            return static_cast<R>(fn(args[Is]...));
+        }(std::make_index_sequence<arity>{});
+    }
+};
+
+} // namespace detail
+
+template <auto e, typename Sig> consteval auto compile_fn() {
+    return &detail::fn_export<e, Sig>::call;
 }
 
 } // namespace refmacro
@@ -13,52 +13,62 @@
 #include <refmacro/ast.hpp>
 #include <refmacro/compile.hpp>
 #include <refmacro/expr.hpp>
+#include <refmacro/interval.hpp>
 #include <refmacro/macro.hpp>
 #include <refmacro/math.hpp>
+#include <type_traits>
 
 namespace refmacro {
 
 // --- Control-flow macros (lowering to lambdas) ---
 
-inline constexpr auto MCond =
-    defmacro<"cond">([](auto test, auto then_, auto else_) {
+inline constexpr auto MCond = defmacro<"cond", pure_op>(
+    [](auto test, auto then_, auto else_) {
         return [=](auto... a) constexpr {
             return test(a...) ? then_(a...) : else_(a...);
         };
-    });
+    },
+    // An undecided test over intervals takes the hull of both arms
+    lower<backend::interval>([](auto test, auto then_, auto else_) {
+        return [=](auto... a) constexpr {
+            return detail::interval_cond(
+                test(a...), [&] { return then_(a...); },
+                [&] { return else_(a...); });
+        };
+    }));
 
-inline constexpr auto MLand = defmacro<"land">([](auto lhs, auto rhs) {
+inline constexpr auto MLand = defmacro<"land", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) && rhs(a...); };
 });
 
-inline constexpr auto MLor = defmacro<"lor">([](auto lhs, auto rhs) {
+inline constexpr auto MLor = defmacro<"lor", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) || rhs(a...); };
 });
 
-inline constexpr auto MLnot = defmacro<"lnot">(
+inline constexpr auto MLnot = defmacro<"lnot", pure_op>(
     [](auto x) { return [=](auto... a) constexpr { return !x(a...); }; });
 
-inline constexpr auto MEq = defmacro<"eq">([](auto lhs, auto rhs) {
+inline constexpr auto MEq = defmacro<"eq", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) == rhs(a...); };
 });
 
-inline constexpr auto MLt = defmacro<"lt">([](auto lhs, auto rhs) {
+inline constexpr auto MLt = defmacro<"lt", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) < rhs(a...); };
 });
 
-inline constexpr auto MGt = defmacro<"gt">([](auto lhs, auto rhs) {
+inline constexpr auto MGt = defmacro<"gt", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) > rhs(a...); };
 });
 
-inline constexpr auto MLe = defmacro<"le">([](auto lhs, auto rhs) {
+inline constexpr auto MLe = defmacro<"le", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) <= rhs(a...); };
 });
 
-inline constexpr auto MGe = defmacro<"ge">([](auto lhs, auto rhs) {
+inline constexpr auto MGe = defmacro<"ge", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) >= rhs(a...); };
 });
 
-inline constexpr auto MProgn = defmacro<"progn">([](auto a, auto b) {
+inline constexpr auto MProgn = defmacro<"progn", pure_op>([](auto a, auto b) {
     return [=](auto... args) constexpr { return (void)a(args...), b(args...); };
 });
 
@@ -122,47 +132,58 @@ consteval auto operator>=(Expression<Cap, Ms1...> lhs,
     return MGe(lhs, rhs);
 }
 
-// double on LHS (comparison)
-template <std::size_t Cap, auto... Ms>
-consteval auto operator==(double lhs, Expression<Cap, Ms...> rhs) {
+// A number on the LHS (comparison): an integral one builds an integer
+// literal
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator==(T lhs, Expression<Cap, Ms...> rhs) {
     return MEq(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator<(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator<(T lhs, Expression<Cap, Ms...> rhs) {
     return MLt(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator>(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator>(T lhs, Expression<Cap, Ms...> rhs) {
     return MGt(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator<=(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator<=(T lhs, Expression<Cap, Ms...> rhs) {
     return MLe(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator>=(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator>=(T lhs, Expression<Cap, Ms...> rhs) {
     return MGe(Expression<Cap>::lit(lhs), rhs);
 }
 
-// double on RHS (comparison)
-template <std::size_t Cap, auto... Ms>
-consteval auto operator==(Expression<Cap, Ms...> lhs, double rhs) {
+// A number on the RHS (comparison)
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator==(Expression<Cap, Ms...> lhs, T rhs) {
     return MEq(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator<(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator<(Expression<Cap, Ms...> lhs, T rhs) {
     return MLt(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator>(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator>(Expression<Cap, Ms...> lhs, T rhs) {
     return MGt(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator<=(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator<=(Expression<Cap, Ms...> lhs, T rhs) {
     return MLe(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator>=(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator>=(Expression<Cap, Ms...> lhs, T rhs) {
     return MGe(lhs, Expression<Cap>::lit(rhs));
 }
 
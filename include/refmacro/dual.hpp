@@ -0,0 +1,159 @@
+#ifndef REFMACRO_DUAL_HPP
+#define REFMACRO_DUAL_HPP
+
+// Forward-mode automatic differentiation through dual numbers.
+//
+// compile_dual<e, N>() compiles e for backend::dual and evaluates it over
+// Dual<N>: a value plus N tangent lanes. Seeding each lane with a direction
+// yields the value and N directional derivatives from a single call, with
+// no symbolic differentiation and no growth of the AST:
+//
+//   constexpr auto f = x * x * y;
+//   constexpr auto fn = compile_dual<f, 2>();
+//   auto r = fn(Dual<2>::variable(3.0, 0), Dual<2>::variable(2.0, 1));
+//   // r.val == 18, r.d[0] == df/dx == 12, r.d[1] == df/dy == 9
+//
+// Plain arguments are constants (zero tangent). The built-in math and
+// control macros lower through Dual's operators and elementary functions
+// (exp, log, sqrt, sin, cos, tanh, pow): comparisons and tests look at the
+// value only, so cond differentiates the branch it takes. A macro
+// whose generic lowering is not expressed in those operators can supply
+// lower<backend::dual>(...) in defmacro.
+
+#include <cmath>
+#include <cstddef>
+#include <refmacro/compile.hpp>
+#include <refmacro/macro.hpp>
+
+namespace refmacro {
+
+// --- Dual<N>: value and N tangents ---
+
+template <std::size_t N = 1> struct Dual {
+    static_assert(N >= 1, "Dual needs at least one tangent lane");
+
+    double val{0.0};
+    double d[N]{};
+
+    constexpr Dual() = default;
+    // A constant: every tangent is zero.
+    constexpr Dual(double v) : val(v) {}
+
+    // The independent variable of lane k: tangent 1 there, 0 elsewhere.
+    static constexpr Dual variable(double v, std::size_t k) {
+        Dual r{v};
+        r.d[k] = 1.0;
+        return r;
+    }
+
+    // Tests (cond, land, lor, lnot) look at the value.
+    explicit constexpr operator bool() const { return val != 0.0; }
+
+    friend constexpr Dual operator+(const Dual& a, const Dual& b) {
+        Dual r{a.val + b.val};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = a.d[k] + b.d[k];
+        return r;
+    }
+    friend constexpr Dual operator-(const Dual& a, const Dual& b) {
+        Dual r{a.val - b.val};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = a.d[k] - b.d[k];
+        return r;
+    }
+    friend constexpr Dual operator*(const Dual& a, const Dual& b) {
+        Dual r{a.val * b.val};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = a.d[k] * b.val + a.val * b.d[k];
+        return r;
+    }
+    friend constexpr Dual operator/(const Dual& a, const Dual& b) {
+        Dual r{a.val / b.val};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = (a.d[k] - r.val * b.d[k]) / b.val;
+        return r;
+    }
+    friend constexpr Dual operator-(const Dual& a) {
+        Dual r{-a.val};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = -a.d[k];
+        return r;
+    }
+
+    // Elementary functions, reached by the math macros' unqualified calls.
+    // Each is f(a) with tangents f'(a.val) * a.d.
+    static constexpr Dual chain(const Dual& a, double value, double slope) {
+        Dual r{value};
+        for (std::size_t k = 0; k < N; ++k)
+            r.d[k] = slope * a.d[k];
+        return r;
+    }
+    friend Dual exp(const Dual& a) {
+        double e = std::exp(a.val);
+        return chain(a, e, e);
+    }
+    friend Dual log(const Dual& a) {
+        return chain(a, std::log(a.val), 1.0 / a.val);
+    }
+    friend Dual sqrt(const Dual& a) {
+        double s = std::sqrt(a.val);
+        return chain(a, s, 0.5 / s);
+    }
+    friend Dual sin(const Dual& a) {
+        return chain(a, std::sin(a.val), std::cos(a.val));
+    }
+    friend Dual cos(const Dual& a) {
+        return chain(a, std::cos(a.val), -std::sin(a.val));
+    }
+    friend Dual tanh(const Dual& a) {
+        double t = std::tanh(a.val);
+        return chain(a, t, 1.0 - t * t);
+    }
+    friend Dual pow(const Dual& a, const Dual& b) {
+        Dual r = chain(a, std::pow(a.val, b.val),
+                       b.val * std::pow(a.val, b.val - 1.0));
+        // The exponent's tangents need log(a), defined for a > 0 only
+        for (std::size_t k = 0; k < N; ++k)
+            if (b.d[k] != 0.0)
+                r.d[k] += r.val * std::log(a.val) * b.d[k];
+        return r;
+    }
+
+    friend constexpr bool operator==(const Dual& a, const Dual& b) {
+        return a.val == b.val;
+    }
+    friend constexpr bool operator<(const Dual& a, const Dual& b) {
+        return a.val < b.val;
+    }
+    friend constexpr bool operator>(const Dual& a, const Dual& b) {
+        return a.val > b.val;
+    }
+    friend constexpr bool operator<=(const Dual& a, const Dual& b) {
+        return a.val <= b.val;
+    }
+    friend constexpr bool operator>=(const Dual& a, const Dual& b) {
+        return a.val >= b.val;
+    }
+};
+
+namespace detail {
+
+template <typename Root, std::size_t N> struct dual_fn {
+    [[gnu::flatten]] constexpr Dual<N> operator()(const auto&... args) const {
+        // Literal-only results come back as double; widen them too
+        return Dual<N>(Root{}(Dual<N>(args)...));
+    }
+};
+
+} // namespace detail
+
+// --- Public API ---
+
+template <auto e, std::size_t N = 1> consteval auto compile_dual() {
+    using Root = decltype(compile<e, backend::dual>());
+    return detail::dual_fn<Root, N>{};
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_DUAL_HPP
@@ -0,0 +1,233 @@
+#ifndef REFMACRO_EVAL_HPP
+#define REFMACRO_EVAL_HPP
+
+// Direct consteval evaluation of an expression, without compiling it.
+//
+// eval(e, {values...}) walks the flat AST once, binding free variables to
+// values in extract_var_map order (the same order compile<e>() takes its
+// arguments). No closure types are instantiated, so constant-evaluated uses
+// such as precomputed tables are much cheaper than compile<e>()(args...).
+//
+//   constexpr auto x = Expr::var("x");
+//   static_assert(eval(x * x + 2.0 * x + 1.0, {3.0}) == 16.0);
+//
+// Built-in semantics cover var, lit, let (apply/lambda), the loops (sum,
+// product, fold_range), arithmetic, the transcendental functions (exp, log,
+// sqrt, sin, cos, tanh, pow, evaluated with std:: as in the generic
+// lowering) and the control-flow macros; cond, land and lor only evaluate
+// the arms they need. Values are scalars, so the array (avar, index) and
+// linalg macros have no built-in rule.
+// Results are doubles: comparisons and logical operators yield 1.0 or 0.0.
+// Any other tag is delegated to an optional hook:
+//
+//   auto hook = [](NodeView<64> n, FoldChildren<double> c) consteval
+//       -> std::optional<double> {
+//       if (n.tag() == "abs") return c[0] < 0 ? -c[0] : c[0];
+//       return std::nullopt;
+//   };
+//   static_assert(eval(Abs(x), {-2.0}, hook) == 2.0);
+
+#include <cmath>
+#include <initializer_list>
+#include <optional>
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/node_view.hpp>
+#include <refmacro/transforms.hpp>
+
+namespace refmacro {
+
+// Default hook: no rules for custom macros.
+struct NoEvalHook {
+    template <std::size_t Cap>
+    consteval std::optional<double> operator()(NodeView<Cap>,
+                                               FoldChildren<double>) const {
+        return std::nullopt;
+    }
+};
+
+namespace detail {
+
+// --- EvalEnv: variable bindings, innermost last ---
+
+template <std::size_t Cap> struct EvalEnv {
+    char names[Cap + 8][16]{};
+    double values[Cap + 8]{};
+    int count{0};
+
+    consteval void push(const char* name, double value) {
+        if (count >= static_cast<int>(Cap + 8))
+            throw "eval: too many bindings";
+        copy_str(names[count], name);
+        values[count++] = value;
+    }
+    consteval void pop() { --count; }
+    consteval double lookup(const char* name) const {
+        for (int i = count - 1; i >= 0; --i)
+            if (str_eq(names[i], name))
+                return values[i];
+        throw "eval: unbound variable";
+    }
+};
+
+// Strict built-in operators over already-evaluated operands.
+consteval std::optional<double> eval_builtin(const char* tag,
+                                             const FoldChildren<double>& c) {
+    if (c.count == 1) {
+        if (str_eq(tag, "neg"))
+            return -c[0];
+        if (str_eq(tag, "lnot"))
+            return c[0] == 0.0 ? 1.0 : 0.0;
+        if (str_eq(tag, "exp"))
+            return std::exp(c[0]);
+        if (str_eq(tag, "log"))
+            return std::log(c[0]);
+        if (str_eq(tag, "sqrt"))
+            return std::sqrt(c[0]);
+        if (str_eq(tag, "sin"))
+            return std::sin(c[0]);
+        if (str_eq(tag, "cos"))
+            return std::cos(c[0]);
+        if (str_eq(tag, "tanh"))
+            return std::tanh(c[0]);
+    }
+    if (c.count == 2) {
+        if (str_eq(tag, "add"))
+            return c[0] + c[1];
+        if (str_eq(tag, "sub"))
+            return c[0] - c[1];
+        if (str_eq(tag, "mul"))
+            return c[0] * c[1];
+        if (str_eq(tag, "div")) {
+            if (c[1] == 0.0)
+                throw "eval: division by zero";
+            return c[0] / c[1];
+        }
+        if (str_eq(tag, "eq"))
+            return c[0] == c[1] ? 1.0 : 0.0;
+        if (str_eq(tag, "lt"))
+            return c[0] < c[1] ? 1.0 : 0.0;
+        if (str_eq(tag, "gt"))
+            return c[0] > c[1] ? 1.0 : 0.0;
+        if (str_eq(tag, "le"))
+            return c[0] <= c[1] ? 1.0 : 0.0;
+        if (str_eq(tag, "ge"))
+            return c[0] >= c[1] ? 1.0 : 0.0;
+        if (str_eq(tag, "pow"))
+            return std::pow(c[0], c[1]);
+    }
+    return std::nullopt;
+}
+
+template <std::size_t Cap, typename Hook>
+consteval double eval_node(const AST<Cap>& ast, int id, EvalEnv<Cap>& env,
+                           const Hook& hook) {
+    const auto& n = ast.nodes[id];
+    auto arg = [&](int i) consteval {
+        return eval_node(ast, n.children[i], env, hook);
+    };
+
+    if (str_eq(n.tag, "lit"))
+        return n.payload;
+    if (str_eq(n.tag, "var"))
+        return env.lookup(n.name);
+
+    // apply(lambda(param, body), val): call-by-value let binding
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+        const auto& fn = ast.nodes[n.children[0]];
+        double value = arg(1);
+        env.push(ast.nodes[fn.children[0]].name, value);
+        double result = eval_node(ast, fn.children[1], env, hook);
+        env.pop();
+        return result;
+    }
+    if (str_eq(n.tag, "lambda"))
+        throw "eval: lambda is not a value";
+
+    // Loops over [lo, hi): the body lambda is called once per index
+    if ((str_eq(n.tag, "sum") || str_eq(n.tag, "product")) &&
+        n.child_count == 3) {
+        const auto& fn = ast.nodes[n.children[2]];
+        bool is_sum = str_eq(n.tag, "sum");
+        double acc = is_sum ? 0.0 : 1.0;
+        auto lo = static_cast<long long>(arg(0));
+        auto hi = static_cast<long long>(arg(1));
+        for (long long i = lo; i < hi; ++i) {
+            env.push(ast.nodes[fn.children[0]].name, static_cast<double>(i));
+            double v = eval_node(ast, fn.children[1], env, hook);
+            env.pop();
+            acc = is_sum ? acc + v : acc * v;
+        }
+        return acc;
+    }
+    if (str_eq(n.tag, "fold_range") && n.child_count == 4) {
+        const auto& outer = ast.nodes[n.children[3]];
+        const auto& inner = ast.nodes[outer.children[1]];
+        double acc = arg(0);
+        auto lo = static_cast<long long>(arg(1));
+        auto hi = static_cast<long long>(arg(2));
+        for (long long i = lo; i < hi; ++i) {
+            env.push(ast.nodes[outer.children[0]].name, acc);
+            env.push(ast.nodes[inner.children[0]].name, static_cast<double>(i));
+            acc = eval_node(ast, inner.children[1], env, hook);
+            env.pop();
+            env.pop();
+        }
+        return acc;
+    }
+
+    // Lazy forms: only the selected operands are evaluated
+    if (str_eq(n.tag, "cond") && n.child_count == 3)
+        return arg(0) != 0.0 ? arg(1) : arg(2);
+    if (str_eq(n.tag, "land") && n.child_count == 2)
+        return arg(0) != 0.0 && arg(1) != 0.0 ? 1.0 : 0.0;
+    if (str_eq(n.tag, "lor") && n.child_count == 2)
+        return arg(0) != 0.0 || arg(1) != 0.0 ? 1.0 : 0.0;
+    if (str_eq(n.tag, "progn") && n.child_count == 2) {
+        (void)arg(0);
+        return arg(1);
+    }
+
+    FoldChildren<double> children;
+    for (int i = 0; i < n.child_count; ++i) {
+        if (children.count >= children.capacity)
+            throw "FoldChildren: capacity exceeded";
+        children.values[children.count++] = arg(i);
+    }
+    if (auto v = hook(NodeView<Cap>{ast, id}, children))
+        return *v;
+    if (auto v = eval_builtin(n.tag, children))
+        return *v;
+    throw "eval: no evaluation rule for node (pass a hook for custom macros)";
+}
+
+// Evaluate a subtree with no free variables (constant folding).
+template <std::size_t Cap, typename Hook = NoEvalHook>
+consteval double eval_closed(const AST<Cap>& ast, int id, Hook hook = {}) {
+    EvalEnv<Cap> env{};
+    return eval_node(ast, id, env, hook);
+}
+
+} // namespace detail
+
+// --- Public API ---
+
+template <std::size_t Cap, auto... Ms, typename Hook = NoEvalHook>
+consteval double eval(const Expression<Cap, Ms...>& e,
+                      std::initializer_list<double> values = {},
+                      Hook hook = {}) {
+    auto vm = extract_var_map(e.ast, e.id);
+    if (values.size() != vm.count)
+        throw "eval: expected one value per free variable";
+    detail::EvalEnv<Cap> env{};
+    std::size_t i = 0;
+    for (double v : values)
+        env.push(vm.names[i++], v);
+    return detail::eval_node(e.ast, e.id, env, hook);
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_EVAL_HPP
@@ -2,6 +2,7 @@
 #define REFMACRO_EXPR_HPP
 
 #include <refmacro/ast.hpp>
+#include <type_traits>
 
 namespace refmacro {
 
@@ -21,10 +22,19 @@ template <std::size_t Cap = 64, auto... Macros> struct Expression {
     // Default constructor (needed since we added the converting constructor)
     consteval Expression() = default;
 
-    static consteval Expression lit(double v) {
+    // An integral v builds an integer literal (see is_int_lit).
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    static consteval Expression lit(T v) {
+        return lit(static_cast<double>(v), std::is_integral_v<T>);
+    }
+
+    static consteval Expression lit(double v, bool integral) {
         Expression e;
         ASTNode n{};
         copy_str(n.tag, "lit");
+        if (integral)
+            copy_str(n.name, int_lit_kind);
         n.payload = v;
         e.id = e.ast.add_node(n);
         return e;
@@ -0,0 +1,134 @@
+#ifndef REFMACRO_FUSED_HPP
+#define REFMACRO_FUSED_HPP
+
+// Fused multi-output compilation.
+//
+// compile_many<e1, e2, ...>() compiles several expressions into one function
+// returning a std::tuple with one element per expression. The outputs are
+// merged into a single AST under a "tuple" root, where structurally equal
+// subtrees collapse to one node; the cse pass then binds every subtree
+// shared between (or within) outputs with a let, so it is evaluated once
+// per call:
+//
+//   constexpr auto f = (x * y + 1.0) * x;
+//   constexpr auto g = (x * y + 1.0) * y;
+//   constexpr auto fn = compile_many<f, g>();
+//   auto [fv, gv] = fn(1.0, 2.0); // x * y + 1 computed once
+//
+// Arguments bind to the free variables of all outputs: those of e1 in
+// compile<e1>() order, then the new ones of e2, and so on. Macros are the
+// union of the outputs' macros. Only pure subtrees (per MacroInfo) are
+// shared; at most Scope::MaxLocals shared values are bound.
+
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <refmacro/passes.hpp>
+#include <tuple>
+#include <type_traits>
+
+namespace refmacro {
+
+// --- FusedPlan: merged outputs with shared subtrees bound ---
+
+template <std::size_t Cap> struct FusedPlan {
+    Expression<Cap> merged{}; // let-bound shared values around a tuple root
+    VarMap<> vars{};          // argument order
+    int outputs{0};
+    int shared{0}; // subtrees evaluated once for several uses
+};
+
+namespace detail {
+
+// --- Macro packs of several expressions ---
+
+template <auto... Ms> struct MacroList {};
+
+template <typename... Lists> struct concat_macros {
+    using type = MacroList<>;
+};
+template <auto... As> struct concat_macros<MacroList<As...>> {
+    using type = MacroList<As...>;
+};
+template <auto... As, auto... Bs, typename... Rest>
+struct concat_macros<MacroList<As...>, MacroList<Bs...>, Rest...>
+    : concat_macros<MacroList<As..., Bs...>, Rest...> {};
+
+template <typename E> struct embedded_macros;
+template <std::size_t Cap, auto... Ms>
+struct embedded_macros<Expression<Cap, Ms...>> {
+    using type = MacroList<Ms...>;
+};
+
+template <auto... es>
+using fused_macros = typename concat_macros<typename embedded_macros<
+    std::remove_cvref_t<decltype(es)>>::type...>::type;
+
+// Root of a merged AST: one child per output.
+inline constexpr auto MTuple = defmacro<"tuple">([](auto... outs) {
+    return [=](auto... args) constexpr {
+        return std::tuple{outs(args...)...};
+    };
+});
+
+template <std::size_t Cap, auto... Ms, typename... Es>
+consteval FusedPlan<Cap> make_fused_plan(MacroList<Ms...>, const Es&... es) {
+    Arena<Cap * 4> a{};
+    ASTNode t{};
+    copy_str(t.tag, "tuple");
+    ((t.children[t.child_count++] = a.load(es.ast, es.id)), ...);
+    int root = a.intern(t);
+
+    FusedPlan<Cap> plan{};
+    plan.outputs = t.child_count;
+    plan.vars = extract_var_map(a.ast, root);
+
+    // Interning already merged equal subtrees across outputs; bind each
+    // one that is used more than once, largest first.
+    CseState cse{};
+    for (int next = cse_pass<Ms...>(a, root, cse); next != root;
+         next = cse_pass<Ms...>(a, root, cse))
+        root = next;
+    plan.shared = cse.bindings;
+
+    int memo[Cap * 4];
+    for (auto& m : memo)
+        m = -1;
+    plan.merged.id = a.store(plan.merged.ast, root, memo);
+    return plan;
+}
+
+template <auto plan, typename Macros> struct fused_compiler;
+
+template <auto plan, auto... Ms>
+struct fused_compiler<plan, MacroList<Ms...>> {
+    static consteval auto run() {
+        using Root =
+            decltype(compile_node<plan.merged.ast, plan.merged.id, plan.vars,
+                                  Scope{}, Ms..., MTuple>());
+        return root_fn<Root>{};
+    }
+};
+
+} // namespace detail
+
+// --- Public API ---
+
+// The merged plan compile_many<es...>() compiles, for inspection.
+template <auto... es> consteval auto fused_plan() {
+    static_assert(sizeof...(es) >= 1 && sizeof...(es) <= 8,
+                  "compile_many takes 1 to 8 expressions");
+    constexpr std::size_t cap =
+        ((sizeof(es.ast.nodes) / sizeof(ASTNode)) + ...) + 32;
+    return detail::make_fused_plan<cap>(detail::fused_macros<es...>{}, es...);
+}
+
+template <auto... es> consteval auto compile_many() {
+    return detail::fused_compiler<fused_plan<es...>(),
+                                  detail::fused_macros<es...>>::run();
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_FUSED_HPP
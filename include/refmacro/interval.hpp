@@ -0,0 +1,365 @@
+#ifndef REFMACRO_INTERVAL_HPP
+#define REFMACRO_INTERVAL_HPP
+
+// Interval arithmetic with outward rounding.
+//
+// compile_interval<e>() compiles e for backend::interval and evaluates it
+// over Interval: given a box of inputs it returns an interval that
+// contains the value of e at every point of the box. Rounding is outward,
+// so the enclosure holds in floating point too, not only over the reals:
+//
+//   constexpr auto fn = compile_interval<x * x - y>();
+//   auto r = fn(Interval{-1.0, 2.0}, Interval{0.5, 1.0});
+//   // r == [-3, 3.5]: x * x is taken as [-2, 4] (no dependency tracking)
+//
+// Plain arguments are point intervals. The math macros lower through
+// Interval's operators and elementary functions. A comparison yields an
+// IntervalBool saying whether the test may be true and whether it may be
+// false over the box, and land, lor and lnot combine those. cond takes
+// the arm a decided test selects and the hull of both arms otherwise, so
+// branch-and-bound code can skip a region whose enclosure is irrelevant,
+// and a refinement predicate compiled this way holds on the whole box when
+// its result is_true().
+//
+// +, - and * round to the nearest enclosing doubles, using error-free
+// transformations; / and sqrt widen their result by one ulp each way.
+// The transcendental functions widen the libm result by libm_ulps, and
+// assume it to be that accurate. A function applied partly outside its
+// domain encloses the part inside; wholly outside it, it gives an empty
+// (NaN) interval. Loop bounds must not depend on interval arguments.
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <refmacro/compile.hpp>
+#include <refmacro/macro.hpp>
+#include <type_traits>
+
+namespace refmacro {
+
+namespace detail {
+
+inline constexpr double inf = std::numeric_limits<double>::infinity();
+
+// The next double above x; infinities and NaN are left alone.
+constexpr double next_up(double x) {
+    if (x != x || x == inf)
+        return x;
+    if (x == 0.0)
+        return std::numeric_limits<double>::denorm_min();
+    auto bits = std::bit_cast<std::uint64_t>(x);
+    return std::bit_cast<double>(x > 0.0 ? bits + 1 : bits - 1);
+}
+
+constexpr double next_down(double x) { return -next_up(-x); }
+
+// The rounding error x + y - s of s = fl(x + y), exact barring overflow.
+constexpr double two_sum_error(double x, double y, double s) {
+    double yy = s - x;
+    return (x - (s - yy)) + (y - yy);
+}
+
+// The error x * y - p for p = fl(x * y) of nonzero x and y, by Dekker's
+// product; near overflow or underflow it is NaN, which widens.
+constexpr double two_product_error(double x, double y, double p) {
+    constexpr double split = 134217729.0; // 2^27 + 1
+    double ap = p < 0.0 ? -p : p;
+    if (!(ap < 0x1p995 && ap > 0x1p-969))
+        return std::numeric_limits<double>::quiet_NaN();
+    double cx = split * x;
+    double xh = cx - (cx - x);
+    double xl = x - xh;
+    double cy = split * y;
+    double yh = cy - (cy - y);
+    double yl = y - yh;
+    return ((xh * yh - p) + xh * yl + xl * yh) + xl * yl;
+}
+
+// A rounded result given the sign of its error: the enclosing doubles.
+constexpr double round_down(double r, double error) {
+    return error < 0.0 || error != error ? next_down(r) : r;
+}
+constexpr double round_up(double r, double error) {
+    return error > 0.0 || error != error ? next_up(r) : r;
+}
+
+// x * y with 0 * inf = 0: a zero factor pins the product.
+constexpr double mul_lo(double x, double y) {
+    if (x == 0.0 || y == 0.0)
+        return 0.0;
+    double p = x * y;
+    return round_down(p, two_product_error(x, y, p));
+}
+constexpr double mul_hi(double x, double y) {
+    if (x == 0.0 || y == 0.0)
+        return 0.0;
+    double p = x * y;
+    return round_up(p, two_product_error(x, y, p));
+}
+
+constexpr double min2(double a, double b) { return b < a ? b : a; }
+constexpr double max2(double a, double b) { return a < b ? b : a; }
+
+} // namespace detail
+
+// --- IntervalBool: a test over a box ---
+
+struct IntervalBool {
+    bool maybe_true{true};
+    bool maybe_false{true};
+
+    constexpr IntervalBool() = default;
+    constexpr IntervalBool(bool b) : maybe_true(b), maybe_false(!b) {}
+    constexpr IntervalBool(bool may_be_true, bool may_be_false)
+        : maybe_true(may_be_true), maybe_false(may_be_false) {}
+
+    // Holds at every point of the box / at none.
+    constexpr bool is_true() const { return !maybe_false; }
+    constexpr bool is_false() const { return !maybe_true; }
+
+    friend constexpr IntervalBool operator!(IntervalBool t) {
+        return {t.maybe_false, t.maybe_true};
+    }
+    friend constexpr IntervalBool operator&&(IntervalBool t, IntervalBool u) {
+        return {t.maybe_true && u.maybe_true, t.maybe_false || u.maybe_false};
+    }
+    friend constexpr IntervalBool operator||(IntervalBool t, IntervalBool u) {
+        return {t.maybe_true || u.maybe_true, t.maybe_false && u.maybe_false};
+    }
+};
+
+// --- Interval: [lo, hi] ---
+
+struct Interval {
+    // libm's error bound assumed for exp, log, sin, cos, tanh and pow.
+    static constexpr int libm_ulps = 4;
+
+    double lo{0.0};
+    double hi{0.0};
+
+    constexpr Interval() = default;
+    // A point.
+    constexpr Interval(double v) : lo(v), hi(v) {}
+    constexpr Interval(double l, double h) : lo(l), hi(h) {}
+
+    static constexpr Interval entire() {
+        return {-detail::inf, detail::inf};
+    }
+    static constexpr Interval empty() {
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        return {nan, nan};
+    }
+
+    constexpr bool is_empty() const { return lo != lo || hi != hi; }
+    constexpr bool contains(double v) const { return lo <= v && v <= hi; }
+    constexpr double width() const { return hi - lo; }
+
+    friend constexpr Interval hull(const Interval& a, const Interval& b) {
+        if (a.is_empty())
+            return b;
+        if (b.is_empty())
+            return a;
+        return {detail::min2(a.lo, b.lo), detail::max2(a.hi, b.hi)};
+    }
+
+    friend constexpr Interval operator+(const Interval& a, const Interval& b) {
+        double l = a.lo + b.lo;
+        double h = a.hi + b.hi;
+        return {detail::round_down(l, detail::two_sum_error(a.lo, b.lo, l)),
+                detail::round_up(h, detail::two_sum_error(a.hi, b.hi, h))};
+    }
+    friend constexpr Interval operator-(const Interval& a) {
+        return {-a.hi, -a.lo};
+    }
+    friend constexpr Interval operator-(const Interval& a, const Interval& b) {
+        return a + -b;
+    }
+    friend constexpr Interval operator*(const Interval& a, const Interval& b) {
+        using namespace detail;
+        if (a.is_empty() || b.is_empty())
+            return empty();
+        return {min2(min2(mul_lo(a.lo, b.lo), mul_lo(a.lo, b.hi)),
+                     min2(mul_lo(a.hi, b.lo), mul_lo(a.hi, b.hi))),
+                max2(max2(mul_hi(a.lo, b.lo), mul_hi(a.lo, b.hi)),
+                     max2(mul_hi(a.hi, b.lo), mul_hi(a.hi, b.hi)))};
+    }
+    friend constexpr Interval operator/(const Interval& a, const Interval& b) {
+        using namespace detail;
+        if (a.is_empty() || b.is_empty() || (b.lo == 0.0 && b.hi == 0.0))
+            return empty();
+        if (b.lo <= 0.0 && b.hi >= 0.0)
+            return entire();
+        double q[4]{a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi};
+        // inf / inf is NaN: those quotients are left out
+        double l = inf;
+        double h = -inf;
+        for (double v : q) {
+            l = v == v ? min2(l, v) : l;
+            h = v == v ? max2(h, v) : h;
+        }
+        if (l > h)
+            return entire();
+        return {next_down(l), next_up(h)};
+    }
+
+    // --- Comparisons: whether the test may hold, and may fail ---
+
+    friend constexpr IntervalBool operator<(const Interval& a,
+                                            const Interval& b) {
+        if (a.is_empty() || b.is_empty())
+            return {};
+        return {a.lo < b.hi, a.hi >= b.lo};
+    }
+    friend constexpr IntervalBool operator<=(const Interval& a,
+                                             const Interval& b) {
+        if (a.is_empty() || b.is_empty())
+            return {};
+        return {a.lo <= b.hi, a.hi > b.lo};
+    }
+    friend constexpr IntervalBool operator>(const Interval& a,
+                                            const Interval& b) {
+        return b < a;
+    }
+    friend constexpr IntervalBool operator>=(const Interval& a,
+                                             const Interval& b) {
+        return b <= a;
+    }
+    friend constexpr IntervalBool operator==(const Interval& a,
+                                             const Interval& b) {
+        if (a.is_empty() || b.is_empty())
+            return {};
+        bool same_point = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+        return {a.lo <= b.hi && b.lo <= a.hi, !same_point};
+    }
+
+    // --- Elementary functions, reached by the math macros' unqualified
+    // calls ---
+
+    // [f(l), f(h)] widened by libm_ulps, for f increasing.
+    static Interval increasing(double l, double h) {
+        for (int i = 0; i < libm_ulps; ++i) {
+            l = detail::next_down(l);
+            h = detail::next_up(h);
+        }
+        return {l, h};
+    }
+    friend Interval exp(const Interval& a) {
+        Interval r = increasing(std::exp(a.lo), std::exp(a.hi));
+        return {detail::max2(r.lo, 0.0), r.hi};
+    }
+    friend Interval log(const Interval& a) {
+        if (a.is_empty() || a.hi < 0.0)
+            return empty();
+        double l = a.lo > 0.0 ? std::log(a.lo) : -detail::inf;
+        return increasing(l, std::log(a.hi));
+    }
+    friend Interval sqrt(const Interval& a) {
+        if (a.is_empty() || a.hi < 0.0)
+            return empty();
+        double l = a.lo > 0.0 ? detail::next_down(std::sqrt(a.lo)) : 0.0;
+        return {detail::max2(l, 0.0), detail::next_up(std::sqrt(a.hi))};
+    }
+    friend Interval tanh(const Interval& a) {
+        Interval r = increasing(std::tanh(a.lo), std::tanh(a.hi));
+        return {detail::max2(r.lo, -1.0), detail::min2(r.hi, 1.0)};
+    }
+
+    // Whether [l, h] may reach c + 2k pi for an integer k. The slack
+    // covers the rounding of the reduction and only ever adds extrema.
+    static bool may_reach(double l, double h, double c) {
+        constexpr double two_pi = 6.28318530717958647692;
+        double slack = 1e-9 * (1.0 + detail::max2(std::fabs(l), std::fabs(h)));
+        double k = std::ceil((l - slack - c) / two_pi);
+        return c + k * two_pi <= h + slack;
+    }
+    // sin or cos over a, given where it peaks and dips.
+    template <typename F>
+    static Interval periodic(const Interval& a, F f, double peak,
+                             double dip) {
+        if (a.is_empty())
+            return empty();
+        if (!(a.width() < 6.0) || !(std::fabs(a.lo) < 0x1p40) ||
+            !(std::fabs(a.hi) < 0x1p40))
+            return {-1.0, 1.0};
+        Interval r = increasing(detail::min2(f(a.lo), f(a.hi)),
+                                detail::max2(f(a.lo), f(a.hi)));
+        double l = may_reach(a.lo, a.hi, dip) ? -1.0 : r.lo;
+        double h = may_reach(a.lo, a.hi, peak) ? 1.0 : r.hi;
+        return {detail::max2(l, -1.0), detail::min2(h, 1.0)};
+    }
+    friend Interval sin(const Interval& a) {
+        constexpr double half_pi = 1.57079632679489661923;
+        return periodic(a, [](double x) { return std::sin(x); }, half_pi,
+                        -half_pi);
+    }
+    friend Interval cos(const Interval& a) {
+        constexpr double pi = 3.14159265358979323846;
+        return periodic(a, [](double x) { return std::cos(x); }, 0.0, pi);
+    }
+
+    friend Interval pow(const Interval& a, const Interval& b) {
+        if (a.is_empty() || b.is_empty())
+            return empty();
+        // A whole exponent n: |a|^n for even n, monotone for odd n
+        double n = b.lo;
+        if (b.lo == b.hi && n == std::floor(n) && std::fabs(n) < 0x1p31) {
+            if (n < 0.0)
+                return Interval{1.0} / pow(a, Interval{-n});
+            if (std::fmod(n, 2.0) != 0.0)
+                return increasing(std::pow(a.lo, n), std::pow(a.hi, n));
+            double mag_lo = a.contains(0.0)
+                                ? 0.0
+                                : detail::min2(std::fabs(a.lo),
+                                               std::fabs(a.hi));
+            double mag_hi =
+                detail::max2(std::fabs(a.lo), std::fabs(a.hi));
+            Interval r = increasing(std::pow(mag_lo, n), std::pow(mag_hi, n));
+            return {detail::max2(r.lo, 0.0), r.hi};
+        }
+        // A negative base has a power at each whole exponent in b
+        if (a.lo < 0.0 && std::floor(b.hi) >= b.lo)
+            return entire();
+        // Otherwise a^b = exp(b log a) for a >= 0
+        if (a.hi < 0.0)
+            return empty();
+        return exp(b * log(Interval{detail::max2(a.lo, 0.0), a.hi}));
+    }
+};
+
+namespace detail {
+
+// cond over intervals: the arm a decided test selects, else both arms'
+// hull.
+template <typename Then, typename Else>
+constexpr Interval interval_cond(IntervalBool test, Then then_, Else else_) {
+    if (test.is_true())
+        return Interval(then_());
+    if (test.is_false())
+        return Interval(else_());
+    return hull(Interval(then_()), Interval(else_()));
+}
+
+template <typename Root> struct interval_fn {
+    constexpr auto operator()(const auto&... args) const {
+        auto r = Root{}(Interval(args)...);
+        if constexpr (std::is_same_v<decltype(r), bool> ||
+                      std::is_same_v<decltype(r), IntervalBool>)
+            return IntervalBool(r);
+        else
+            return Interval(r);
+    }
+};
+
+} // namespace detail
+
+// --- Public API ---
+
+template <auto e> consteval auto compile_interval() {
+    using Root = decltype(compile<e, backend::interval>());
+    return detail::interval_fn<Root>{};
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_INTERVAL_HPP
@@ -0,0 +1,280 @@
+#ifndef REFMACRO_LINALG_HPP
+#define REFMACRO_LINALG_HPP
+
+// Small fixed-size linear algebra.
+//
+// Vectors and matrices have every dimension between 1 and max_linalg_dim
+// and are stored row-major in a std::array. vec(e0, ..., eN-1) builds a
+// vector from scalars; an array variable avar("x", N) is an N-vector, and
+// mvar("A", R, C) reads an array argument of R * C elements as an R x C
+// matrix. dot(x, y), matvec(A, x), matmul(A, B) and transpose(A) lower to
+// fully unrolled straight-line code over the operands' elements, with no
+// loop and no temporary beyond the result array:
+//
+//   constexpr auto A = mvar("A", 3, 3);
+//   constexpr auto p = vec(x, y, Expr::lit(1.0));
+//   constexpr auto q = dot(p, matvec(A, p)); // a quadratic form
+//   math_compile<q>()(x, y, std::array<double, 9>{...});
+//
+// Shapes are checked when a node is built. math.hpp's simplify() cancels
+// double transposes and reassociates products into the cheaper order;
+// differentiate() and gradient() handle them with respect to the scalar
+// variables under vec, through transposes and products. Array arguments
+// are constants. There is no matrix sum to carry the product rule, so a
+// product whose factors both depend on the variable is rejected.
+
+#include <array>
+#include <cstddef>
+#include <refmacro/array.hpp>
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <type_traits>
+#include <utility>
+
+namespace refmacro {
+
+inline constexpr int max_linalg_dim = 8;
+
+// --- Shapes ---
+
+struct Shape {
+    int rows{1};
+    int cols{1};
+};
+
+namespace detail {
+
+// Shape of a linear-algebra operand; scalars (and dot) are 1 x 1.
+template <std::size_t Cap>
+consteval Shape linalg_shape(const AST<Cap>& ast, int id) {
+    const auto& n = ast.nodes[id];
+    auto operand = [&](int i) consteval {
+        return linalg_shape(ast, n.children[i]);
+    };
+    if (str_eq(n.tag, "avar"))
+        return {static_cast<int>(n.payload), 1};
+    if (str_eq(n.tag, "vec"))
+        return {n.child_count, 1};
+    // mat(w): payload is the column count
+    if (str_eq(n.tag, "mat") && n.child_count == 1) {
+        int elems = operand(0).rows;
+        int cols = static_cast<int>(n.payload);
+        if (cols <= 0 || elems % cols != 0)
+            throw "mat: element count is not a multiple of the columns";
+        return {elems / cols, cols};
+    }
+    if (str_eq(n.tag, "transpose") && n.child_count == 1) {
+        Shape s = operand(0);
+        return {s.cols, s.rows};
+    }
+    if (str_eq(n.tag, "dot") && n.child_count == 2) {
+        Shape x = operand(0);
+        Shape y = operand(1);
+        if (x.cols != 1 || y.cols != 1 || x.rows != y.rows)
+            throw "dot: operands must be vectors of equal length";
+        return {1, 1};
+    }
+    if (str_eq(n.tag, "matvec") && n.child_count == 2) {
+        Shape a = operand(0);
+        Shape x = operand(1);
+        if (x.cols != 1 || a.cols != x.rows)
+            throw "matvec: matrix columns must match the vector length";
+        return {a.rows, 1};
+    }
+    if (str_eq(n.tag, "matmul") && n.child_count == 2) {
+        Shape a = operand(0);
+        Shape b = operand(1);
+        if (a.cols != b.rows)
+            throw "matmul: inner dimensions differ";
+        return {a.rows, b.cols};
+    }
+    return {1, 1};
+}
+
+// Whether a node is vector- or matrix-valued rather than a scalar.
+template <std::size_t Cap>
+consteval bool is_linalg_value(const AST<Cap>& ast, int id) {
+    const char* tag = ast.nodes[id].tag;
+    return str_eq(tag, "avar") || str_eq(tag, "vec") || str_eq(tag, "mat") ||
+           str_eq(tag, "transpose") || str_eq(tag, "matvec") ||
+           str_eq(tag, "matmul");
+}
+
+// Shape of the node at e's root, rejecting dimensions beyond the limit and
+// scalars where a vector or matrix is expected.
+template <std::size_t Cap, auto... Ms>
+consteval Shape small_shape(const Expression<Cap, Ms...>& e,
+                            bool linalg_value = true) {
+    if (linalg_value != is_linalg_value(e.ast, e.id))
+        throw linalg_value ? "linalg: expected a vector or matrix operand"
+                           : "vec: components must be scalars";
+    Shape s = linalg_shape(e.ast, e.id);
+    if (s.rows > max_linalg_dim || s.cols > max_linalg_dim)
+        throw "linalg: dimensions are limited to max_linalg_dim";
+    return s;
+}
+
+template <typename Node> consteval Shape operand_shape(int i) {
+    auto v = Node::view().child(i);
+    return linalg_shape(v.ast, v.id);
+}
+
+// f(0) + f(1) + ... + f(N - 1), in that order.
+template <std::size_t N, typename F>
+[[gnu::always_inline]] constexpr auto unrolled_sum(F f) {
+    return [&]<std::size_t... K>(std::index_sequence<K...>) {
+        return (... + f(K));
+    }(std::make_index_sequence<N>{});
+}
+
+// std::array{f(0), ..., f(N - 1)}.
+template <std::size_t N, typename F>
+[[gnu::always_inline]] constexpr auto unrolled_array(F f) {
+    return [&]<std::size_t... K>(std::index_sequence<K...>) {
+        return std::array{f(K)...};
+    }(std::make_index_sequence<N>{});
+}
+
+} // namespace detail
+
+// --- Linear algebra macros ---
+
+// Fully unrolled: at most max_linalg_dim^3 multiply-adds.
+inline constexpr MacroInfo linalg_op{.cost = 16, .pure = true};
+
+inline constexpr auto MVec = defmacro<"vec", pure_op>([](auto... xs) {
+    return [=](auto... a) constexpr {
+        using T = std::common_type_t<decltype(xs(a...))...>;
+        return std::array<T, sizeof...(xs)>{T(xs(a...))...};
+    };
+});
+
+inline constexpr auto MMat = defmacro<"mat", pure_op>([](auto w) {
+    return [=](auto... a) constexpr { return w(a...); };
+});
+
+inline constexpr auto MDot =
+    defmacro<"dot", linalg_op>([](NodeInfo auto node, auto x, auto y) {
+        constexpr auto n = static_cast<std::size_t>(
+            detail::operand_shape<decltype(node)>(0).rows);
+        return [=](auto... a) constexpr {
+            auto u = x(a...);
+            auto v = y(a...);
+            return detail::unrolled_sum<n>(
+                [&](std::size_t k) constexpr { return u[k] * v[k]; });
+        };
+    });
+
+inline constexpr auto MMatVec =
+    defmacro<"matvec", linalg_op>([](NodeInfo auto node, auto m, auto x) {
+        constexpr Shape s = detail::operand_shape<decltype(node)>(0);
+        constexpr auto r = static_cast<std::size_t>(s.rows);
+        constexpr auto c = static_cast<std::size_t>(s.cols);
+        return [=](auto... a) constexpr {
+            auto A = m(a...);
+            auto v = x(a...);
+            return detail::unrolled_array<r>([&](std::size_t i) constexpr {
+                return detail::unrolled_sum<c>([&](std::size_t k) constexpr {
+                    return A[i * c + k] * v[k];
+                });
+            });
+        };
+    });
+
+inline constexpr auto MMatMul =
+    defmacro<"matmul", linalg_op>([](NodeInfo auto node, auto m, auto n) {
+        using Node = decltype(node);
+        constexpr Shape sa = detail::operand_shape<Node>(0);
+        constexpr Shape sb = detail::operand_shape<Node>(1);
+        constexpr auto r = static_cast<std::size_t>(sa.rows);
+        constexpr auto inner = static_cast<std::size_t>(sa.cols);
+        constexpr auto c = static_cast<std::size_t>(sb.cols);
+        return [=](auto... a) constexpr {
+            auto A = m(a...);
+            auto B = n(a...);
+            return detail::unrolled_array<r * c>([&](std::size_t ij) constexpr {
+                std::size_t i = ij / c;
+                std::size_t j = ij % c;
+                return detail::unrolled_sum<inner>(
+                    [&](std::size_t k) constexpr {
+                        return A[i * inner + k] * B[k * c + j];
+                    });
+            });
+        };
+    });
+
+inline constexpr auto MTranspose =
+    defmacro<"transpose", pure_op>([](NodeInfo auto node, auto m) {
+        constexpr Shape s = detail::operand_shape<decltype(node)>(0);
+        constexpr auto r = static_cast<std::size_t>(s.rows);
+        constexpr auto c = static_cast<std::size_t>(s.cols);
+        return [=](auto... a) constexpr {
+            auto A = m(a...);
+            return detail::unrolled_array<r * c>([&](std::size_t ji) constexpr {
+                using T = std::remove_cvref_t<decltype(A[0])>;
+                return T(A[(ji % r) * c + ji / r]);
+            });
+        };
+    });
+
+// --- Linear algebra sugar ---
+
+template <std::size_t Cap = 64>
+consteval auto mvar(const char* name, int rows, int cols) {
+    if (rows <= 0 || cols <= 0)
+        throw "mvar: dimensions must be positive";
+    auto m = MMat(avar<Cap>(name, rows * cols));
+    m.ast.nodes[m.id].payload = cols;
+    detail::small_shape(m);
+    return m;
+}
+
+template <std::size_t Cap, auto... Ms, typename... Es>
+consteval auto vec(Expression<Cap, Ms...> x, Es... xs) {
+    static_assert(1 + sizeof...(Es) <= max_linalg_dim,
+                  "vec: at most max_linalg_dim components");
+    detail::small_shape(x, false);
+    (detail::small_shape(xs, false), ...);
+    return MVec(x, xs...);
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto dot(Expression<Cap, Ms1...> x, Expression<Cap, Ms2...> y) {
+    detail::small_shape(x);
+    detail::small_shape(y);
+    auto e = MDot(x, y);
+    detail::linalg_shape(e.ast, e.id);
+    return e;
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto matvec(Expression<Cap, Ms1...> m, Expression<Cap, Ms2...> x) {
+    detail::small_shape(m);
+    detail::small_shape(x);
+    auto e = MMatVec(m, x);
+    detail::small_shape(e);
+    return e;
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto matmul(Expression<Cap, Ms1...> m, Expression<Cap, Ms2...> n) {
+    detail::small_shape(m);
+    detail::small_shape(n);
+    auto e = MMatMul(m, n);
+    detail::small_shape(e);
+    return e;
+}
+
+template <std::size_t Cap, auto... Ms>
+consteval auto transpose(Expression<Cap, Ms...> m) {
+    detail::small_shape(m);
+    auto e = MTranspose(m);
+    detail::small_shape(e);
+    return e;
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_LINALG_HPP
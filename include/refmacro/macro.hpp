@@ -3,6 +3,7 @@
 
 #include <refmacro/ast.hpp>
 #include <refmacro/expr.hpp>
+#include <type_traits>
 
 namespace refmacro {
 
@@ -16,15 +17,83 @@ template <std::size_t N> struct FixedString {
     }
 };
 
+// --- MacroInfo: static cost annotation consulted by the compiler ---
+//
+// cost: relative cost of one evaluation, in units of a scalar add.
+// pure: the lowering has no side effects and cannot trap, so it is safe to
+//       evaluate speculatively (e.g. both arms of a cond). Unannotated
+//       macros are conservatively impure.
+
+struct MacroInfo {
+    int cost{1};
+    bool pure{false};
+};
+
+// A cheap, side-effect-free scalar operation (add, compare, ...).
+inline constexpr MacroInfo pure_op{.cost = 1, .pure = true};
+
+// --- Backends: alternative lowerings selected by compile<e, Backend>() ---
+
+namespace backend {
+struct generic {};  // the lowering passed first to defmacro
+struct scalar {};   // plain scalar code
+struct batch {};    // several lanes per call (SIMD)
+struct interval {}; // interval arithmetic
+struct dual {};     // forward-mode dual numbers
+struct fast {};     // approximate, branch-free math (vectorizes)
+} // namespace backend
+
+template <typename Backend, typename CompileFn> struct Lowering {
+    using backend_type = Backend;
+    using fn_type = CompileFn;
+};
+
+// Named lowering for one backend, passed to defmacro after the generic one.
+template <typename Backend, typename CompileFn>
+consteval auto lower(CompileFn) {
+    return Lowering<Backend, CompileFn>{};
+}
+
+namespace detail {
+template <typename Backend, typename Generic, typename... Lowerings>
+struct pick_lowering {
+    using type = Generic;
+};
+template <typename Backend, typename Generic, typename L, typename... Ls>
+struct pick_lowering<Backend, Generic, L, Ls...>
+    : std::conditional_t<std::is_same_v<Backend, typename L::backend_type>,
+                         std::type_identity<typename L::fn_type>,
+                         pick_lowering<Backend, Generic, Ls...>> {};
+} // namespace detail
+
 // --- MacroSpec: type-level macro identity ---
 
-template <FixedString Tag, typename CompileFn> struct MacroSpec {
+template <FixedString Tag, typename CompileFn, MacroInfo Info = MacroInfo{},
+          typename... Lowerings>
+struct MacroSpec {
     static constexpr auto tag = Tag;
+    static constexpr MacroInfo info = Info;
     static consteval auto compile_fn() { return CompileFn{}; }
+    // Lowering for Backend, or the generic one if none was given
+    template <typename Backend> static consteval auto compile_fn_for() {
+        return typename detail::pick_lowering<Backend, CompileFn,
+                                              Lowerings...>::type{};
+    }
 };
 
 // --- MacroCaller: callable with AST creation + macro tracking ---
 
+namespace detail {
+// Expression<Cap, Ms1..., Ms2..., ...>: the macro packs of Es, joined.
+template <typename... Es> struct joined;
+template <std::size_t Cap, auto... Ms> struct joined<Expression<Cap, Ms...>> {
+    using type = Expression<Cap, Ms...>;
+};
+template <std::size_t Cap, auto... Ms1, auto... Ms2, typename... Es>
+struct joined<Expression<Cap, Ms1...>, Expression<Cap, Ms2...>, Es...>
+    : joined<Expression<Cap, Ms1..., Ms2...>, Es...> {};
+} // namespace detail
+
 template <typename Spec> struct MacroCaller {
     using spec_type = Spec;
     static_assert(sizeof(Spec::tag.data) <= 16,
@@ -33,9 +102,14 @@ template <typename Spec> struct MacroCaller {
     // Backward-compatible fields (same layout as old Macro)
     char tag[16]{};
     decltype(Spec::compile_fn()) fn{};
+    static constexpr MacroInfo info = Spec::info;
 
     consteval MacroCaller() { copy_str(tag, Spec::tag.data); }
 
+    template <typename Backend> static consteval auto lowering() {
+        return Spec::template compile_fn_for<Backend>();
+    }
+
     // Nullary
     template <std::size_t Cap = 64> consteval auto operator()() const {
         constexpr MacroCaller self{};
@@ -97,13 +171,34 @@ template <typename Spec> struct MacroCaller {
             tag, {c0.id, c1.id + off1, c2.id + off2, c3.id + off3});
         return result;
     }
+
+    // 5 to 8 children
+    template <std::size_t Cap, auto... Ms, typename... Rest>
+        requires(sizeof...(Rest) >= 4 && sizeof...(Rest) <= 7)
+    consteval auto operator()(Expression<Cap, Ms...> c0, Rest... rest) const {
+        constexpr MacroCaller self{};
+        typename detail::joined<Expression<Cap, self, Ms...>, Rest...>::type
+            result;
+        result.ast = c0.ast;
+        int ids[1 + sizeof...(Rest)]{c0.id};
+        int k = 1;
+        ((ids[k++] = rest.id + result.ast.merge(rest.ast)), ...);
+        result.id = result.ast.add_tagged_node(tag, ids, 1 + sizeof...(Rest));
+        return result;
+    }
 };
 
 // --- New defmacro: tag as NTTP ---
-
-template <FixedString Tag, typename CompileFn>
-consteval auto defmacro(CompileFn) {
-    return MacroCaller<MacroSpec<Tag, CompileFn>>{};
+//
+//   defmacro<"add">(lower_fn)
+//   defmacro<"add", pure_op>(lower_fn)
+//   defmacro<"div", MacroInfo{.cost = 4}>(lower_fn)
+//   defmacro<"add">(lower_fn, lower<backend::batch>(simd_fn))
+
+template <FixedString Tag, MacroInfo Info = MacroInfo{}, typename CompileFn,
+          typename... Lowerings>
+consteval auto defmacro(CompileFn, Lowerings...) {
+    return MacroCaller<MacroSpec<Tag, CompileFn, Info, Lowerings...>>{};
 }
 
 } // namespace refmacro
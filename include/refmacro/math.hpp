@@ -1,35 +1,432 @@
 #ifndef REFMACRO_MATH_HPP
 #define REFMACRO_MATH_HPP
 
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <refmacro/ast.hpp>
 #include <refmacro/compile.hpp>
+#include <refmacro/eval.hpp>
 #include <refmacro/expr.hpp>
+#include <initializer_list>
+#include <refmacro/linalg.hpp>
 #include <refmacro/macro.hpp>
+#include <refmacro/passes.hpp>
 #include <refmacro/transforms.hpp>
+#include <type_traits>
 
 namespace refmacro {
 
 // --- Math macros (lowering to lambdas) ---
+// Division is annotated impure: integer division by zero traps, so it must
+// not be evaluated speculatively.
 
-inline constexpr auto MAdd = defmacro<"add">([](auto lhs, auto rhs) {
+inline constexpr auto MAdd = defmacro<"add", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) + rhs(a...); };
 });
 
-inline constexpr auto MSub = defmacro<"sub">([](auto lhs, auto rhs) {
+inline constexpr auto MSub = defmacro<"sub", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) - rhs(a...); };
 });
 
-inline constexpr auto MMul = defmacro<"mul">([](auto lhs, auto rhs) {
+inline constexpr auto MMul = defmacro<"mul", pure_op>([](auto lhs, auto rhs) {
     return [=](auto... a) constexpr { return lhs(a...) * rhs(a...); };
 });
 
-inline constexpr auto MDiv = defmacro<"div">([](auto lhs, auto rhs) {
-    return [=](auto... a) constexpr { return lhs(a...) / rhs(a...); };
-});
+inline constexpr auto MDiv =
+    defmacro<"div", MacroInfo{.cost = 4}>([](auto lhs, auto rhs) {
+        return [=](auto... a) constexpr { return lhs(a...) / rhs(a...); };
+    });
 
-inline constexpr auto MNeg = defmacro<"neg">(
+inline constexpr auto MNeg = defmacro<"neg", pure_op>(
     [](auto x) { return [=](auto... a) constexpr { return -x(a...); }; });
 
+// --- Transcendental macros ---
+//
+// exp, log, sqrt, sin, cos, tanh and pow. The generic lowering calls the
+// libm function, found by unqualified lookup so that number types such as
+// Dual supply their own overloads. compile<e, backend::fast>() selects the
+// fast lowerings instead: branch-free polynomial approximations with no
+// table lookups, which the optimizer can vectorize. Over the normal range
+// exp is within 1 ulp of the true value, and log, sin, cos and tanh within
+// 2. pow is exp(y log x), so log's rounding grows with |y log x|: 20 ulp
+// at x^y near 1e7. sqrt has no fast lowering; the libm call is already a
+// single vector instruction.
+
+namespace detail {
+
+// --- Fast approximations: constexpr, branch-free ---
+
+inline constexpr double ln2_hi = 6.93147180369123816490e-01;
+inline constexpr double ln2_lo = 1.90821492927058770002e-10;
+inline constexpr double log2e = 1.44269504088896338700e+00;
+// pi / 2 in three parts; k * pio2_1 is exact for |k| < 2^20
+inline constexpr double pio2_1 = 1.57079632673412561417e+00;
+inline constexpr double pio2_2 = 6.07710050630396597660e-11;
+inline constexpr double pio2_3 = 2.02226624871116645580e-21;
+inline constexpr double two_over_pi = 6.36619772367581382433e-01;
+
+// Adding and subtracting 1.5 * 2^52 rounds to the nearest integer.
+constexpr double round_nearest(double x) {
+    constexpr double magic = 6755399441055744.0;
+    return (x + magic) - magic;
+}
+
+constexpr bool is_finite(double x) { return x - x == 0.0; }
+
+// 2^k for integral k in the normal exponent range
+constexpr double exp2_int(double k) {
+    auto e = static_cast<std::uint64_t>(static_cast<std::int64_t>(k) + 1023);
+    return std::bit_cast<double>(e << 52);
+}
+
+// e^r - 1 for |r| <= ln2 / 2: the degree-13 Taylor polynomial without its
+// constant term, so a small result does not cancel.
+constexpr double expm1_reduced(double r) {
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    return p * r;
+}
+
+// e^x = 2^k * e^r with |r| <= ln2 / 2.
+constexpr double fast_exp(double x) {
+    double xc = x > 709.0 ? 709.0 : x < -708.0 ? -708.0 : x;
+    xc = xc == xc ? xc : 0.0;
+    double k = round_nearest(xc * log2e);
+    double r = (xc - k * ln2_hi) - k * ln2_lo;
+    double y = (1.0 + expm1_reduced(r)) * exp2_int(k);
+    y = x > 709.0 ? std::numeric_limits<double>::infinity() : y;
+    y = x < -708.0 ? 0.0 : y;
+    return x == x ? y : x;
+}
+
+// e^x - 1 = 2^k (e^r - 1) + (2^k - 1); near zero, where k = 0, just
+// e^r - 1, which keeps the sign of a zero.
+constexpr double fast_expm1(double x) {
+    double xc = x > 709.0 ? 709.0 : x < -708.0 ? -708.0 : x;
+    xc = xc == xc ? xc : 0.0;
+    double k = round_nearest(xc * log2e);
+    double r = (xc - k * ln2_hi) - k * ln2_lo;
+    double s = exp2_int(k);
+    double u = expm1_reduced(r);
+    double y = k == 0.0 ? u : s * u + (s - 1.0);
+    y = x > 709.0 ? std::numeric_limits<double>::infinity() : y;
+    y = x < -708.0 ? -1.0 : y;
+    return x == x ? y : x;
+}
+
+// x = 2^e * m with m in [sqrt(1/2), sqrt(2)); log m = 2 atanh(s) with
+// s = (m - 1) / (m + 1), |s| <= 0.172, as an odd series up to s^19.
+constexpr double fast_log(double x) {
+    auto bits = std::bit_cast<std::uint64_t>(x);
+    auto biased = static_cast<std::int64_t>(bits >> 52);
+    double e = static_cast<double>(biased - 1023);
+    double m = std::bit_cast<double>((bits & 0x000FFFFFFFFFFFFFull) |
+                                     0x3FF0000000000000ull);
+    bool high = m > 1.41421356237309504880;
+    m = high ? m * 0.5 : m;
+    e = high ? e + 1.0 : e;
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s;
+    double p = 1.0 / 19.0;
+    p = p * s2 + 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    p = p * s2 + 1.0;
+    double y = e * ln2_hi + (2.0 * s * p + e * ln2_lo);
+    y = x == 0.0 ? -std::numeric_limits<double>::infinity() : y;
+    y = x == std::numeric_limits<double>::infinity() ? x : y;
+    return x < 0.0 || x != x ? std::numeric_limits<double>::quiet_NaN() : y;
+}
+
+struct SinCos {
+    double sin;
+    double cos;
+};
+
+// x = k * pi/2 + r with |r| <= pi/4; Taylor polynomials of degree 15 (sin)
+// and 16 (cos) for r, then the quadrant k mod 4 picks and negates them.
+// Accurate for |x| below about 1e6.
+constexpr SinCos fast_sincos(double x) {
+    double xc = is_finite(x) ? x : 0.0;
+    double k = round_nearest(xc * two_over_pi);
+    double r = ((xc - k * pio2_1) - k * pio2_2) - k * pio2_3;
+    double r2 = r * r;
+    double ps = -1.0 / 1307674368000.0;
+    ps = ps * r2 + 1.0 / 6227020800.0;
+    ps = ps * r2 - 1.0 / 39916800.0;
+    ps = ps * r2 + 1.0 / 362880.0;
+    ps = ps * r2 - 1.0 / 5040.0;
+    ps = ps * r2 + 1.0 / 120.0;
+    ps = ps * r2 - 1.0 / 6.0;
+    double sr = r + r * r2 * ps;
+    double pc = 1.0 / 20922789888000.0;
+    pc = pc * r2 - 1.0 / 87178291200.0;
+    pc = pc * r2 + 1.0 / 479001600.0;
+    pc = pc * r2 - 1.0 / 3628800.0;
+    pc = pc * r2 + 1.0 / 40320.0;
+    pc = pc * r2 - 1.0 / 720.0;
+    pc = pc * r2 + 1.0 / 24.0;
+    pc = pc * r2 - 0.5;
+    double cr = 1.0 + r2 * pc;
+    auto q = static_cast<std::int64_t>(k) & 3;
+    double s = (q & 1) ? cr : sr;
+    double c = (q & 1) ? sr : cr;
+    s = (q & 2) ? -s : s;
+    c = ((q + 1) & 2) ? -c : c;
+    constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+    return {is_finite(x) ? s : nan, is_finite(x) ? c : nan};
+}
+
+constexpr double fast_sin(double x) { return fast_sincos(x).sin; }
+constexpr double fast_cos(double x) { return fast_sincos(x).cos; }
+
+// tanh x = m / (m + 2) with m = e^2x - 1, which does not cancel near
+// zero. Past |x| = 20 tanh rounds to +-1, so x is clamped there.
+constexpr double fast_tanh(double x) {
+    double xc = x > 20.0 ? 20.0 : x < -20.0 ? -20.0 : x;
+    double m = fast_expm1(2.0 * xc);
+    double t = m / (m + 2.0);
+    return x == x ? t : x;
+}
+
+// x^y = e^(y log x) for x >= 0; negative bases give NaN.
+constexpr double fast_pow(double x, double y) {
+    double r = fast_exp(y * fast_log(x));
+    return y == 0.0 ? 1.0 : r;
+}
+
+} // namespace detail
+
+inline constexpr MacroInfo transcendental_op{.cost = 20, .pure = true};
+
+inline constexpr auto MExp = defmacro<"exp", transcendental_op>(
+    [](auto x) {
+        return [=](auto... a) constexpr {
+            using std::exp;
+            return exp(x(a...));
+        };
+    },
+    lower<backend::fast>([](auto x) {
+        return [=](auto... a) constexpr { return detail::fast_exp(x(a...)); };
+    }));
+
+inline constexpr auto MLog = defmacro<"log", transcendental_op>(
+    [](auto x) {
+        return [=](auto... a) constexpr {
+            using std::log;
+            return log(x(a...));
+        };
+    },
+    lower<backend::fast>([](auto x) {
+        return [=](auto... a) constexpr { return detail::fast_log(x(a...)); };
+    }));
+
+inline constexpr auto MSqrt =
+    defmacro<"sqrt", MacroInfo{.cost = 6, .pure = true}>([](auto x) {
+        return [=](auto... a) constexpr {
+            using std::sqrt;
+            return sqrt(x(a...));
+        };
+    });
+
+inline constexpr auto MSin = defmacro<"sin", transcendental_op>(
+    [](auto x) {
+        return [=](auto... a) constexpr {
+            using std::sin;
+            return sin(x(a...));
+        };
+    },
+    lower<backend::fast>([](auto x) {
+        return [=](auto... a) constexpr { return detail::fast_sin(x(a...)); };
+    }));
+
+inline constexpr auto MCos = defmacro<"cos", transcendental_op>(
+    [](auto x) {
+        return [=](auto... a) constexpr {
+            using std::cos;
+            return cos(x(a...));
+        };
+    },
+    lower<backend::fast>([](auto x) {
+        return [=](auto... a) constexpr { return detail::fast_cos(x(a...)); };
+    }));
+
+inline constexpr auto MTanh = defmacro<"tanh", transcendental_op>(
+    [](auto x) {
+        return [=](auto... a) constexpr {
+            using std::tanh;
+            return tanh(x(a...));
+        };
+    },
+    lower<backend::fast>([](auto x) {
+        return [=](auto... a) constexpr {
+            return detail::fast_tanh(x(a...));
+        };
+    }));
+
+inline constexpr auto MPow =
+    defmacro<"pow", MacroInfo{.cost = 40, .pure = true}>(
+        [](auto base, auto exponent) {
+            return [=](auto... a) constexpr {
+                using std::pow;
+                return pow(base(a...), exponent(a...));
+            };
+        },
+        lower<backend::fast>([](auto base, auto exponent) {
+            return [=](auto... a) constexpr {
+                return detail::fast_pow(base(a...), exponent(a...));
+            };
+        }));
+
+// --- Loop macros ---
+//
+// sum(i, lo, hi, body), product(i, lo, hi, body) and
+// fold_range(acc, init, i, lo, hi, body) run i over the integers in
+// [lo, hi). The body is stored once, under a lambda binding i (and acc), so
+// the AST does not grow with the trip count; compile lowers each loop to a
+// for loop calling the body's closure:
+//
+//   constexpr auto e = sum("i", 0, 64, x * Expr::var("i"));
+//   compile<e>()(2.0); // 2 * (0 + 1 + ... + 63), one node per term kind
+//
+// Bounds may be any expression and are truncated to integers. i reaches
+// the body in the evaluation type of the arguments, so a float or integer
+// kernel's loop stays in float or integer code. The loop node's payload is
+// its unroll factor: 0 (the default) unrolls loops with literal bounds
+// completely up to full_unroll_limit trips and leaves the rest rolled for
+// the optimizer; a positive factor unrolls by that many iterations plus a
+// rolled remainder. Iterations are combined in order, so the factor never
+// changes the result.
+
+namespace detail {
+
+inline constexpr int full_unroll_limit = 16;
+
+// Trip count of [lo, hi) when both bounds are literals, else -1.
+template <std::size_t Cap>
+consteval long long literal_trips(NodeView<Cap> lo, NodeView<Cap> hi) {
+    if (lo.tag() != "lit" || hi.tag() != "lit")
+        return -1;
+    auto t = static_cast<long long>(hi.payload()) -
+             static_cast<long long>(lo.payload());
+    return t < 0 ? 0 : t;
+}
+
+template <typename Node, int First> consteval long long loop_trips() {
+    return literal_trips(Node::child(First), Node::child(First + 1));
+}
+
+template <typename Node, int First> consteval int unroll_factor() {
+    int requested = static_cast<int>(Node::payload());
+    long long trips = loop_trips<Node, First>();
+    if (requested > 0)
+        return requested;
+    return trips >= 0 && trips <= full_unroll_limit ? static_cast<int>(trips)
+                                                    : 1;
+}
+
+// The type a loop body receives its index in: the evaluation type of the
+// loop's arguments (see eval_type_t), so the index does not pull a float
+// or integer body's literals up to double; double without arithmetic
+// arguments.
+template <typename... A>
+using index_type_t =
+    std::conditional_t<std::is_same_v<eval_type_t<A...>, bool>, double,
+                       eval_type_t<A...>>;
+
+// acc = step(acc, i) for i in [lo, hi), U iterations per round, with i
+// passed as an I.
+template <int U, long long Trips, typename I, typename Acc, typename Step>
+[[gnu::always_inline]] constexpr Acc run_loop(long long lo, long long hi,
+                                              Acc acc, Step step) {
+    auto round = [&]<int... K>(long long i, std::integer_sequence<int, K...>) {
+        ((acc = step(acc, static_cast<I>(i + K))), ...);
+    };
+    if constexpr (Trips >= 0 && Trips <= U) {
+        round(lo, std::make_integer_sequence<int, static_cast<int>(Trips)>{});
+    } else {
+        long long i = lo;
+        if constexpr (U > 1)
+            for (; hi - i >= U; i += U)
+                round(i, std::make_integer_sequence<int, U>{});
+        for (; i < hi; ++i)
+            acc = step(acc, static_cast<I>(i));
+    }
+    return acc;
+}
+
+template <typename Node, typename Lo, typename Hi, typename Body,
+          typename Combine>
+constexpr auto lower_reduction(Lo lo, Hi hi, Body body, double identity,
+                               Combine combine) {
+    return [=](auto... a) constexpr {
+        using I = index_type_t<decltype(a)...>;
+        auto f = body(a...);
+        using R = std::remove_cvref_t<decltype(f(I{}))>;
+        return run_loop<unroll_factor<Node, 0>(), loop_trips<Node, 0>(), I>(
+            static_cast<long long>(lo(a...)),
+            static_cast<long long>(hi(a...)), R(identity),
+            [&](const R& acc, I i) constexpr {
+                return R(combine(acc, f(i)));
+            });
+    };
+}
+
+} // namespace detail
+
+// A loop costs more than any arm cond would evaluate eagerly.
+inline constexpr MacroInfo loop_op{.cost = 16, .pure = true};
+
+inline constexpr auto MSum = defmacro<"sum", loop_op>(
+    [](NodeInfo auto node, auto lo, auto hi, auto body) {
+        return detail::lower_reduction<decltype(node)>(
+            lo, hi, body, 0.0,
+            [](const auto& s, const auto& v) constexpr { return s + v; });
+    });
+
+inline constexpr auto MProduct = defmacro<"product", loop_op>(
+    [](NodeInfo auto node, auto lo, auto hi, auto body) {
+        return detail::lower_reduction<decltype(node)>(
+            lo, hi, body, 1.0,
+            [](const auto& p, const auto& v) constexpr { return p * v; });
+    });
+
+inline constexpr auto MFoldRange = defmacro<"fold_range", loop_op>(
+    [](NodeInfo auto node, auto init, auto lo, auto hi, auto body) {
+        using Node = decltype(node);
+        return [=](auto... a) constexpr {
+            using I = detail::index_type_t<decltype(a)...>;
+            auto f = body(a...); // f(acc)(i)
+            auto start = init(a...);
+            using R = std::remove_cvref_t<decltype(f(start)(I{}))>;
+            return detail::run_loop<detail::unroll_factor<Node, 1>(),
+                                    detail::loop_trips<Node, 1>(), I>(
+                static_cast<long long>(lo(a...)),
+                static_cast<long long>(hi(a...)), R(start),
+                [&](const R& acc, I i) constexpr {
+                    return R(f(acc)(i));
+                });
+        };
+    });
+
 // --- Operator sugar (auto-tracks macros via MacroCaller delegation) ---
 
 template <std::size_t Cap, auto... Ms1, auto... Ms2>
@@ -57,65 +454,408 @@ consteval auto operator-(Expression<Cap, Ms...> x) {
     return MNeg(x);
 }
 
-// double on LHS
-template <std::size_t Cap, auto... Ms>
-consteval auto operator+(double lhs, Expression<Cap, Ms...> rhs) {
+// A number on the LHS: an integral one builds an integer literal
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator+(T lhs, Expression<Cap, Ms...> rhs) {
     return MAdd(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator-(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator-(T lhs, Expression<Cap, Ms...> rhs) {
     return MSub(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator*(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator*(T lhs, Expression<Cap, Ms...> rhs) {
     return MMul(Expression<Cap>::lit(lhs), rhs);
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator/(double lhs, Expression<Cap, Ms...> rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator/(T lhs, Expression<Cap, Ms...> rhs) {
     return MDiv(Expression<Cap>::lit(lhs), rhs);
 }
 
-// double on RHS
-template <std::size_t Cap, auto... Ms>
-consteval auto operator+(Expression<Cap, Ms...> lhs, double rhs) {
+// A number on the RHS
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator+(Expression<Cap, Ms...> lhs, T rhs) {
     return MAdd(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator-(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator-(Expression<Cap, Ms...> lhs, T rhs) {
     return MSub(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator*(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator*(Expression<Cap, Ms...> lhs, T rhs) {
     return MMul(lhs, Expression<Cap>::lit(rhs));
 }
-template <std::size_t Cap, auto... Ms>
-consteval auto operator/(Expression<Cap, Ms...> lhs, double rhs) {
+template <typename T, std::size_t Cap, auto... Ms>
+    requires std::is_arithmetic_v<T>
+consteval auto operator/(Expression<Cap, Ms...> lhs, T rhs) {
     return MDiv(lhs, Expression<Cap>::lit(rhs));
 }
 
+// Function sugar for the transcendental macros
+template <std::size_t Cap, auto... Ms>
+consteval auto exp(Expression<Cap, Ms...> x) {
+    return MExp(x);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto log(Expression<Cap, Ms...> x) {
+    return MLog(x);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto sqrt(Expression<Cap, Ms...> x) {
+    return MSqrt(x);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto sin(Expression<Cap, Ms...> x) {
+    return MSin(x);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto cos(Expression<Cap, Ms...> x) {
+    return MCos(x);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto tanh(Expression<Cap, Ms...> x) {
+    return MTanh(x);
+}
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto pow(Expression<Cap, Ms1...> base,
+                   Expression<Cap, Ms2...> exponent) {
+    return MPow(base, exponent);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto pow(Expression<Cap, Ms...> base, double exponent) {
+    return MPow(base, Expression<Cap>::lit(exponent));
+}
+
+// --- Loop sugar ---
+
+namespace detail {
+
+// lambda(param, body), as control.hpp's lambda() builds it.
+template <std::size_t Cap, auto... Ms>
+consteval Expression<Cap, Ms...> binder(const char* param,
+                                        Expression<Cap, Ms...> body) {
+    Expression<Cap, Ms...> result;
+    result.ast = body.ast;
+    ASTNode param_node{};
+    copy_str(param_node.tag, "var");
+    copy_str(param_node.name, param);
+    int param_id = result.ast.add_node(param_node);
+    result.id = result.ast.add_tagged_node("lambda", {param_id, body.id});
+    return result;
+}
+
+template <std::size_t Cap, auto... Ms>
+consteval Expression<Cap, Ms...> with_unroll(Expression<Cap, Ms...> loop,
+                                             int unroll) {
+    if (unroll < 0)
+        throw "loop unroll factor must be >= 0";
+    loop.ast.nodes[loop.id].payload = unroll;
+    return loop;
+}
+
+// Whether name occurs free in the subtree at id.
+template <std::size_t Cap>
+consteval bool occurs_free(const AST<Cap>& ast, int id, const char* name) {
+    const auto& n = ast.nodes[id];
+    if (str_eq(n.tag, "var"))
+        return str_eq(n.name, name);
+    if (str_eq(n.tag, "lambda") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].name, name))
+        return false;
+    for (int i = 0; i < n.child_count; ++i)
+        if (occurs_free(ast, n.children[i], name))
+            return true;
+    return false;
+}
+
+} // namespace detail
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2, auto... Ms3>
+consteval auto sum(const char* i, Expression<Cap, Ms1...> lo,
+                   Expression<Cap, Ms2...> hi, Expression<Cap, Ms3...> body,
+                   int unroll = 0) {
+    return detail::with_unroll(MSum(lo, hi, detail::binder(i, body)), unroll);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto sum(const char* i, int lo, int hi, Expression<Cap, Ms...> body,
+                   int unroll = 0) {
+    return sum(i, Expression<Cap>::lit(lo), Expression<Cap>::lit(hi), body,
+               unroll);
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2, auto... Ms3>
+consteval auto product(const char* i, Expression<Cap, Ms1...> lo,
+                       Expression<Cap, Ms2...> hi,
+                       Expression<Cap, Ms3...> body, int unroll = 0) {
+    return detail::with_unroll(MProduct(lo, hi, detail::binder(i, body)),
+                               unroll);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto product(const char* i, int lo, int hi,
+                       Expression<Cap, Ms...> body, int unroll = 0) {
+    return product(i, Expression<Cap>::lit(lo), Expression<Cap>::lit(hi),
+                   body, unroll);
+}
+
+// acc starts at init; each iteration replaces it with body.
+template <std::size_t Cap, auto... Ms1, auto... Ms2, auto... Ms3,
+          auto... Ms4>
+consteval auto fold_range(const char* acc, Expression<Cap, Ms1...> init,
+                          const char* i, Expression<Cap, Ms2...> lo,
+                          Expression<Cap, Ms3...> hi,
+                          Expression<Cap, Ms4...> body, int unroll = 0) {
+    return detail::with_unroll(
+        MFoldRange(init, lo, hi, detail::binder(acc, detail::binder(i, body))),
+        unroll);
+}
+template <std::size_t Cap, auto... Ms>
+consteval auto fold_range(const char* acc, double init, const char* i, int lo,
+                          int hi, Expression<Cap, Ms...> body,
+                          int unroll = 0) {
+    return fold_range(acc, Expression<Cap>::lit(init), i,
+                      Expression<Cap>::lit(lo), Expression<Cap>::lit(hi), body,
+                      unroll);
+}
+
 // --- Convenience: compile with all math macros ---
 
 template <auto e> consteval auto math_compile() {
-    return compile<e, MAdd, MSub, MMul, MDiv, MNeg>();
+    return compile<e, MAdd, MSub, MMul, MDiv, MNeg, MExp, MLog, MSqrt, MSin,
+                   MCos, MTanh, MPow, MSum, MProduct, MFoldRange, MVec, MMat,
+                   MDot, MMatVec, MMatMul, MTranspose>();
+}
+
+// --- Smart constructors: simplify while building ---
+//
+// smart::add(a, b) and friends build the same node as a + b, but first
+// apply simplify()'s identities and literal folding to the new root only:
+// 0 + x -> x, x * 1 -> x, x * 0 -> 0, 2 * 3 -> 6, --x -> x, ... No tree is
+// walked, so a transform that builds its output through them never
+// materializes the terms simplify() would remove. The result type is the
+// one a + b would have.
+
+namespace smart {
+
+namespace detail {
+
+template <std::size_t Cap, auto... Ms>
+consteval bool is_lit(const Expression<Cap, Ms...>& e) {
+    return str_eq(e.ast.nodes[e.id].tag, "lit");
 }
 
+template <std::size_t Cap, auto... Ms>
+consteval bool is_lit(const Expression<Cap, Ms...>& e, double v) {
+    return is_lit(e) && e.ast.nodes[e.id].payload == v;
+}
+
+template <std::size_t Cap, auto... Ms>
+consteval double lit_value(const Expression<Cap, Ms...>& e) {
+    return e.ast.nodes[e.id].payload;
+}
+
+// Whether a literal folded from a and b is an integer one (int_operands).
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval bool int_lits(const Expression<Cap, Ms1...>& a,
+                        const Expression<Cap, Ms2...>& b) {
+    return is_int_lit(a.ast.nodes[a.id]) && is_int_lit(b.ast.nodes[b.id]);
+}
+
+} // namespace detail
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto add(Expression<Cap, Ms1...> a, Expression<Cap, Ms2...> b) {
+    using R = decltype(MAdd(a, b));
+    if (detail::is_lit(a) && detail::is_lit(b))
+        return R(Expression<Cap>::lit(detail::lit_value(a) +
+                                          detail::lit_value(b),
+                                      detail::int_lits(a, b)));
+    if (detail::is_lit(a, 0.0))
+        return R(b);
+    if (detail::is_lit(b, 0.0))
+        return R(a);
+    return MAdd(a, b);
+}
+
+template <std::size_t Cap, auto... Ms>
+consteval auto neg(Expression<Cap, Ms...> a) {
+    using R = decltype(MNeg(a));
+    if (detail::is_lit(a))
+        return R(Expression<Cap>::lit(-detail::lit_value(a),
+                                      is_int_lit(a.ast.nodes[a.id])));
+    const auto& n = a.ast.nodes[a.id];
+    if (str_eq(n.tag, "neg") && n.child_count == 1)
+        return R(Expression<Cap>(a.ast, n.children[0]));
+    return MNeg(a);
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto sub(Expression<Cap, Ms1...> a, Expression<Cap, Ms2...> b) {
+    using R = decltype(MSub(a, b));
+    if (detail::is_lit(a) && detail::is_lit(b))
+        return R(Expression<Cap>::lit(detail::lit_value(a) -
+                                          detail::lit_value(b),
+                                      detail::int_lits(a, b)));
+    if (detail::is_lit(b, 0.0))
+        return R(a);
+    if (detail::is_lit(a, 0.0))
+        return R(neg(b));
+    return MSub(a, b);
+}
+
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto mul(Expression<Cap, Ms1...> a, Expression<Cap, Ms2...> b) {
+    using R = decltype(MMul(a, b));
+    if (detail::is_lit(a) && detail::is_lit(b))
+        return R(Expression<Cap>::lit(detail::lit_value(a) *
+                                          detail::lit_value(b),
+                                      detail::int_lits(a, b)));
+    // Keep the zero's kind
+    if (detail::is_lit(a, 0.0))
+        return R(a);
+    if (detail::is_lit(b, 0.0))
+        return R(b);
+    if (detail::is_lit(a, 1.0))
+        return R(b);
+    if (detail::is_lit(b, 1.0))
+        return R(a);
+    return MMul(a, b);
+}
+
+// x / 0, and integer literals that do not divide, are left for the
+// runtime, as in simplify().
+template <std::size_t Cap, auto... Ms1, auto... Ms2>
+consteval auto div(Expression<Cap, Ms1...> a, Expression<Cap, Ms2...> b) {
+    using R = decltype(MDiv(a, b));
+    if (detail::is_lit(a) && detail::is_lit(b) && !detail::is_lit(b, 0.0)) {
+        double q = detail::lit_value(a) / detail::lit_value(b);
+        bool integral = detail::int_lits(a, b);
+        if (!integral || is_integral_value(q))
+            return R(Expression<Cap>::lit(q, integral));
+    }
+    if (detail::is_lit(b, 1.0))
+        return R(a);
+    return MDiv(a, b);
+}
+
+} // namespace smart
+
 // --- simplify: algebraic identities + constant folding ---
 
 namespace detail {
-consteval double eval_op(std::string_view tag, double lhs, double rhs) {
-    if (tag == "add")
-        return lhs + rhs;
-    if (tag == "sub")
-        return lhs - rhs;
-    if (tag == "mul")
-        return lhs * rhs;
-    if (tag == "div") {
-        if (rhs == 0.0)
-            throw "division by zero in constant folding";
-        return lhs / rhs;
+
+// Loops with literal bounds: no trips -> identity (or init), one trip ->
+// let i = lo in body, a literal body -> its closed form.
+template <std::size_t Cap>
+consteval std::optional<Expression<Cap>> simplify_loop(NodeView<Cap> n) {
+    if (n.tag() == "fold_range" && n.child_count() == 4) {
+        long long trips = literal_trips(n.child(1), n.child(2));
+        auto outer = n.child(3);
+        if (trips == 0)
+            return to_expr(n, n.child(0));
+        // let acc = init in let i = lo in body
+        if (trips == 1) {
+            Expression<Cap> body =
+                make_node("apply", to_expr(n, outer.child(1)),
+                          to_expr(n, n.child(1)));
+            return make_node("apply",
+                             binder(n.ast.nodes[outer.child(0).id].name, body),
+                             to_expr(n, n.child(0)));
+        }
+        return std::nullopt;
+    }
+    if (n.child_count() != 3)
+        return std::nullopt;
+    bool is_sum = n.tag() == "sum";
+    long long trips = literal_trips(n.child(0), n.child(1));
+    auto fn = n.child(2);
+    // The result has the body's kind: an integer literal body folds to an
+    // integer literal, as fold_literals does.
+    bool int_body = is_int_lit(n.ast.nodes[fn.child(1).id]);
+    if (trips == 0)
+        return Expression<Cap>::lit(is_sum ? 0.0 : 1.0, int_body);
+    if (trips == 1)
+        return make_node("apply", to_expr(n, fn), to_expr(n, n.child(0)));
+    if (trips > 1 && fn.child(1).tag() == "lit") {
+        double v = fn.child(1).payload();
+        double r = is_sum ? static_cast<double>(trips) * v : 1.0;
+        for (long long k = 0; !is_sum && k < trips; ++k)
+            r *= v;
+        if (int_body && !is_integral_value(r))
+            return std::nullopt;
+        return Expression<Cap>::lit(r, int_body);
     }
-    return 0.0;
+    return std::nullopt;
 }
+
+// lit op lit -> lit for the arithmetic ops, an integer literal when both
+// operands are and the result is exact (see int_operands).
+template <std::size_t Cap>
+consteval std::optional<Expression<Cap>> fold_literals(NodeView<Cap> n) {
+    if (n.tag() != "add" && n.tag() != "sub" && n.tag() != "mul" &&
+        n.tag() != "div")
+        return std::nullopt;
+    double v = eval_closed(n.ast, n.id);
+    bool integral = int_operands(n.ast, n.ast.nodes[n.id]);
+    if (integral && !is_integral_value(v))
+        return std::nullopt;
+    return Expression<Cap>::lit(v, integral);
+}
+
+// transpose(transpose(A)) -> A; (A B) x -> A (B x) and (A B) C <->
+// A (B C), each when the new order needs fewer multiplies.
+template <std::size_t Cap>
+consteval std::optional<Expression<Cap>> simplify_linalg(NodeView<Cap> n) {
+    auto shape = [&](NodeView<Cap> v) consteval {
+        return linalg_shape(n.ast, v.id);
+    };
+    if (n.tag() == "transpose" && n.child(0).tag() == "transpose")
+        return to_expr(n, n.child(0).child(0));
+    // A: p x q, B: q x r, x: r
+    if (n.tag() == "matvec" && n.child(0).tag() == "matmul") {
+        auto ab = n.child(0);
+        Shape a = shape(ab.child(0));
+        Shape b = shape(ab.child(1));
+        int p = a.rows, q = a.cols, r = b.cols;
+        if (q * r + p * q >= p * q * r + p * r)
+            return std::nullopt;
+        Expression<Cap> bx = make_node("matvec", to_expr(n, ab.child(1)),
+                                       to_expr(n, n.child(1)));
+        return make_node("matvec", to_expr(n, ab.child(0)), bx);
+    }
+    if (n.tag() != "matmul")
+        return std::nullopt;
+    // A: p x q, B: q x r, C: r x s
+    if (n.child(0).tag() == "matmul") {
+        Shape a = shape(n.child(0).child(0));
+        Shape c = shape(n.child(1));
+        int p = a.rows, q = a.cols, r = c.rows, s = c.cols;
+        if (q * r * s + p * q * s < p * q * r + p * r * s) {
+            Expression<Cap> bc =
+                make_node("matmul", to_expr(n, n.child(0).child(1)),
+                          to_expr(n, n.child(1)));
+            return make_node("matmul", to_expr(n, n.child(0).child(0)), bc);
+        }
+    }
+    if (n.child(1).tag() == "matmul") {
+        Shape a = shape(n.child(0));
+        Shape c = shape(n.child(1).child(1));
+        int p = a.rows, q = a.cols, r = c.rows, s = c.cols;
+        if (p * q * r + p * r * s < q * r * s + p * q * s) {
+            Expression<Cap> ab = make_node("matmul", to_expr(n, n.child(0)),
+                                           to_expr(n, n.child(1).child(0)));
+            return make_node("matmul", ab, to_expr(n, n.child(1).child(1)));
+        }
+    }
+    return std::nullopt;
+}
+
 } // namespace detail
 
 template <std::size_t Cap = 64, auto... Ms>
@@ -141,9 +881,9 @@ consteval Expression<Cap, Ms...> simplify(Expression<Cap, Ms...> e) {
                 if (is_lit(n.child(0), 1.0))
                     return to_expr(n, n.child(1));
                 if (is_lit(n.child(0), 0.0))
-                    return Expression<Cap>::lit(0.0);
+                    return to_expr(n, n.child(0));
                 if (is_lit(n.child(1), 0.0))
-                    return Expression<Cap>::lit(0.0);
+                    return to_expr(n, n.child(1));
             }
             // x - 0 -> x
             if (n.tag() == "sub" && n.child_count() == 2 &&
@@ -160,16 +900,44 @@ consteval Expression<Cap, Ms...> simplify(Expression<Cap, Ms...> e) {
             // -lit -> lit
             if (n.tag() == "neg" && n.child_count() == 1 &&
                 n.child(0).tag() == "lit")
-                return Expression<Cap>::lit(-n.child(0).payload());
+                return Expression<Cap>::lit(
+                    -n.child(0).payload(),
+                    is_int_lit(n.ast.nodes[n.child(0).id]));
+            // exp(0) -> 1, log(1) -> 0, sin(0) -> 0, ...
+            if (n.child_count() == 1 && is_lit(n.child(0), 0.0)) {
+                if (n.tag() == "exp" || n.tag() == "cos")
+                    return Expression<Cap>::lit(1.0);
+                if (n.tag() == "sin" || n.tag() == "tanh" ||
+                    n.tag() == "sqrt")
+                    return Expression<Cap>::lit(0.0);
+            }
+            if (n.child_count() == 1 && is_lit(n.child(0), 1.0)) {
+                if (n.tag() == "log")
+                    return Expression<Cap>::lit(0.0);
+                if (n.tag() == "sqrt")
+                    return Expression<Cap>::lit(1.0);
+            }
+            // log(exp(x)) -> x
+            if (n.tag() == "log" && n.child_count() == 1 &&
+                n.child(0).tag() == "exp")
+                return to_expr(n, n.child(0).child(0));
+            // pow(x, 1) -> x, pow(x, 0) -> 1
+            if (n.tag() == "pow" && n.child_count() == 2) {
+                if (is_lit(n.child(1), 1.0))
+                    return to_expr(n, n.child(0));
+                if (is_lit(n.child(1), 0.0))
+                    return Expression<Cap>::lit(1.0);
+            }
+            if (n.tag() == "sum" || n.tag() == "product" ||
+                n.tag() == "fold_range")
+                return detail::simplify_loop(n);
+            if (n.tag() == "transpose" || n.tag() == "matvec" ||
+                n.tag() == "matmul")
+                return detail::simplify_linalg(n);
             // constant folding: lit op lit -> lit
             if (n.child_count() == 2 && n.child(0).tag() == "lit" &&
-                n.child(1).tag() == "lit") {
-                auto tag = n.tag();
-                if (tag == "add" || tag == "sub" || tag == "mul" ||
-                    tag == "div")
-                    return Expression<Cap>::lit(detail::eval_op(
-                        tag, n.child(0).payload(), n.child(1).payload()));
-            }
+                n.child(1).tag() == "lit")
+                return detail::fold_literals(n);
             return std::nullopt;
         });
     return result; // implicit conversion back to Expression<Cap, Ms...>
@@ -177,8 +945,36 @@ consteval Expression<Cap, Ms...> simplify(Expression<Cap, Ms...> e) {
 
 // --- differentiate: symbolic differentiation via structural recursion ---
 
+namespace detail {
+
+// E with each of Extra appended unless its pack already holds it.
+template <typename E, auto... Extra> struct with_macros {
+    using type = E;
+};
+template <std::size_t Cap, auto... Ms, auto First, auto... Rest>
+struct with_macros<Expression<Cap, Ms...>, First, Rest...>
+    : with_macros<
+          std::conditional_t<(std::is_same_v<std::remove_cvref_t<decltype(Ms)>,
+                                             std::remove_cvref_t<decltype(
+                                                 First)>> ||
+                              ...),
+                             Expression<Cap, Ms...>,
+                             Expression<Cap, Ms..., First>>,
+          Rest...> {};
+
+} // namespace detail
+
+// A derivative of Expression<Cap, Ms...> carries Ms plus every macro the
+// derivative rules may introduce (sin' builds cos, a quotient builds sub,
+// a product loop builds a sum).
+template <std::size_t Cap, auto... Ms>
+using Derivative =
+    typename detail::with_macros<Expression<Cap, Ms...>, MAdd, MSub, MMul,
+                                 MDiv, MNeg, MExp, MLog, MSqrt, MSin, MCos,
+                                 MTanh, MPow, MSum>::type;
+
 template <std::size_t Cap = 64, auto... Ms>
-consteval Expression<Cap, Ms...> differentiate(Expression<Cap, Ms...> e,
+consteval Derivative<Cap, Ms...> differentiate(Expression<Cap, Ms...> e,
                                                const char* var) {
     Expression<Cap> plain = e; // strip macros
     auto result = transform(
@@ -189,27 +985,405 @@ consteval Expression<Cap, Ms...> differentiate(Expression<Cap, Ms...> e,
             if (n.tag() == "var")
                 return Expression<Cap>::lit(n.name() == var ? 1.0 : 0.0);
             if (n.tag() == "neg" && n.child_count() == 1)
-                return -recurse(n.child(0));
+                return smart::neg(recurse(n.child(0)));
             if (n.tag() == "add" && n.child_count() == 2)
-                return recurse(n.child(0)) + recurse(n.child(1));
+                return smart::add(recurse(n.child(0)), recurse(n.child(1)));
             if (n.tag() == "sub" && n.child_count() == 2)
-                return recurse(n.child(0)) - recurse(n.child(1));
+                return smart::sub(recurse(n.child(0)), recurse(n.child(1)));
             if (n.tag() == "mul" && n.child_count() == 2) {
-                auto f = to_expr(n, n.child(0));
-                auto g = to_expr(n, n.child(1));
-                return f * recurse(n.child(1)) + recurse(n.child(0)) * g;
+                auto df = recurse(n.child(0));
+                auto dg = recurse(n.child(1));
+                // Copy the primal factors only into terms that survive
+                auto f = smart::detail::is_lit(dg, 0.0)
+                             ? Expression<Cap>::lit(0.0)
+                             : to_expr(n, n.child(0));
+                auto g = smart::detail::is_lit(df, 0.0)
+                             ? Expression<Cap>::lit(0.0)
+                             : to_expr(n, n.child(1));
+                return smart::add(smart::mul(f, dg), smart::mul(df, g));
             }
             if (n.tag() == "div" && n.child_count() == 2) {
+                auto df = recurse(n.child(0));
+                auto dg = recurse(n.child(1));
+                if (smart::detail::is_lit(df, 0.0) &&
+                    smart::detail::is_lit(dg, 0.0))
+                    return Expression<Cap>::lit(0.0);
                 auto f = to_expr(n, n.child(0));
                 auto g = to_expr(n, n.child(1));
-                return (recurse(n.child(0)) * g - f * recurse(n.child(1))) /
-                       (g * g);
+                return smart::div(
+                    smart::sub(smart::mul(df, g), smart::mul(f, dg)),
+                    smart::mul(g, g));
+            }
+            // Chain rule: d f(u) = f'(u) * du
+            if (n.child_count() == 1 &&
+                (n.tag() == "exp" || n.tag() == "log" || n.tag() == "sqrt" ||
+                 n.tag() == "sin" || n.tag() == "cos" || n.tag() == "tanh")) {
+                auto du = recurse(n.child(0));
+                if (smart::detail::is_lit(du, 0.0))
+                    return du;
+                auto u = to_expr(n, n.child(0));
+                if (n.tag() == "exp")
+                    return smart::mul(MExp(u), du);
+                if (n.tag() == "log")
+                    return smart::div(du, u);
+                if (n.tag() == "sqrt")
+                    return smart::div(
+                        du, smart::mul(Expression<Cap>::lit(2.0), MSqrt(u)));
+                if (n.tag() == "sin")
+                    return smart::mul(MCos(u), du);
+                if (n.tag() == "cos")
+                    return smart::neg(smart::mul(MSin(u), du));
+                auto t = MTanh(u);
+                return smart::mul(
+                    smart::sub(Expression<Cap>::lit(1.0), smart::mul(t, t)),
+                    du);
+            }
+            if (n.tag() == "pow" && n.child_count() == 2) {
+                auto du = recurse(n.child(0));
+                auto dv = recurse(n.child(1));
+                if (smart::detail::is_lit(du, 0.0) &&
+                    smart::detail::is_lit(dv, 0.0))
+                    return Expression<Cap>::lit(0.0);
+                auto u = to_expr(n, n.child(0));
+                auto v = to_expr(n, n.child(1));
+                // Constant exponent: d u^c = c * u^(c - 1) * du
+                if (smart::detail::is_lit(v))
+                    return smart::mul(
+                        smart::mul(v, MPow(u, Expression<Cap>::lit(
+                                                  smart::detail::lit_value(v) -
+                                                  1.0))),
+                        du);
+                // d u^v = u^v * (dv * log u + v * du / u)
+                return smart::mul(
+                    MPow(u, v),
+                    smart::add(smart::mul(dv, MLog(u)),
+                               smart::div(smart::mul(v, du), u)));
+            }
+            // Loops: the integer bounds contribute nothing
+            if ((n.tag() == "sum" || n.tag() == "product") &&
+                n.child_count() == 3) {
+                auto fn = n.child(2);
+                const char* i = n.ast.nodes[fn.child(0).id].name;
+                if (fn.child(0).name() == var)
+                    return Expression<Cap>::lit(0.0); // bound, not free
+                auto df = recurse(fn.child(1));
+                if (smart::detail::is_lit(df, 0.0))
+                    return df;
+                auto lo = to_expr(n, n.child(0));
+                auto hi = to_expr(n, n.child(1));
+                int unroll = static_cast<int>(n.payload());
+                if (n.tag() == "sum")
+                    return sum(i, lo, hi, df, unroll);
+                // d prod f(i) = sum over j of f'(j) * prod_{i<j} f(i) *
+                // prod_{i>j} f(i): the partial products' bounds read j
+                if (detail::occurs_free(n.ast, n.child(0).id, i) ||
+                    detail::occurs_free(n.ast, n.child(1).id, i))
+                    throw "differentiate: loop bounds mention the loop "
+                          "variable";
+                auto f = to_expr(n, fn.child(1));
+                auto j = Expression<Cap>::var(i);
+                auto next = smart::add(j, Expression<Cap>::lit(1.0));
+                auto before = product(i, lo, j, f, unroll);
+                auto after = product(i, next, hi, f, unroll);
+                return sum(i, lo, hi,
+                           smart::mul(smart::mul(df, before), after), unroll);
+            }
+            // fold_range: with acc_k the accumulator before trip k, its
+            // derivative d_k follows d_{k+1} = dbody/dacc * d_k + dbody, the
+            // partials taken at acc_k, which an inner fold recomputes.
+            if (n.tag() == "fold_range" && n.child_count() == 4) {
+                auto outer = n.child(3);
+                auto inner = outer.child(1);
+                const char* acc = n.ast.nodes[outer.child(0).id].name;
+                const char* i = n.ast.nodes[inner.child(0).id].name;
+                if (outer.child(0).name() == var ||
+                    inner.child(0).name() == var)
+                    throw "differentiate: variable shadowed by a fold_range "
+                          "binder";
+                auto dinit = recurse(n.child(0));
+                auto dbody = recurse(inner.child(1));
+                if (smart::detail::is_lit(dinit, 0.0) &&
+                    smart::detail::is_lit(dbody, 0.0))
+                    return Expression<Cap>::lit(0.0);
+                for (int c = 0; c < 3; ++c)
+                    if (detail::occurs_free(n.ast, n.child(c).id, i) ||
+                        detail::occurs_free(n.ast, n.child(c).id, "%d"))
+                        throw "differentiate: fold_range operands mention "
+                              "a binder";
+                auto init = to_expr(n, n.child(0));
+                auto lo = to_expr(n, n.child(1));
+                auto hi = to_expr(n, n.child(2));
+                auto body = to_expr(n, inner.child(1));
+                int unroll = static_cast<int>(n.payload());
+                Expression<Cap> step = smart::add(
+                    smart::mul(differentiate(body, acc),
+                               Expression<Cap>::var("%d")),
+                    dbody);
+                if (detail::occurs_free(step.ast, step.id, acc)) {
+                    Expression<Cap> prefix = fold_range(
+                        acc, init, i, lo, Expression<Cap>::var(i), body,
+                        unroll);
+                    step = make_node("apply", detail::binder(acc, step),
+                                     prefix);
+                }
+                return fold_range("%d", dinit, i, lo, hi, step, unroll);
+            }
+            // Linear algebra: a zero literal stands for a zero vector or
+            // matrix, and array arguments are constants. There is no
+            // matrix sum, so a product whose operands both depend on var
+            // is rejected.
+            if (n.tag() == "vec") {
+                Expression<Cap> dv = recurse(n.child(0));
+                int ids[8]{dv.id};
+                bool zero = smart::detail::is_lit(dv, 0.0);
+                for (int i = 1; i < n.child_count(); ++i) {
+                    Expression<Cap> di = recurse(n.child(i));
+                    zero = zero && smart::detail::is_lit(di, 0.0);
+                    ids[i] = di.id + dv.ast.merge(di.ast);
+                }
+                if (zero)
+                    return Expression<Cap>::lit(0.0);
+                dv.id = dv.ast.add_tagged_node("vec", ids, n.child_count());
+                return dv;
+            }
+            if (n.tag() == "dot" && n.child_count() == 2) {
+                Expression<Cap> du = recurse(n.child(0));
+                Expression<Cap> dv = recurse(n.child(1));
+                Expression<Cap> l = Expression<Cap>::lit(0.0);
+                Expression<Cap> r = Expression<Cap>::lit(0.0);
+                if (!smart::detail::is_lit(du, 0.0))
+                    l = make_node("dot", du, to_expr(n, n.child(1)));
+                if (!smart::detail::is_lit(dv, 0.0))
+                    r = make_node("dot", to_expr(n, n.child(0)), dv);
+                return smart::add(l, r);
+            }
+            if ((n.tag() == "mat" || n.tag() == "transpose") &&
+                n.child_count() == 1) {
+                Expression<Cap> dw = recurse(n.child(0));
+                if (smart::detail::is_lit(dw, 0.0))
+                    return dw;
+                ASTNode m = n.ast.nodes[n.id];
+                m.children[0] = dw.id;
+                dw.id = dw.ast.add_node(m);
+                return dw;
+            }
+            if ((n.tag() == "matvec" || n.tag() == "matmul") &&
+                n.child_count() == 2) {
+                const char* tag = n.tag() == "matvec" ? "matvec" : "matmul";
+                Expression<Cap> da = recurse(n.child(0));
+                Expression<Cap> dx = recurse(n.child(1));
+                bool a_const = smart::detail::is_lit(da, 0.0);
+                if (smart::detail::is_lit(dx, 0.0))
+                    return a_const ? dx
+                                   : make_node(tag, da, to_expr(n, n.child(1)));
+                if (!a_const)
+                    throw "differentiate: both factors of a matrix product "
+                          "depend on the variable";
+                return make_node(tag, to_expr(n, n.child(0)), dx);
             }
             return Expression<Cap>::lit(0.0);
         });
     return result; // implicit conversion back to Expression<Cap, Ms...>
 }
 
+// --- gradient: all partial derivatives in one traversal ---
+//
+// gradient(e, {"x", "y"}) differentiates e with respect to each listed
+// variable in a single bottom-up pass, using the same rules as
+// differentiate. Primal subterms and sub-derivatives are interned in one
+// hash-consed arena, so every partial reuses them instead of copying, and
+// terms that are identically zero are never built. The partials are roots
+// of one shared AST:
+//
+//   constexpr auto g = gradient(x * y + y, {"x", "y"});
+//   constexpr auto dfdy = g[1]; // x + 1
+//
+// Each partial has the type of a derivative of e (see Derivative).
+
+template <std::size_t Cap, auto... Ms> struct Gradient {
+    AST<Cap> ast{};
+    int roots[8]{};
+    int count{0};
+
+    consteval Derivative<Cap, Ms...> operator[](int k) const {
+        if (k < 0 || k >= count)
+            throw "gradient: partial index out of range";
+        return Expression<Cap>(ast, roots[k]);
+    }
+};
+
+template <std::size_t Cap = 64, auto... Ms>
+consteval Gradient<Cap, Ms...>
+gradient(Expression<Cap, Ms...> e, std::initializer_list<const char*> vars) {
+    if (vars.size() > 8)
+        throw "gradient: at most 8 variables";
+    const int k_count = static_cast<int>(vars.size());
+    const char* names[8]{};
+    int k_init = 0;
+    for (const char* v : vars)
+        names[k_init++] = v;
+
+    // Nodes reachable from the root; children have lower ids than parents
+    bool live[Cap]{};
+    live[e.id] = true;
+    for (int id = e.id; id >= 0; --id)
+        if (live[id])
+            for (int i = 0; i < e.ast.nodes[id].child_count; ++i)
+                live[e.ast.nodes[id].children[i]] = true;
+
+    detail::Arena<Cap * 4> a{};
+    const int zero = a.lit(0.0);
+    const int one = a.lit(1.0);
+    auto add = [&](int p, int q) consteval {
+        return p == zero ? q : q == zero ? p : a.node("add", {p, q});
+    };
+    auto neg = [&](int p) consteval {
+        return p == zero ? zero : a.node("neg", {p});
+    };
+    auto sub = [&](int p, int q) consteval {
+        return q == zero ? p : p == zero ? neg(q) : a.node("sub", {p, q});
+    };
+    auto mul = [&](int p, int q) consteval {
+        if (p == zero || q == zero)
+            return zero;
+        return p == one ? q : q == one ? p : a.node("mul", {p, q});
+    };
+    auto div = [&](int p, int q) consteval {
+        return p == zero ? zero : q == one ? p : a.node("div", {p, q});
+    };
+    auto is_chain = [](const char* tag) consteval {
+        return str_eq(tag, "exp") || str_eq(tag, "log") ||
+               str_eq(tag, "sqrt") || str_eq(tag, "sin") ||
+               str_eq(tag, "cos") || str_eq(tag, "tanh");
+    };
+
+    int prim[Cap]{};
+    int d[Cap][8]{};
+    for (int id = 0; id <= e.id; ++id) {
+        if (!live[id])
+            continue;
+        ASTNode n = e.ast.nodes[id];
+        int c[8]{};
+        for (int i = 0; i < n.child_count; ++i)
+            c[i] = n.children[i] = prim[n.children[i]];
+        prim[id] = a.intern(n);
+        for (int k = 0; k < k_count; ++k) {
+            auto dc = [&](int i) consteval {
+                return d[e.ast.nodes[id].children[i]][k];
+            };
+            int r = zero;
+            if (str_eq(n.tag, "var"))
+                r = str_eq(n.name, names[k]) ? one : zero;
+            else if (str_eq(n.tag, "neg") && n.child_count == 1)
+                r = neg(dc(0));
+            else if (str_eq(n.tag, "add") && n.child_count == 2)
+                r = add(dc(0), dc(1));
+            else if (str_eq(n.tag, "sub") && n.child_count == 2)
+                r = sub(dc(0), dc(1));
+            else if (str_eq(n.tag, "mul") && n.child_count == 2)
+                r = add(mul(c[0], dc(1)), mul(dc(0), c[1]));
+            else if (str_eq(n.tag, "div") && n.child_count == 2)
+                r = div(sub(mul(dc(0), c[1]), mul(c[0], dc(1))),
+                        mul(c[1], c[1]));
+            else if (n.child_count == 1 && is_chain(n.tag) && dc(0) != zero) {
+                // f'(u) * du, reusing f(u) itself where f' is built from it
+                int self = prim[id];
+                if (str_eq(n.tag, "exp"))
+                    r = mul(self, dc(0));
+                else if (str_eq(n.tag, "log"))
+                    r = div(dc(0), c[0]);
+                else if (str_eq(n.tag, "sqrt"))
+                    r = div(dc(0), mul(a.lit(2.0), self));
+                else if (str_eq(n.tag, "sin"))
+                    r = mul(a.node("cos", {c[0]}), dc(0));
+                else if (str_eq(n.tag, "cos"))
+                    r = neg(mul(a.node("sin", {c[0]}), dc(0)));
+                else
+                    r = mul(sub(one, mul(self, self)), dc(0));
+            } else if (str_eq(n.tag, "pow") && n.child_count == 2) {
+                if (a.is_lit(c[1])) {
+                    // Constant exponent: c * u^(c - 1) * du
+                    double p = a.ast.nodes[c[1]].payload;
+                    if (dc(0) != zero) {
+                        int lower = a.node("pow", {c[0], a.lit(p - 1.0)});
+                        r = mul(mul(c[1], lower), dc(0));
+                    }
+                } else if (dc(0) != zero || dc(1) != zero)
+                    r = mul(prim[id],
+                            add(mul(dc(1), a.node("log", {c[0]})),
+                                div(mul(c[1], dc(0)), c[0])));
+            } else if (str_eq(n.tag, "lambda") && n.child_count == 2) {
+                r = dc(1); // a loop body's derivative, read by the loop
+            } else if ((str_eq(n.tag, "sum") || str_eq(n.tag, "product")) &&
+                       n.child_count == 3 && dc(2) != zero &&
+                       !str_eq(a.ast.nodes[a.ast.nodes[c[2]].children[0]].name,
+                               names[k])) {
+                // Same rules as differentiate, sharing f with the primal
+                ASTNode fn = a.ast.nodes[c[2]];
+                auto loop = [&](const char* tag, int lo, int hi,
+                                int body) consteval {
+                    fn.children[1] = body;
+                    ASTNode l{};
+                    copy_str(l.tag, tag);
+                    l.payload = n.payload; // unroll factor
+                    l.child_count = 3;
+                    l.children[0] = lo;
+                    l.children[1] = hi;
+                    l.children[2] = a.intern(fn);
+                    return a.intern(l);
+                };
+                if (str_eq(n.tag, "sum"))
+                    r = loop("sum", c[0], c[1], dc(2));
+                else {
+                    int f = fn.children[1];
+                    int j = fn.children[0];
+                    int before = loop("product", c[0], j, f);
+                    int after = loop("product", add(j, one), c[1], f);
+                    r = loop("sum", c[0], c[1],
+                             mul(mul(dc(2), before), after));
+                }
+            } else if (str_eq(n.tag, "vec")) {
+                // Linear algebra, as in differentiate
+                ASTNode dv = n;
+                bool nonzero = false;
+                for (int i = 0; i < n.child_count; ++i) {
+                    dv.children[i] = dc(i);
+                    nonzero = nonzero || dc(i) != zero;
+                }
+                r = nonzero ? a.intern(dv) : zero;
+            } else if (str_eq(n.tag, "dot") && n.child_count == 2) {
+                int lhs = dc(0) == zero ? zero : a.node("dot", {dc(0), c[1]});
+                int rhs = dc(1) == zero ? zero : a.node("dot", {c[0], dc(1)});
+                r = add(lhs, rhs);
+            } else if ((str_eq(n.tag, "mat") || str_eq(n.tag, "transpose")) &&
+                       n.child_count == 1 && dc(0) != zero) {
+                ASTNode m = n;
+                m.children[0] = dc(0);
+                r = a.intern(m);
+            } else if ((str_eq(n.tag, "matvec") || str_eq(n.tag, "matmul")) &&
+                       n.child_count == 2 && (dc(0) != zero || dc(1) != zero)) {
+                if (dc(0) != zero && dc(1) != zero)
+                    throw "gradient: both factors of a matrix product depend "
+                          "on the variable";
+                r = dc(0) != zero ? a.node(n.tag, {dc(0), c[1]})
+                                  : a.node(n.tag, {c[0], dc(1)});
+            } else if (str_eq(n.tag, "fold_range") &&
+                       (dc(0) != zero || dc(3) != zero))
+                throw "gradient: no fold_range rule; use differentiate";
+            d[id][k] = r;
+        }
+    }
+
+    Gradient<Cap, Ms...> g{};
+    int memo[Cap * 4];
+    for (auto& m : memo)
+        m = -1;
+    for (int k = 0; k < k_count; ++k)
+        g.roots[k] = a.store(g.ast, d[e.id][k], memo);
+    g.count = k_count;
+    return g;
+}
+
 } // namespace refmacro
 
 #endif // REFMACRO_MATH_HPP
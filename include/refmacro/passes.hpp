@@ -0,0 +1,394 @@
+#ifndef REFMACRO_PASSES_HPP
+#define REFMACRO_PASSES_HPP
+
+// Optimization pass manager for the transform pipeline.
+//
+// optimize<O2>(e) runs the built-in passes over e until none of them changes
+// the tree, instead of piping e | simplify | ... by hand:
+//
+//   fold       constant folding of literal arithmetic (via eval)
+//   simplify   algebraic identities: x + 0, x * 1, x - 0, x / 1, --x, ...
+//   dce        progn(a, b) -> b when a is pure
+//   dead_cond  cond(lit, a, b) -> a or b, cond(t, a, a) -> a
+//   cse        repeated pure subtrees bound once with let_ (O2 only)
+//
+// All passes work on one hash-consed arena: every node is interned, so
+// structurally equal subtrees share one id, an unchanged subtree is never
+// copied, and a pass that returns the same root id made no change. Purity
+// comes from the MacroInfo of the macros carried in e's type; nodes of
+// unannotated macros are never dropped, speculated or shared. CSE binds
+// only pure subtrees, which a let computes once up front, so hoisting one
+// to the root never runs a division or a checked read that an untaken
+// cond arm would have skipped.
+//
+//   constexpr auto r = PassManager<O2>::run(e);
+//   static_assert(r.report.changed(Pass::cse));
+//   constexpr auto fn = compile<r.expr>();
+
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/eval.hpp>
+#include <refmacro/expr.hpp>
+
+namespace refmacro {
+
+// --- Levels and report ---
+
+enum class OptLevel { O0, O1, O2 };
+inline constexpr OptLevel O0 = OptLevel::O0; // no passes
+inline constexpr OptLevel O1 = OptLevel::O1; // fold, simplify, dce, dead_cond
+inline constexpr OptLevel O2 = OptLevel::O2; // O1 + cse
+
+enum class Pass { fold, simplify, dce, dead_cond, cse };
+inline constexpr int pass_count = 5;
+
+struct PassReport {
+    int changes[pass_count]{}; // rounds in which each pass changed the tree
+    int rounds{0};
+
+    consteval bool changed(Pass p) const {
+        return changes[static_cast<int>(p)] > 0;
+    }
+    consteval bool any() const {
+        for (int c : changes)
+            if (c > 0)
+                return true;
+        return false;
+    }
+};
+
+template <std::size_t Cap, auto... Ms> struct OptResult {
+    Expression<Cap, Ms...> expr{};
+    PassReport report{};
+};
+
+namespace detail {
+
+// --- Arena: hash-consed node storage shared by all passes ---
+
+template <std::size_t N> struct Arena {
+    AST<N> ast{};
+
+    consteval int intern(const ASTNode& n) {
+        for (std::size_t i = 0; i < ast.count; ++i) {
+            const auto& m = ast.nodes[i];
+            if (m.child_count != n.child_count || m.payload != n.payload ||
+                !str_eq(m.tag, n.tag) || !str_eq(m.name, n.name))
+                continue;
+            bool same = true;
+            for (int c = 0; c < n.child_count && same; ++c)
+                same = m.children[c] == n.children[c];
+            if (same)
+                return static_cast<int>(i);
+        }
+        return ast.add_node(n);
+    }
+
+    consteval int lit(double v, bool integral = false) {
+        ASTNode n{};
+        copy_str(n.tag, "lit");
+        if (integral)
+            copy_str(n.name, int_lit_kind);
+        n.payload = v;
+        return intern(n);
+    }
+    consteval int var(const char* name) {
+        ASTNode n{};
+        copy_str(n.tag, "var");
+        copy_str(n.name, name);
+        return intern(n);
+    }
+    consteval int node(const char* tag, std::initializer_list<int> children) {
+        ASTNode n{};
+        copy_str(n.tag, tag);
+        for (int c : children)
+            n.children[n.child_count++] = c;
+        return intern(n);
+    }
+
+    template <std::size_t Cap>
+    consteval int load(const AST<Cap>& src, int id) {
+        ASTNode n = src.nodes[id];
+        for (int i = 0; i < n.child_count; ++i)
+            n.children[i] = load(src, n.children[i]);
+        return intern(n);
+    }
+
+    // Copy the nodes reachable from root into dst, keeping sharing.
+    template <std::size_t Cap>
+    consteval int store(AST<Cap>& dst, int id, int* memo) const {
+        if (memo[id] >= 0)
+            return memo[id];
+        ASTNode n = ast.nodes[id];
+        for (int i = 0; i < n.child_count; ++i)
+            n.children[i] = store(dst, n.children[i], memo);
+        return memo[id] = dst.add_node(n);
+    }
+
+    consteval bool is_lit(int id) const {
+        return str_eq(ast.nodes[id].tag, "lit");
+    }
+    consteval bool is_lit(int id, double v) const {
+        return is_lit(id) && ast.nodes[id].payload == v;
+    }
+};
+
+// Rebuild bottom-up, applying a local rule to each interned node. Shared
+// subtrees are visited once per pass.
+template <std::size_t N, typename Rule>
+consteval int rebuild_with(Arena<N>& a, int id, int* memo, Rule& rule) {
+    if (memo[id] >= 0)
+        return memo[id];
+    ASTNode n = a.ast.nodes[id];
+    for (int i = 0; i < n.child_count; ++i)
+        n.children[i] = rebuild_with(a, n.children[i], memo, rule);
+    return memo[id] = rule(a.intern(n));
+}
+
+template <std::size_t N, typename Rule>
+consteval int run_local_pass(Arena<N>& a, int root, Rule rule) {
+    int memo[N];
+    for (auto& m : memo)
+        m = -1;
+    return rebuild_with(a, root, memo, rule);
+}
+
+template <auto... Ms, std::size_t N>
+consteval bool arena_pure(const Arena<N>& a, int id) {
+    return subtree_cost<Ms...>(a.ast, id).pure;
+}
+
+// --- Local passes ---
+
+template <auto... Ms, std::size_t N>
+consteval int fold_pass(Arena<N>& a, int root) {
+    return run_local_pass(a, root, [&](int id) consteval {
+        const auto& n = a.ast.nodes[id];
+        if (n.child_count == 0 || n.child_count > 2 ||
+            !(str_eq(n.tag, "add") || str_eq(n.tag, "sub") ||
+              str_eq(n.tag, "mul") || str_eq(n.tag, "div") ||
+              str_eq(n.tag, "neg")))
+            return id;
+        FoldChildren<double> c;
+        for (int i = 0; i < n.child_count; ++i) {
+            if (!a.is_lit(n.children[i]))
+                return id;
+            c.values[c.count++] = a.ast.nodes[n.children[i]].payload;
+        }
+        // Leave x / 0 for the runtime to decide
+        if (str_eq(n.tag, "div") && c[1] == 0.0)
+            return id;
+        // Integer operands fold to an integer literal, if an exact one
+        bool integral = true;
+        for (int i = 0; i < n.child_count; ++i)
+            integral = integral && is_int_lit(a.ast.nodes[n.children[i]]);
+        if (integral && !is_integral_value(*eval_builtin(n.tag, c)))
+            return id;
+        return a.lit(*eval_builtin(n.tag, c), integral);
+    });
+}
+
+template <auto... Ms, std::size_t N>
+consteval int simplify_pass(Arena<N>& a, int root) {
+    return run_local_pass(a, root, [&](int id) consteval {
+        const auto n = a.ast.nodes[id];
+        if (n.child_count == 2) {
+            int l = n.children[0], r = n.children[1];
+            if (str_eq(n.tag, "add")) {
+                if (a.is_lit(r, 0.0))
+                    return l;
+                if (a.is_lit(l, 0.0))
+                    return r;
+            }
+            if (str_eq(n.tag, "mul")) {
+                if (a.is_lit(r, 1.0))
+                    return l;
+                if (a.is_lit(l, 1.0))
+                    return r;
+                // x * 0 -> 0 drops x, so x must be pure
+                if (a.is_lit(l, 0.0) && arena_pure<Ms...>(a, r))
+                    return l;
+                if (a.is_lit(r, 0.0) && arena_pure<Ms...>(a, l))
+                    return r;
+            }
+            if (str_eq(n.tag, "sub") && a.is_lit(r, 0.0))
+                return l;
+            if (str_eq(n.tag, "div") && a.is_lit(r, 1.0))
+                return l;
+        }
+        if (n.child_count == 1 && str_eq(n.tag, "neg")) {
+            const auto& c = a.ast.nodes[n.children[0]];
+            if (str_eq(c.tag, "neg") && c.child_count == 1)
+                return c.children[0];
+        }
+        return id;
+    });
+}
+
+template <auto... Ms, std::size_t N>
+consteval int dce_pass(Arena<N>& a, int root) {
+    return run_local_pass(a, root, [&](int id) consteval {
+        const auto& n = a.ast.nodes[id];
+        if (str_eq(n.tag, "progn") && n.child_count == 2 &&
+            arena_pure<Ms...>(a, n.children[0]))
+            return n.children[1];
+        return id;
+    });
+}
+
+template <auto... Ms, std::size_t N>
+consteval int dead_cond_pass(Arena<N>& a, int root) {
+    return run_local_pass(a, root, [&](int id) consteval {
+        const auto& n = a.ast.nodes[id];
+        if (!str_eq(n.tag, "cond") || n.child_count != 3)
+            return id;
+        if (a.is_lit(n.children[0]))
+            return a.ast.nodes[n.children[0]].payload != 0.0 ? n.children[1]
+                                                             : n.children[2];
+        if (n.children[1] == n.children[2] &&
+            arena_pure<Ms...>(a, n.children[0]))
+            return n.children[1];
+        return id;
+    });
+}
+
+// --- CSE: bind the largest repeated pure subtree with a let ---
+
+struct CseState {
+    int bindings{0}; // let names issued so far ("%c0", "%c1", ...)
+};
+
+template <std::size_t N>
+consteval int let_depth(const Arena<N>& a, int id) {
+    const auto& n = a.ast.nodes[id];
+    int deepest = 0;
+    for (int i = 0; i < n.child_count; ++i) {
+        int d = let_depth(a, n.children[i]);
+        deepest = d > deepest ? d : deepest;
+    }
+    // Each lambda (a let or a loop body) binds one name in Scope
+    return deepest + (str_eq(n.tag, "lambda") ? 1 : 0);
+}
+
+template <auto... Ms, std::size_t N>
+consteval int cse_pass(Arena<N>& a, int root, CseState& st) {
+    if (let_depth(a, root) >= static_cast<int>(Scope::MaxLocals))
+        return root;
+
+    // Occurrences of each id in the tree, and names bound anywhere in it.
+    // Children always have lower ids than their parents, so one downward
+    // sweep from the root propagates occurrence counts.
+    int occ[N]{};
+    int size[N]{};
+    occ[root] = 1;
+    VarMap<N> bound{};
+    for (int id = root; id >= 0; --id) {
+        const auto& n = a.ast.nodes[id];
+        size[id] = 1;
+        if (occ[id] == 0)
+            continue;
+        for (int i = 0; i < n.child_count; ++i)
+            occ[n.children[i]] += occ[id];
+        if (str_eq(n.tag, "lambda") && n.child_count == 2)
+            bound.add(a.ast.nodes[n.children[0]].name);
+    }
+    for (int id = 0; id <= root; ++id)
+        for (int i = 0; i < a.ast.nodes[id].child_count; ++i)
+            size[id] += size[a.ast.nodes[id].children[i]];
+
+    int best = -1;
+    for (int id = 0; id <= root; ++id) {
+        const auto& n = a.ast.nodes[id];
+        if (occ[id] < 2 || n.child_count == 0 || str_eq(n.tag, "lambda") ||
+            !arena_pure<Ms...>(a, id))
+            continue;
+        // Only free variables of the whole expression may be hoisted to
+        // the root; anything mentioning a let-bound name stays put.
+        VarMap<> free{};
+        collect_vars_dfs(a.ast, id, free);
+        bool scoped = false;
+        for (std::size_t v = 0; v < free.count && !scoped; ++v)
+            scoped = bound.contains(free.names[v]);
+        if (scoped)
+            continue;
+        if (best < 0 || size[id] > size[best])
+            best = id;
+    }
+    if (best < 0)
+        return root;
+
+    char name[16]{'%', 'c'};
+    int k = st.bindings++;
+    int len = 0;
+    char digits[16]{};
+    do {
+        digits[len++] = static_cast<char>('0' + k % 10);
+        k /= 10;
+    } while (k > 0);
+    for (int i = 0; i < len; ++i)
+        name[2 + i] = digits[len - 1 - i];
+
+    int placeholder = a.var(name);
+    int body = run_local_pass(a, root, [&](int id) consteval {
+        return id == best ? placeholder : id;
+    });
+    // Replacing best bottom-up: its children are rebuilt (unchanged) first,
+    // so the interned id of the rebuilt node is best itself.
+    return a.node("apply", {a.node("lambda", {placeholder, body}), best});
+}
+
+} // namespace detail
+
+// --- PassManager ---
+
+template <OptLevel Level> struct PassManager {
+    static constexpr int max_rounds = 16;
+
+    template <std::size_t Cap, auto... Ms>
+    static consteval OptResult<Cap, Ms...>
+    run(const Expression<Cap, Ms...>& e) {
+        OptResult<Cap, Ms...> out{};
+        if constexpr (Level == OptLevel::O0) {
+            out.expr = e;
+            return out;
+        } else {
+            detail::Arena<Cap * 4> a{};
+            detail::CseState cse{};
+            int root = a.load(e.ast, e.id);
+            bool changed = true;
+            while (changed && out.report.rounds < max_rounds) {
+                changed = false;
+                ++out.report.rounds;
+                auto step = [&](Pass p, int next) consteval {
+                    if (next != root) {
+                        ++out.report.changes[static_cast<int>(p)];
+                        changed = true;
+                        root = next;
+                    }
+                };
+                step(Pass::fold, detail::fold_pass<Ms...>(a, root));
+                step(Pass::simplify, detail::simplify_pass<Ms...>(a, root));
+                step(Pass::dce, detail::dce_pass<Ms...>(a, root));
+                step(Pass::dead_cond, detail::dead_cond_pass<Ms...>(a, root));
+                if constexpr (Level == OptLevel::O2)
+                    step(Pass::cse, detail::cse_pass<Ms...>(a, root, cse));
+            }
+            int memo[Cap * 4];
+            for (auto& m : memo)
+                m = -1;
+            Expression<Cap> plain{};
+            plain.id = a.store(plain.ast, root, memo);
+            out.expr = plain; // implicit conversion restores macros
+            return out;
+        }
+    }
+};
+
+template <OptLevel Level, std::size_t Cap, auto... Ms>
+consteval Expression<Cap, Ms...> optimize(const Expression<Cap, Ms...>& e) {
+    return PassManager<Level>::run(e).expr;
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_PASSES_HPP
@@ -135,11 +135,20 @@ consteval PrintBuffer<256> pp_node(const AST<Cap>& ast, int id) {
         s.append_double(n.payload);
         return s;
     }
-    if (str_eq(n.tag, "var")) {
+    if (str_eq(n.tag, "var") || str_eq(n.tag, "avar")) {
         s.append(n.name);
         return s;
     }
 
+    if ((str_eq(n.tag, "index") || str_eq(n.tag, "index_proven")) &&
+        n.child_count == 2) {
+        s.append(pp_node(ast, n.children[0]));
+        s.append_char('[');
+        s.append(pp_node(ast, n.children[1]));
+        s.append_char(']');
+        return s;
+    }
+
     if (str_eq(n.tag, "neg") && n.child_count == 1) {
         s.append("(-");
         s.append(pp_node(ast, n.children[0]));
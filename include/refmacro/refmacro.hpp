@@ -1,14 +1,24 @@
 #ifndef REFMACRO_REFMACRO_HPP
 #define REFMACRO_REFMACRO_HPP
 
+#include <refmacro/adjoint.hpp>
+#include <refmacro/analyze.hpp>
+#include <refmacro/array.hpp>
 #include <refmacro/ast.hpp>
 #include <refmacro/compile.hpp>
 #include <refmacro/control.hpp>
+#include <refmacro/dual.hpp>
+#include <refmacro/eval.hpp>
 #include <refmacro/expr.hpp>
+#include <refmacro/fused.hpp>
+#include <refmacro/interval.hpp>
+#include <refmacro/linalg.hpp>
 #include <refmacro/macro.hpp>
 #include <refmacro/math.hpp>
 #include <refmacro/node_view.hpp>
+#include <refmacro/passes.hpp>
 #include <refmacro/pretty_print.hpp>
+#include <refmacro/staged.hpp>
 #include <refmacro/transforms.hpp>
 
 #endif // REFMACRO_REFMACRO_HPP
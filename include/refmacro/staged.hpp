@@ -0,0 +1,191 @@
+#ifndef REFMACRO_STAGED_HPP
+#define REFMACRO_STAGED_HPP
+
+// Staged compilation: loop-invariant code motion at the AST level.
+//
+// compile_staged<e, "a", "b">() splits the free variables of e into uniform
+// parameters (a, b) and per-row variables (the rest, in extract_var_map
+// order). It returns a function of the uniform arguments that evaluates every
+// subtree depending only on them exactly once, and returns a closure over
+// those values that takes the per-row arguments:
+//
+//   constexpr auto e = a * b * x + (a + b);
+//   constexpr auto stage = compile_staged<e, "a", "b">();
+//   auto row = stage(2.0, 3.0); // a * b and a + b computed here
+//   row(1.0);                   // 6 * 1 + 5
+//
+// Macros are discovered from e's type. A hoisted subtree is evaluated
+// once per stage even when it sits under a cond arm or a loop that runs no
+// trips, so only pure subtrees (MacroInfo::pure: no side effects, cannot
+// trap) are hoisted; a checked index or division by a uniform stays in the
+// residual, where only its own arm evaluates it.
+
+#include <refmacro/ast.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <tuple>
+#include <utility>
+
+namespace refmacro {
+
+// --- StagePlan: residual AST + hoisted subtree roots ---
+
+template <std::size_t Cap> struct StagePlan {
+    Expression<Cap> residual{};
+    int hoisted[Cap]{};
+    std::size_t hoisted_count{0};
+    // Residual argument order: per-row variables, then one placeholder per
+    // hoisted subtree ("%0", "%1", ...).
+    VarMap<Cap + 8> vars{};
+};
+
+namespace detail {
+
+template <FixedString... Uniforms> consteval VarMap<> uniform_var_map() {
+    VarMap<> vm{};
+    (vm.add(Uniforms.data), ...);
+    return vm;
+}
+
+// A subtree is invariant when every free variable is a uniform that is not
+// shadowed by an enclosing let, and it is pure, so evaluating it ahead of
+// time cannot trap or have effects the residual would not have had.
+template <auto... Macros, std::size_t Cap>
+consteval bool is_invariant(const AST<Cap>& ast, int id,
+                            const VarMap<>& uniforms, const VarMap<>& bound) {
+    if (!subtree_cost<Macros...>(ast, id).pure)
+        return false;
+    VarMap<> free{};
+    collect_vars_dfs(ast, id, free);
+    for (std::size_t i = 0; i < free.count; ++i)
+        if (!uniforms.contains(free.names[i]) || bound.contains(free.names[i]))
+            return false;
+    return true;
+}
+
+consteval void placeholder_name(char (&dst)[16], std::size_t k) {
+    char digits[16]{};
+    int len = 0;
+    do {
+        digits[len++] = static_cast<char>('0' + k % 10);
+        k /= 10;
+    } while (k > 0);
+    dst[0] = '%';
+    for (int i = 0; i < len; ++i)
+        dst[1 + i] = digits[len - 1 - i];
+    dst[1 + len] = '\0';
+}
+
+template <auto... Macros, std::size_t Cap>
+consteval int stage_node(const AST<Cap>& src, int id, const VarMap<>& uniforms,
+                         const VarMap<>& bound, StagePlan<Cap>& plan) {
+    ASTNode n = src.nodes[id];
+
+    // Literals are cheaper to rebuild than to capture; a lambda is not a
+    // value.
+    if (!str_eq(n.tag, "lit") && !str_eq(n.tag, "lambda") &&
+        is_invariant<Macros...>(src, id, uniforms, bound)) {
+        ASTNode ph{};
+        copy_str(ph.tag, "var");
+        placeholder_name(ph.name, plan.hoisted_count);
+        plan.hoisted[plan.hoisted_count++] = id;
+        return plan.residual.ast.add_node(ph);
+    }
+
+    // apply(lambda(param, body), val): param is bound inside body
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(src.nodes[n.children[0]].tag, "lambda")) {
+        ASTNode fn = src.nodes[n.children[0]];
+        int val =
+            stage_node<Macros...>(src, n.children[1], uniforms, bound, plan);
+        VarMap<> inner = bound;
+        inner.add(src.nodes[fn.children[0]].name);
+        int param = plan.residual.ast.add_node(src.nodes[fn.children[0]]);
+        int body =
+            stage_node<Macros...>(src, fn.children[1], uniforms, inner, plan);
+        fn.children[0] = param;
+        fn.children[1] = body;
+        n.children[0] = plan.residual.ast.add_node(fn);
+        n.children[1] = val;
+        return plan.residual.ast.add_node(n);
+    }
+
+    // lambda(param, body) of a loop: param is bound inside body
+    if (str_eq(n.tag, "lambda") && n.child_count == 2) {
+        VarMap<> inner = bound;
+        inner.add(src.nodes[n.children[0]].name);
+        n.children[0] = plan.residual.ast.add_node(src.nodes[n.children[0]]);
+        n.children[1] =
+            stage_node<Macros...>(src, n.children[1], uniforms, inner, plan);
+        return plan.residual.ast.add_node(n);
+    }
+
+    for (int i = 0; i < n.child_count; ++i)
+        n.children[i] =
+            stage_node<Macros...>(src, n.children[i], uniforms, bound, plan);
+    return plan.residual.ast.add_node(n);
+}
+
+template <auto... Macros, std::size_t Cap>
+consteval StagePlan<Cap> make_stage_plan(const AST<Cap>& ast, int root,
+                                         const VarMap<>& uniforms) {
+    StagePlan<Cap> plan{};
+    plan.residual.id =
+        stage_node<Macros...>(ast, root, uniforms, VarMap<>{}, plan);
+
+    auto all = extract_var_map(ast, root);
+    for (std::size_t i = 0; i < all.count; ++i)
+        if (!uniforms.contains(all.names[i]))
+            plan.vars.add(all.names[i]);
+    for (std::size_t k = 0; k < plan.hoisted_count; ++k) {
+        char name[16]{};
+        placeholder_name(name, k);
+        plan.vars.add(name);
+    }
+    return plan;
+}
+
+template <auto e, typename ExprType, auto uniforms> struct staged_compiler;
+
+template <auto e, std::size_t Cap, auto... Embedded, auto uniforms>
+struct staged_compiler<e, Expression<Cap, Embedded...>, uniforms> {
+    static consteval auto run() {
+        constexpr auto plan =
+            make_stage_plan<Embedded...>(e.ast, e.id, uniforms);
+
+        // Stage one: each hoisted subtree, compiled against the uniforms
+        auto hoisted = [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+            return std::tuple{
+                compile_node<e.ast, plan.hoisted[Is], uniforms, Scope{},
+                             Embedded...>()...};
+        }(std::make_index_sequence<plan.hoisted_count>{});
+
+        // Stage two: the residual, reading hoisted values as trailing args
+        auto residual =
+            compile_node<plan.residual.ast, plan.residual.id, plan.vars,
+                         Scope{}, Embedded...>();
+
+        return [=](auto... u) constexpr {
+            auto values = std::apply(
+                [&](auto... h) { return std::tuple{h(u...)...}; }, hoisted);
+            return [=](auto... r) constexpr {
+                return std::apply(
+                    [&](auto... v) { return residual(r..., v...); }, values);
+            };
+        };
+    }
+};
+
+} // namespace detail
+
+// --- Public API ---
+
+template <auto e, FixedString... Uniforms> consteval auto compile_staged() {
+    return detail::staged_compiler<
+        e, decltype(e), detail::uniform_var_map<Uniforms...>()>::run();
+}
+
+} // namespace refmacro
+
+#endif // REFMACRO_STAGED_HPP
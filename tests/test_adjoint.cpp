@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <refmacro/adjoint.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Adjoint program ---
+
+TEST(AdjointProgram, OneSlotPerReachableNode) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = x * y + y;
+    constexpr auto prog = detail::make_adjoint_program(e.ast, e.id);
+    // x, y, mul, y, add: each var occurrence is its own node
+    static_assert(prog.count == 5);
+    static_assert(prog.arity == 2);
+    static_assert(prog.result == 4);
+}
+
+TEST(AdjointProgram, LetValueComputedOnce) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto s = Expr::var("s");
+    constexpr auto e = let_("s", x * x, s * s + s);
+    constexpr auto prog = detail::make_adjoint_program(e.ast, e.id);
+    // x, x, mul (the value), then mul and add reading its slot
+    static_assert(prog.count == 5);
+}
+
+// --- compile_gradient ---
+
+TEST(CompileGradient, ValueAndGradient) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto z = Expr::var("z");
+    constexpr auto f = x * y + y / z;
+    constexpr auto grad = compile_gradient<f>();
+    constexpr auto r = grad(1.0, 2.0, 4.0);
+    static_assert(r.value == 2.5);
+    static_assert(r.grad[0] == 2.0);    // y
+    static_assert(r.grad[1] == 1.25);   // x + 1 / z
+    static_assert(r.grad[2] == -0.125); // -y / z^2
+}
+
+TEST(CompileGradient, MatchesSymbolicDerivatives) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * x * y - y / (x + 2.0) + -(x * y);
+    constexpr auto grad = compile_gradient<f>();
+    constexpr auto dfdx = compile<differentiate(f, "x")>();
+    constexpr auto dfdy = compile<differentiate(f, "y")>();
+    constexpr auto value = compile<f>();
+    for (double xv : {-1.0, 0.5, 3.0}) {
+        for (double yv : {0.0, 2.0}) {
+            auto r = grad(xv, yv);
+            EXPECT_DOUBLE_EQ(r.value, value(xv, yv));
+            EXPECT_DOUBLE_EQ(r.grad[0], dfdx(xv, yv));
+            EXPECT_DOUBLE_EQ(r.grad[1], dfdy(xv, yv));
+        }
+    }
+}
+
+TEST(CompileGradient, LetAccumulatesThroughBinding) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto s = Expr::var("s");
+    // let s = x * x in s * s: d/dx x^4 = 4x^3
+    constexpr auto f = let_("s", x * x, s * s);
+    static_assert(compile_gradient<f>()(2.0).grad[0] == 32.0);
+}
+
+TEST(CompileGradient, CondTakesBranchAdjoint) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = MCond(x < y, x * 3.0, y * 5.0);
+    constexpr auto grad = compile_gradient<f>();
+    constexpr auto lo = grad(1.0, 2.0);
+    static_assert(lo.grad[0] == 3.0 && lo.grad[1] == 0.0);
+    constexpr auto hi = grad(4.0, 2.0);
+    static_assert(hi.grad[0] == 0.0 && hi.grad[1] == 5.0);
+}
+
+TEST(CompileGradient, UntakenArmDoesNotPoison) {
+    constexpr auto x = Expr::var("x");
+    // 1 / x is inf at x == 0, but that arm is not taken
+    constexpr auto f = MCond(x == 0.0, Expr::lit(0.0), 1.0 / x);
+    constexpr auto grad = compile_gradient<f>();
+    auto at_zero = grad(0.0);
+    EXPECT_EQ(at_zero.value, 0.0);
+    EXPECT_EQ(at_zero.grad[0], 0.0);
+    EXPECT_DOUBLE_EQ(grad(2.0).grad[0], -0.25);
+    // log(x) is -inf at x == 0
+    constexpr auto g = MCond(x > 0.0, log(x) * x, x);
+    auto clamped = compile_gradient<g>()(0.0);
+    EXPECT_EQ(clamped.grad[0], 1.0);
+}
+
+TEST(CompileGradient, IsStateless) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto f = x * x;
+    constexpr auto grad = compile_gradient<f>();
+    static_assert(std::is_empty_v<decltype(grad)>);
+    EXPECT_DOUBLE_EQ(grad(-3.0).grad[0], -6.0);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Structure ---
+
+TEST(Analyze, Leaf) {
+    constexpr auto m = analyze(Expr::var("x"));
+    static_assert(m.nodes == 1);
+    static_assert(m.depth == 1);
+    static_assert(m.vars == 1);
+    static_assert(m.flops == 0);
+    static_assert(m.latency == 0);
+    static_assert(m.op_kinds == 0);
+}
+
+TEST(Analyze, Polynomial) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    // ((x * x) + (2 * y)) + 1
+    constexpr auto e = x * x + 2.0 * y + 1.0;
+    constexpr auto m = analyze(e);
+    static_assert(m.nodes == 9);
+    static_assert(m.depth == 4);
+    static_assert(m.vars == 2);
+    static_assert(m.ops_of("mul") == 2);
+    static_assert(m.ops_of("add") == 2);
+    static_assert(m.ops_of("div") == 0);
+    static_assert(m.op_kinds == 2);
+}
+
+TEST(Analyze, LetBoundVariablesAreNotFree) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto t = Expr::var("t");
+    constexpr auto e = let_("t", x * 2.0, t + t);
+    static_assert(analyze(e).vars == 1);
+}
+
+// --- Cost model ---
+
+TEST(Analyze, CostsFromMacroInfo) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    // add/mul are pure_op (cost 1), div declares cost 4
+    constexpr auto e = (x + y) / (x * y);
+    constexpr auto m = analyze(e);
+    static_assert(m.flops == 6);
+    static_assert(m.latency == 5); // div after either operand
+}
+
+TEST(Analyze, LatencyIsCriticalPath) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto c = Expr::var("c");
+    constexpr auto d = Expr::var("d");
+    constexpr auto chain = ((a + b) + c) + d;
+    constexpr auto tree = (a + b) + (c + d);
+    static_assert(analyze(chain).flops == analyze(tree).flops);
+    static_assert(analyze(chain).latency == 3);
+    static_assert(analyze(tree).latency == 2);
+}
+
+TEST(Analyze, LoopsCountEveryTrip) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    // sum is a loop_op (cost 16); its body's mul runs 10 times
+    constexpr auto s = sum("i", 0, 10, x * i);
+    static_assert(analyze(s).flops == 16 + 10);
+    static_assert(analyze(s).latency == 16 + 10);
+    constexpr auto nested = sum("j", 0, 4, s);
+    static_assert(analyze(nested).flops == 16 + 4 * (16 + 10));
+    constexpr auto f = fold_range("acc", 0.0, "i", 0, 8,
+                                  Expr::var("acc") + x);
+    static_assert(analyze(f).flops == 16 + 8);
+    static_assert(analyze(s).bounded() && analyze(f).bounded());
+}
+
+TEST(Analyze, UnknownTripCountIsUnbounded) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto n = Expr::var("n");
+    constexpr auto s = sum("i", Expr::lit(0.0), n, x * Expr::var("i"));
+    constexpr auto m = analyze(s + x);
+    static_assert(!m.bounded());
+    static_assert(m.flops == unbounded_cost);
+    static_assert(m.latency == unbounded_cost);
+}
+
+TEST(Analyze, CustomCostTable) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * x + x;
+    constexpr auto costs = cost_table<MAdd, MMul>().set("mul", 1, 4);
+    constexpr auto m = analyze(e, costs);
+    static_assert(m.flops == 2);
+    static_assert(m.latency == 5);
+}
+
+TEST(Analyze, UserMacroCost) {
+    constexpr auto Sqrt = defmacro<"sqrt", MacroInfo{.cost = 12, .pure = true}>(
+        [](auto x) { return [=](auto... a) constexpr { return x(a...); }; });
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Sqrt(x * x + 1.0);
+    static_assert(analyze(e).flops == 14);
+}
+
+TEST(Analyze, UnknownTagsUseDefaults) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = make_node("opaque", x, x);
+    constexpr auto costs = []() consteval {
+        CostTable<> t{};
+        t.default_flops = 3;
+        return t;
+    }();
+    static_assert(analyze(e, CostTable<>{}).flops == 1);
+    static_assert(analyze(e, costs).flops == 3);
+}
+
+// --- Duplicate subtrees ---
+
+TEST(Analyze, NoDuplicates) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto m = analyze(x + y);
+    static_assert(m.unique_nodes == 3);
+    static_assert(m.duplicate_ratio() == 0.0);
+}
+
+TEST(Analyze, RepeatedSubtree) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto s = x + y;
+    // (x + y) * (x + y): 7 nodes, 4 distinct (x, y, x + y, product)
+    constexpr auto m = analyze(s * s);
+    static_assert(m.nodes == 7);
+    static_assert(m.unique_nodes == 4);
+    static_assert(m.duplicate_ratio() == 3.0 / 7.0);
+}
+
+TEST(Analyze, StaticBudget) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto horner = ((2.0 * x + 3.0) * x + 4.0) * x + 5.0;
+    constexpr auto naive =
+        2.0 * x * x * x + 3.0 * x * x + 4.0 * x + Expr::lit(5.0);
+    static_assert(analyze(horner).flops < analyze(naive).flops);
+    static_assert(analyze(horner).ops_of("mul") == 3);
+}
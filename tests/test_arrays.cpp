@@ -0,0 +1,115 @@
+#include <array>
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/array.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/passes.hpp>
+#include <refmacro/pretty_print.hpp>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+using namespace refmacro;
+
+// --- Building ---
+
+TEST(Arrays, AvarIsAFreeVariable) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto w = avar("w", 4);
+    constexpr auto e = x * index(w, 2) + index(avar("v", 3), 0);
+    constexpr auto vm = extract_var_map(e.ast, e.id);
+    static_assert(vm.count == 3);
+    static_assert(str_eq(vm.names[0], "x"));
+    static_assert(str_eq(vm.names[1], "w"));
+    static_assert(str_eq(vm.names[2], "v"));
+    static_assert(w.ast.nodes[w.id].payload == 4.0);
+}
+
+TEST(Arrays, PrettyPrint) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = index(avar("w", 8), i + 1.0);
+    constexpr auto s = pretty_print(e);
+    static_assert(str_eq(s.data, "w[(i + 1)]"));
+}
+
+// --- Compiling ---
+
+TEST(Arrays, StdArrayArgument) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto w = avar("w", 3);
+    constexpr auto e = index(w, 0) + index(w, 2) * x;
+    constexpr auto fn = compile<e>();
+    static_assert(fn(std::array{1.0, 2.0, 3.0}, 2.0) == 7.0);
+}
+
+TEST(Arrays, SpanArgument) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = sum("i", 0, 4, index(avar("w", 4), i) * i);
+    constexpr auto fn = math_compile<e>();
+    std::vector<double> data{1.0, 2.0, 3.0, 4.0};
+    EXPECT_EQ(fn(std::span<const double>{data}), 2.0 + 6.0 + 12.0);
+}
+
+TEST(Arrays, CompileFn) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = index(avar("w", 4), i);
+    constexpr auto f = compile_fn<e, double(std::span<const double, 4>,
+                                            double)>();
+    std::array<double, 4> w{5.0, 6.0, 7.0, 8.0};
+    EXPECT_EQ(f(w, 3.0), 8.0);
+}
+
+TEST(Arrays, IndexTruncates) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto fn = compile<index(avar("w", 2), i)>();
+    static_assert(fn(std::array{1.0, 2.0}, 1.75) == 2.0);
+    static_assert(fn(std::array{1.0, 2.0}, -0.5) == 1.0);
+}
+
+// --- Bounds checks ---
+
+TEST(Arrays, CheckedIndexThrows) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto fn = compile<index(avar("w", 3), i)>();
+    std::array<double, 3> w{1.0, 2.0, 3.0};
+    EXPECT_EQ(fn(w, 2.0), 3.0);
+    EXPECT_THROW(fn(w, 3.0), std::out_of_range);
+    EXPECT_THROW(fn(w, -1.0), std::out_of_range);
+}
+
+TEST(Arrays, ShortArgumentThrows) {
+    // Every read is in bounds for w, but the argument holds 2 of its 3
+    constexpr auto w = avar("w", 3);
+    constexpr auto checked = compile<index(w, 0)>();
+    constexpr auto proven = compile<MIndexProven(w, Expr::lit(0))>();
+    std::vector<double> data{1.0, 2.0};
+    std::span<const double> two{data};
+    EXPECT_THROW(checked(two), std::out_of_range);
+    EXPECT_THROW(proven(two), std::out_of_range);
+    data.push_back(3.0);
+    EXPECT_EQ(proven(std::span<const double>{data}), 1.0);
+}
+
+TEST(Arrays, ProvenIndexIsPure) {
+    constexpr auto w = avar("w", 3);
+    constexpr auto i = Expr::var("i");
+    constexpr auto checked = index(w, i);
+    constexpr auto proven = MIndexProven(w, i);
+    static_assert(
+        !detail::subtree_cost<MIndex>(checked.ast, checked.id).pure);
+    static_assert(
+        detail::subtree_cost<MIndexProven>(proven.ast, proven.id).pure);
+    constexpr auto fn = compile<proven>();
+    static_assert(fn(std::array{1.0, 2.0, 3.0}, 1.0) == 2.0);
+}
+
+TEST(Arrays, OptimizeKeepsCheckedReads) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto w = avar("w", 4);
+    constexpr auto e = sum("i", 0, 4, index(w, i) * index(w, i));
+    constexpr auto r = optimize<O2>(e);
+    constexpr auto fn = math_compile<r>();
+    static_assert(fn(std::array{1.0, 2.0, 3.0, 4.0}) == 30.0);
+}
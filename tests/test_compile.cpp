@@ -1,7 +1,9 @@
+#include <array>
 #include <gtest/gtest.h>
 #include <refmacro/compile.hpp>
 #include <refmacro/expr.hpp>
 #include <refmacro/macro.hpp>
+#include <type_traits>
 
 using namespace refmacro;
 
@@ -101,6 +103,52 @@ TEST(Compile, RuntimeCall) {
     EXPECT_DOUBLE_EQ(fn(0.0, 5.0), 5.0);
 }
 
+// --- Literal kinds: literals take the evaluation type ---
+
+TEST(LiteralKind, IntegralValueBuildsIntegerLiteral) {
+    constexpr auto i = Expr::lit(3);
+    constexpr auto r = Expr::lit(3.0);
+    static_assert(is_int_lit(i.ast.nodes[i.id]));
+    static_assert(!is_int_lit(r.ast.nodes[r.id]));
+    static_assert(i.ast.nodes[i.id].payload == r.ast.nodes[r.id].payload);
+}
+
+TEST(LiteralKind, FloatArgumentsStayFloat) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Add(Mul(x, Expr::lit(0.5)), Expr::lit(2));
+    constexpr auto fn = compile<e>();
+    static_assert(std::is_same_v<decltype(fn(1.0f)), float>);
+    static_assert(fn(3.0f) == 3.5f);
+    static_assert(std::is_same_v<decltype(fn(1.0)), double>);
+}
+
+TEST(LiteralKind, IntegerArgumentsStayIntegral) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Add(Mul(x, Expr::lit(3)), Expr::lit(1));
+    constexpr auto fn = compile<e>();
+    static_assert(std::is_same_v<decltype(fn(2)), int>);
+    static_assert(fn(2) == 7);
+    static_assert(std::is_same_v<decltype(fn(2LL)), long long>);
+    // A real literal is not truncated: it widens the result to double
+    constexpr auto half = compile<Mul(x, Expr::lit(0.5))>();
+    static_assert(std::is_same_v<decltype(half(3)), double>);
+    static_assert(half(3) == 1.5);
+}
+
+TEST(LiteralKind, MixedArgumentsUseTheCommonType) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto fn = compile<Add(Mul(x, y), Expr::lit(1))>();
+    static_assert(std::is_same_v<decltype(fn(2, 1.5f)), float>);
+    static_assert(fn(2, 1.5f) == 4.0f);
+}
+
+TEST(LiteralKind, NoArithmeticArgumentsGiveDouble) {
+    constexpr auto fn = compile<Add(Expr::lit(1), Expr::lit(2))>();
+    static_assert(std::is_same_v<decltype(fn()), double>);
+    static_assert(fn() == 3.0);
+}
+
 // --- Test that macros are truly generic (custom DSL node) ---
 
 constexpr auto If =
@@ -186,3 +234,203 @@ TEST(AutoCompile, CustomDSLAutoDiscover) {
     static_assert(fn(5.0) == 5.0);
     static_assert(fn(-3.0) == 3.0);
 }
+
+// --- Node-aware lowerings (NodeRef before the child closures) ---
+
+// Literal exponents unroll to a multiply chain; others loop at runtime
+constexpr auto Pow =
+    defmacro<"pow">([](NodeInfo auto node, auto base, auto exp) {
+        if constexpr (node.child(1).tag() == "lit") {
+            constexpr int k = static_cast<int>(node.child(1).payload());
+            return [=](auto... args) constexpr {
+                auto b = base(args...);
+                return [&]<int... Is>(std::integer_sequence<int, Is...>) {
+                    return ((static_cast<void>(Is), b) * ... * 1.0);
+                }(std::make_integer_sequence<int, k>{});
+            };
+        } else {
+            return [=](auto... args) constexpr {
+                auto b = base(args...);
+                double r = 1.0;
+                for (int i = 0; i < static_cast<int>(exp(args...)); ++i)
+                    r *= b;
+                return r;
+            };
+        }
+    });
+
+// Reports the literal payload of its child, or -1 for anything else
+constexpr auto LitOf = defmacro<"lit_of">([](NodeInfo auto node, auto) {
+    constexpr bool is_lit = node.child(0).tag() == "lit";
+    constexpr double v = is_lit ? node.child(0).payload() : -1.0;
+    return [](auto...) constexpr { return v; };
+});
+
+// Unconstrained node parameter: arity differs from the closure count
+constexpr auto Arity = defmacro<"arity">([](auto node, auto, auto) {
+    constexpr int n = node.child_count();
+    return [](auto...) constexpr { return n; };
+});
+
+TEST(NodeAwareLowering, LiteralChild) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e1 = LitOf(Expr::lit(4.0));
+    constexpr auto e2 = LitOf(x);
+    static_assert(compile<e1>()() == 4.0);
+    static_assert(compile<e2>()(9.0) == -1.0);
+}
+
+TEST(NodeAwareLowering, PowSpecialization) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto n = Expr::var("n");
+    constexpr auto cube = Pow(x, Expr::lit(3.0));
+    constexpr auto general = Pow(x, n);
+    static_assert(compile<cube>()(2.0) == 8.0);
+    static_assert(compile<general>()(2.0, 3.0) == 8.0);
+    EXPECT_DOUBLE_EQ(compile<cube>()(1.5), 3.375);
+}
+
+TEST(NodeAwareLowering, UnconstrainedNodeParameter) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Arity(x, Mul(x, x));
+    static_assert(compile<e>()(1.0) == 2);
+}
+
+TEST(NodeAwareLowering, MixesWithClosureOnlyMacros) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Add(Pow(x, Expr::lit(2.0)), Neg(x));
+    static_assert(compile<e>()(3.0) == 6.0);
+}
+
+// --- Backend-specific lowerings ---
+
+using Lanes = std::array<double, 4>;
+
+// Generic lowering works on scalars; the batch one maps over 4 lanes
+constexpr auto Sq = defmacro<"sq">(
+    [](auto x) {
+        return [=](auto... args) constexpr {
+            auto v = x(args...);
+            return v * v;
+        };
+    },
+    lower<backend::batch>([](auto x) {
+        return [=](auto... args) constexpr {
+            Lanes v = x(args...);
+            Lanes r{};
+            for (std::size_t i = 0; i < r.size(); ++i)
+                r[i] = v[i] * v[i];
+            return r;
+        };
+    }));
+
+constexpr auto VAdd = defmacro<"vadd">(
+    [](auto lhs, auto rhs) {
+        return [=](auto... args) constexpr {
+            return lhs(args...) + rhs(args...);
+        };
+    },
+    lower<backend::batch>([](auto lhs, auto rhs) {
+        return [=](auto... args) constexpr {
+            Lanes l = lhs(args...), r = rhs(args...);
+            for (std::size_t i = 0; i < l.size(); ++i)
+                l[i] += r[i];
+            return l;
+        };
+    }));
+
+TEST(Backend, SelectsNamedLowering) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = VAdd(Sq(x), y);
+    constexpr auto scalar = compile<e>();
+    constexpr auto batch = compile<e, backend::batch>();
+    static_assert(scalar(3.0, 1.0) == 10.0);
+    constexpr auto r = batch(Lanes{1, 2, 3, 4}, Lanes{1, 1, 1, 1});
+    static_assert(r[0] == 2.0 && r[1] == 5.0 && r[2] == 10.0 && r[3] == 17.0);
+}
+
+TEST(Backend, FallsBackToGenericLowering) {
+    // Neg declares no interval lowering, so the generic one is used
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Sq(Neg(x));
+    static_assert(compile<e, backend::interval>()(3.0) == 9.0);
+}
+
+TEST(Backend, LoweringLookup) {
+    static_assert(std::is_same_v<decltype(Sq.lowering<backend::generic>()),
+                                 decltype(Sq.fn)>);
+    static_assert(!std::is_same_v<decltype(Sq.lowering<backend::batch>()),
+                                  decltype(Sq.fn)>);
+    static_assert(std::is_same_v<decltype(Neg.lowering<backend::batch>()),
+                                 decltype(Neg.fn)>);
+}
+
+// --- compile_fn: plain function pointers ---
+
+TEST(CompileFn, FixedSignature) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = Add(Mul(x, x), y);
+    constexpr double (*f)(double, double) =
+        compile_fn<e, double(double, double)>();
+    static_assert(f(3.0, 1.0) == 10.0);
+    EXPECT_DOUBLE_EQ(f(-2.0, 0.5), 4.5);
+}
+
+TEST(CompileFn, ArrayForm) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = Add(Mul(x, x), y);
+    constexpr double (*f)(const double*) =
+        compile_fn<e, double(const double*)>();
+    constexpr double args[] = {3.0, 1.0};
+    static_assert(f(args) == 10.0);
+}
+
+TEST(CompileFn, ConvertsResult) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Mul(x, Expr::lit(2.5));
+    constexpr auto f = compile_fn<e, int(int)>();
+    static_assert(f(2) == 5);
+}
+
+TEST(CompileFn, DispatchTable) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    static constexpr auto sum = Add(x, y);
+    static constexpr auto prod = Mul(x, y);
+    static constexpr auto neg = Neg(Add(x, y));
+    constexpr double (*table[])(const double*) = {
+        compile_fn<sum, double(const double*)>(),
+        compile_fn<prod, double(const double*)>(),
+        compile_fn<neg, double(const double*)>(),
+    };
+    const double args[] = {2.0, 5.0};
+    EXPECT_DOUBLE_EQ(table[0](args), 7.0);
+    EXPECT_DOUBLE_EQ(table[1](args), 10.0);
+    EXPECT_DOUBLE_EQ(table[2](args), -7.0);
+}
+
+// --- Stateless closures ---
+
+TEST(StatelessCompile, CompiledFunctionIsEmpty) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = Neg(Add(Mul(x, Expr::lit(3.0)), Mul(y, y)));
+    constexpr auto f = compile<e>();
+    static_assert(std::is_empty_v<decltype(f)>);
+    static_assert(std::is_trivially_copyable_v<decltype(f)>);
+    static_assert(f(1.0, 2.0) == -7.0);
+}
+
+TEST(StatelessCompile, NodeFunctionsAreEmpty) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Add(Mul(x, x), Expr::lit(1.0));
+    constexpr auto node =
+        detail::compile_node<e.ast, e.id, extract_var_map(e.ast, e.id),
+                             Scope{}, Add, Mul>();
+    static_assert(std::is_empty_v<decltype(node)>);
+    // A default-constructed node function evaluates the same subtree
+    static_assert(decltype(node){}(3.0) == 10.0);
+}
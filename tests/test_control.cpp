@@ -2,6 +2,7 @@
 #include <refmacro/control.hpp>
 #include <refmacro/math.hpp>
 #include <refmacro/pretty_print.hpp>
+#include <type_traits>
 
 using namespace refmacro;
 
@@ -131,6 +132,23 @@ TEST(ControlMacros, ComparisonWithDouble) {
     EXPECT_FALSE(fn2(4.0));
 }
 
+TEST(ControlMacros, IntegralOperandsStayIntegral) {
+    // x * 2 + 1 and x < 10 build integer literals: an int kernel stays int
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * 2 + 1;
+    static_assert(is_int_lit(e.ast.nodes[e.ast.nodes[e.id].children[1]]));
+    constexpr auto fn = full_compile<e>();
+    static_assert(std::is_same_v<decltype(fn(3)), int>);
+    static_assert(fn(3) == 7);
+    static_assert(std::is_same_v<decltype(fn(3.0)), double>);
+    constexpr auto t = full_compile<MCond(x < 10, 2 - x, x / 2)>();
+    static_assert(std::is_same_v<decltype(t(3)), int>);
+    static_assert(t(3) == -1 && t(15) == 7);
+    // A real operand is still a real literal
+    constexpr auto h = x * 0.5;
+    static_assert(!is_int_lit(h.ast.nodes[h.ast.nodes[h.id].children[1]]));
+}
+
 // --- Pretty-print tests ---
 
 TEST(ControlPrettyPrint, Cond) {
@@ -215,12 +233,99 @@ TEST(ControlMacros, Clamp) {
     EXPECT_DOUBLE_EQ(fn(15.0, 0.0, 10.0), 10.0);
 }
 
+// --- Branchless select for cheap, pure cond arms ---
+
+inline int probe_calls = 0;
+
+// Same lowering, annotated pure (speculatable) and left unannotated
+constexpr auto PureProbe = defmacro<"pprobe", pure_op>([](auto x) {
+    return [=](auto... a) {
+        ++probe_calls;
+        return x(a...);
+    };
+});
+constexpr auto Probe = defmacro<"probe">([](auto x) {
+    return [=](auto... a) {
+        ++probe_calls;
+        return x(a...);
+    };
+});
+
+TEST(CondSelect, CostModel) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = MCond(x < y, x * y + 1.0, x - y);
+    constexpr auto n = e.ast.nodes[e.id];
+    static_assert(detail::subtree_cost<MAdd, MMul, MSub>(e.ast, n.children[1])
+                      .cost == 2);
+    static_assert(detail::prefer_select<MAdd, MMul, MSub>(
+        e.ast, n.children[1], n.children[2]));
+    // Unknown macros are impure
+    static_assert(!detail::prefer_select<MAdd, MMul>(e.ast, n.children[1],
+                                                     n.children[2]));
+}
+
+TEST(CondSelect, DivisionKeepsBranch) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = MCond(y == Expr::lit(0.0), Expr::lit(0.0), x / y);
+    constexpr auto n = e.ast.nodes[e.id];
+    static_assert(!detail::prefer_select<MDiv, MEq>(e.ast, n.children[1],
+                                                    n.children[2]));
+    // Integer division by zero must not be evaluated speculatively
+    constexpr auto fn = full_compile<e>();
+    EXPECT_EQ(fn(0, 10), 0);
+    EXPECT_EQ(fn(2, 10), 5);
+}
+
+TEST(CondSelect, ExpensiveArmKeepsBranch) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto big = x * x * x * x * x * x * x * x * x * x;
+    constexpr auto e = MCond(x < Expr::lit(0.0), big, x);
+    constexpr auto n = e.ast.nodes[e.id];
+    static_assert(detail::subtree_cost<MMul>(e.ast, n.children[1]).cost >
+                  detail::select_arm_budget);
+    static_assert(!detail::prefer_select<MMul, MLt>(e.ast, n.children[1],
+                                                    n.children[2]));
+}
+
+TEST(CondSelect, PureArmsAreEvaluatedEagerly) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MCond(x < Expr::lit(0.0), PureProbe(-x), PureProbe(x));
+    constexpr auto fn = full_compile<e>();
+    probe_calls = 0;
+    EXPECT_DOUBLE_EQ(fn(-3.0), 3.0);
+    EXPECT_EQ(probe_calls, 2);
+    EXPECT_DOUBLE_EQ(fn(4.0), 4.0);
+    EXPECT_EQ(probe_calls, 4);
+}
+
+TEST(CondSelect, UnannotatedArmsStayLazy) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MCond(x < Expr::lit(0.0), Probe(-x), Probe(x));
+    constexpr auto fn = full_compile<e>();
+    probe_calls = 0;
+    EXPECT_DOUBLE_EQ(fn(-3.0), 3.0);
+    EXPECT_EQ(probe_calls, 1);
+}
+
+TEST(CondSelect, MatchesBranchyResults) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto lo = Expr::var("lo");
+    constexpr auto hi = Expr::var("hi");
+    constexpr auto e = MCond(x < lo, lo, MCond(x > hi, hi, x)) * 2.0;
+    constexpr auto fn = full_compile<e>();
+    static_assert(fn(5.0, 0.0, 10.0) == 10.0);
+    static_assert(fn(-1.0, 0.0, 10.0) == 0.0);
+    static_assert(fn(15.0, 0.0, 10.0) == 20.0);
+}
+
 // --- Lambda / Apply / Let tests ---
 
 TEST(LambdaApply, BasicLet) {
     // let tmp = x * x in tmp + tmp
     // Equivalent to: ((lambda tmp. tmp + tmp) (x * x))
-    // Note: call-by-name semantics — x*x is re-evaluated per use of tmp
+    // x*x is pure, so it is evaluated once and shared by both uses of tmp
     constexpr auto x = Expr::var("x");
     constexpr auto e = let_("tmp", x * x, Expr::var("tmp") + Expr::var("tmp"));
     constexpr auto fn = full_compile<e>();
@@ -229,6 +334,37 @@ TEST(LambdaApply, BasicLet) {
     EXPECT_DOUBLE_EQ(fn(5.0), 50.0); // 25 + 25
 }
 
+TEST(LambdaApply, ImpureLetIsByName) {
+    // A value that may not be pure runs at each use, and only there
+    constexpr auto x = Expr::var("x");
+    constexpr auto t = Expr::var("t");
+    constexpr auto e = let_("t", Probe(x), MCond(x > 0.0, t + t, -x));
+    constexpr auto fn = full_compile<e>();
+    probe_calls = 0;
+    EXPECT_DOUBLE_EQ(fn(-2.0), 2.0);
+    EXPECT_EQ(probe_calls, 0);
+    EXPECT_DOUBLE_EQ(fn(3.0), 6.0);
+    EXPECT_EQ(probe_calls, 2);
+    // A pure value read from it is not speculated either, nor is an arm
+    // that reads it
+    constexpr auto u = Expr::var("u");
+    constexpr auto nested =
+        let_("t", Probe(x), let_("u", t + 1.0, MCond(x > 0.0, u, -x)));
+    constexpr auto gn = full_compile<nested>();
+    probe_calls = 0;
+    EXPECT_DOUBLE_EQ(gn(-2.0), 2.0);
+    EXPECT_EQ(probe_calls, 0);
+    constexpr auto arm = let_("t", Probe(x), MCond(x > 0.0, t, -x));
+    constexpr auto hn = full_compile<arm>();
+    EXPECT_DOUBLE_EQ(hn(-2.0), 2.0);
+    EXPECT_EQ(probe_calls, 0);
+    // A pure value is computed once
+    constexpr auto shared = let_("t", PureProbe(x), t + t);
+    constexpr auto sn = full_compile<shared>();
+    EXPECT_DOUBLE_EQ(sn(3.0), 6.0);
+    EXPECT_EQ(probe_calls, 1);
+}
+
 TEST(LambdaApply, LetWithConstant) {
     // let c = 42 in c + x
     constexpr auto x = Expr::var("x");
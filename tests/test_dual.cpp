@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <refmacro/control.hpp>
+#include <refmacro/dual.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Dual arithmetic ---
+
+TEST(Dual, ProductAndQuotientRules) {
+    constexpr auto x = Dual<1>::variable(3.0, 0);
+    constexpr auto p = x * x;
+    static_assert(p.val == 9.0 && p.d[0] == 6.0);
+    constexpr auto q = Dual<1>(1.0) / x;
+    static_assert(q.d[0] == -1.0 / 9.0);
+}
+
+TEST(Dual, ConstantsHaveZeroTangent) {
+    constexpr Dual<3> c = 2.5;
+    static_assert(c.val == 2.5);
+    static_assert(c.d[0] == 0.0 && c.d[1] == 0.0 && c.d[2] == 0.0);
+}
+
+// --- compile_dual ---
+
+TEST(CompileDual, ValueAndPartials) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * x * y;
+    constexpr auto fn = compile_dual<f, 2>();
+    constexpr auto r =
+        fn(Dual<2>::variable(3.0, 0), Dual<2>::variable(2.0, 1));
+    static_assert(r.val == 18.0);
+    static_assert(r.d[0] == 12.0);
+    static_assert(r.d[1] == 9.0);
+}
+
+TEST(CompileDual, MatchesSymbolicDerivative) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * x * y - y / (x + 2.0);
+    constexpr auto dfdx = compile<differentiate(f, "x")>();
+    constexpr auto fn = compile_dual<f>();
+    for (double xv : {-1.0, 0.5, 3.0}) {
+        for (double yv : {0.0, 2.0}) {
+            auto r = fn(Dual<1>::variable(xv, 0), yv);
+            EXPECT_DOUBLE_EQ(r.d[0], dfdx(xv, yv));
+        }
+    }
+}
+
+TEST(CompileDual, DirectionalDerivative) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * y + y;
+    // Direction (1, 2) in the single lane: df = y * 1 + (x + 1) * 2
+    Dual<1> xd{1.0}, yd{4.0};
+    xd.d[0] = 1.0;
+    yd.d[0] = 2.0;
+    auto r = compile_dual<f>()(xd, yd);
+    EXPECT_DOUBLE_EQ(r.val, 8.0);
+    EXPECT_DOUBLE_EQ(r.d[0], 8.0);
+}
+
+TEST(CompileDual, CondDifferentiatesTakenBranch) {
+    constexpr auto x = Expr::var("x");
+    // |x| as cond(x < 0, -x, x)
+    constexpr auto f = MCond(x < 0.0, -x, x);
+    constexpr auto fn = compile_dual<f>();
+    static_assert(fn(Dual<1>::variable(-2.0, 0)).d[0] == -1.0);
+    static_assert(fn(Dual<1>::variable(2.0, 0)).d[0] == 1.0);
+}
+
+TEST(CompileDual, LetAndLiteralArms) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto s = Expr::var("s");
+    // let s = x * x in cond(s > 4, s, 0)
+    constexpr auto f = let_("s", x * x, MCond(s > 4.0, s, Expr::lit(0.0)));
+    constexpr auto fn = compile_dual<f>();
+    static_assert(fn(Dual<1>::variable(3.0, 0)).d[0] == 6.0);
+    static_assert(fn(Dual<1>::variable(1.0, 0)).val == 0.0);
+    static_assert(fn(Dual<1>::variable(1.0, 0)).d[0] == 0.0);
+}
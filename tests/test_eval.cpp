@@ -0,0 +1,160 @@
+#include <array>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <optional>
+#include <refmacro/control.hpp>
+#include <refmacro/eval.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Built-in semantics ---
+
+TEST(Eval, Literal) { static_assert(eval(Expr::lit(2.5)) == 2.5); }
+
+TEST(Eval, Polynomial) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto f = x * x + 2.0 * x + 1.0;
+    static_assert(eval(f, {3.0}) == 16.0);
+    static_assert(eval(f, {-1.0}) == 0.0);
+}
+
+TEST(Eval, ArgumentOrderMatchesCompile) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = (x - y) / (y + 1.0);
+    constexpr auto fn = math_compile<e>();
+    static_assert(eval(e, {7.0, 1.0}) == fn(7.0, 1.0));
+    static_assert(eval(e, {1.0, 3.0}) == fn(1.0, 3.0));
+}
+
+TEST(Eval, Negation) {
+    constexpr auto x = Expr::var("x");
+    static_assert(eval(-(x * 2.0), {4.0}) == -8.0);
+}
+
+TEST(Eval, Transcendentals) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = exp(x) + log(x) + sqrt(x) + sin(x) + cos(x) + tanh(x);
+    static_assert(eval(e, {2.0}) == std::exp(2.0) + std::log(2.0) +
+                                        std::sqrt(2.0) + std::sin(2.0) +
+                                        std::cos(2.0) + std::tanh(2.0));
+    static_assert(eval(pow(x, 3.0), {2.0}) == 8.0);
+    static_assert(eval(e, {0.5}) == math_compile<e>()(0.5));
+}
+
+TEST(Eval, Comparisons) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    static_assert(eval(x < y, {1.0, 2.0}) == 1.0);
+    static_assert(eval(x > y, {1.0, 2.0}) == 0.0);
+    static_assert(eval(x <= y, {2.0, 2.0}) == 1.0);
+    static_assert(eval(x >= y, {1.0, 2.0}) == 0.0);
+    static_assert(eval(x == y, {2.0, 2.0}) == 1.0);
+}
+
+TEST(Eval, Logical) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    static_assert(eval(x && y, {1.0, 0.0}) == 0.0);
+    static_assert(eval(x || y, {1.0, 0.0}) == 1.0);
+    static_assert(eval(!x, {0.0}) == 1.0);
+}
+
+TEST(Eval, CondOnlyEvaluatesSelectedArm) {
+    // The untaken arm divides by zero, which eval would reject
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MCond(x == Expr::lit(0.0), Expr::lit(0.0), 1.0 / x);
+    static_assert(eval(e, {0.0}) == 0.0);
+    static_assert(eval(e, {4.0}) == 0.25);
+}
+
+TEST(Eval, ShortCircuit) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x > Expr::lit(0.0) && 1.0 / x > Expr::lit(0.5);
+    static_assert(eval(e, {0.0}) == 0.0);
+    static_assert(eval(e, {1.0}) == 1.0);
+}
+
+TEST(Eval, Let) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = let_("y", x * 2.0, y * y + x);
+    static_assert(eval(e, {3.0}) == 39.0);
+}
+
+TEST(Eval, LetShadowing) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = let_("x", Expr::lit(5.0), x + 1.0);
+    static_assert(eval(e) == 6.0);
+}
+
+TEST(Eval, NestedLet) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = let_("a", x + 1.0, let_("b", a * a, b - a));
+    static_assert(eval(e, {2.0}) == 6.0);
+}
+
+TEST(Eval, Progn) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MProgn(x * 100.0, x + 1.0);
+    static_assert(eval(e, {1.0}) == 2.0);
+}
+
+// --- Custom macros via hook ---
+
+constexpr auto Abs = defmacro<"abs">([](auto x) {
+    return [=](auto... a) constexpr {
+        auto v = x(a...);
+        return v < 0 ? -v : v;
+    };
+});
+
+constexpr auto abs_hook = [](NodeView<64> n, FoldChildren<double> c) consteval
+    -> std::optional<double> {
+    if (n.tag() == "abs")
+        return c[0] < 0 ? -c[0] : c[0];
+    return std::nullopt;
+};
+
+TEST(Eval, HookEvaluatesCustomMacro) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = Abs(x - 5.0) * 2.0;
+    static_assert(eval(e, {1.0}, abs_hook) == 8.0);
+    static_assert(eval(e, {1.0}, abs_hook) == compile<e>()(1.0));
+}
+
+TEST(Eval, HookOverridesBuiltin) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto saturating = [](NodeView<64> n, FoldChildren<double> c)
+        consteval -> std::optional<double> {
+        if (n.tag() == "add")
+            return c[0] + c[1] > 10.0 ? 10.0 : c[0] + c[1];
+        return std::nullopt;
+    };
+    static_assert(eval(x + 8.0, {5.0}, saturating) == 10.0);
+}
+
+// --- simplify reuses eval for constant folding ---
+
+TEST(Eval, SimplifyFoldsConstants) {
+    constexpr auto e = simplify(Expr::lit(3.0) * Expr::lit(4.0) - 2.0);
+    static_assert(e.ast.nodes[e.id].payload == 10.0);
+}
+
+// --- Precomputed table built by eval ---
+
+TEST(Eval, CompileTimeTable) {
+    constexpr auto x = Expr::var("x");
+    static constexpr auto sq = x * x + 1.0;
+    constexpr auto table = []() consteval {
+        std::array<double, 16> t{};
+        for (int i = 0; i < 16; ++i)
+            t[i] = eval(sq, {static_cast<double>(i)});
+        return t;
+    }();
+    static_assert(table[0] == 1.0);
+    static_assert(table[15] == 226.0);
+}
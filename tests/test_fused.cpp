@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/fused.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/passes.hpp>
+#include <tuple>
+#include <type_traits>
+
+using namespace refmacro;
+
+// --- Fused plan ---
+
+TEST(FusedPlan, SharesSubtreesAcrossOutputs) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = (x * y + 1.0) * x;
+    constexpr auto g = (x * y + 1.0) * y;
+    constexpr auto plan = fused_plan<f, g>();
+    static_assert(plan.outputs == 2);
+    static_assert(plan.shared == 1);
+    // The merged tree holds one copy of x * y + 1
+    static_assert(analyze(plan.merged).ops_of("add") == 1);
+    static_assert(analyze(plan.merged).ops_of("mul") == 3);
+}
+
+TEST(FusedPlan, VariablesInOutputOrder) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto c = Expr::var("c");
+    constexpr auto plan = fused_plan<b * a, c + a>();
+    static_assert(plan.vars.count == 3);
+    static_assert(plan.vars.index_of("b") == 0);
+    static_assert(plan.vars.index_of("a") == 1);
+    static_assert(plan.vars.index_of("c") == 2);
+}
+
+TEST(FusedPlan, NothingShared) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto plan = fused_plan<x * 2.0, y + 1.0>();
+    static_assert(plan.shared == 0);
+}
+
+// --- compile_many ---
+
+TEST(CompileMany, ReturnsAllOutputs) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = (x * y + 1.0) * x;
+    constexpr auto g = (x * y + 1.0) * y;
+    constexpr auto fn = compile_many<f, g>();
+    static_assert(std::is_empty_v<decltype(fn)>);
+    constexpr auto r = fn(2.0, 3.0);
+    static_assert(std::get<0>(r) == 14.0);
+    static_assert(std::get<1>(r) == 21.0);
+    auto [fv, gv] = fn(-1.0, 0.5);
+    EXPECT_DOUBLE_EQ(fv, -0.5);
+    EXPECT_DOUBLE_EQ(gv, 0.25);
+}
+
+TEST(CompileMany, MatchesSeparateCompiles) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * x * y - y / (x + 2.0);
+    constexpr auto dfdx = optimize<O1>(differentiate(f, "x"));
+    constexpr auto dfdy = optimize<O1>(differentiate(f, "y"));
+    constexpr auto fn = compile_many<f, dfdx, dfdy>();
+    constexpr auto f1 = compile<f>();
+    constexpr auto f2 = compile<dfdx>();
+    constexpr auto f3 = compile<dfdy>();
+    for (double xv : {-1.0, 0.5, 3.0}) {
+        for (double yv : {0.0, 2.0}) {
+            auto [v, dx, dy] = fn(xv, yv);
+            EXPECT_DOUBLE_EQ(v, f1(xv, yv));
+            EXPECT_DOUBLE_EQ(dx, f2(xv, yv));
+            EXPECT_DOUBLE_EQ(dy, f3(xv, yv));
+        }
+    }
+}
+
+TEST(CompileMany, OutputWithFewerVariables) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto fn = compile_many<x * x, x * x + y>();
+    static_assert(fn(3.0, 1.0) == std::tuple{9.0, 10.0});
+}
+
+TEST(CompileMany, WithControlFlowAndLet) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto s = Expr::var("s");
+    constexpr auto f = let_("s", x * x, MCond(s > 4.0, s, x));
+    constexpr auto g = x * x - 1.0;
+    constexpr auto fn = compile_many<f, g>();
+    static_assert(fn(3.0) == std::tuple{9.0, 8.0});
+    static_assert(fn(1.5) == std::tuple{1.5, 1.25});
+}
+
+TEST(CompileMany, SingleOutput) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto fn = compile_many<x + 1.0>();
+    static_assert(std::get<0>(fn(1.0)) == 2.0);
+}
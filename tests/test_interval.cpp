@@ -0,0 +1,130 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include <refmacro/control.hpp>
+#include <refmacro/interval.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Interval arithmetic ---
+
+TEST(Interval, ExactResultsStayPoints) {
+    constexpr auto s = Interval{2.0} + Interval{3.0};
+    static_assert(s.lo == 5.0 && s.hi == 5.0);
+    constexpr auto p = Interval{-1.0, 2.0} * Interval{3.0, 4.0};
+    static_assert(p.lo == -4.0 && p.hi == 8.0);
+    constexpr auto d = Interval{1.0, 2.0} - Interval{0.5, 4.0};
+    static_assert(d.lo == -3.0 && d.hi == 1.5);
+}
+
+TEST(Interval, RoundsOutward) {
+    // 0.1 + 0.2 is not a double: the enclosure straddles it
+    constexpr auto s = Interval{0.1} + Interval{0.2};
+    static_assert(s.lo < s.hi);
+    static_assert(s.lo <= 0.1 + 0.2 && 0.1 + 0.2 <= s.hi);
+    static_assert(detail::next_up(s.lo) == s.hi);
+    constexpr auto p = Interval{0.1} * Interval{3.0};
+    static_assert(p.lo < p.hi && detail::next_up(p.lo) == p.hi);
+    constexpr auto q = Interval{1.0} / Interval{3.0};
+    static_assert(q.lo < 1.0 / 3.0 && 1.0 / 3.0 < q.hi);
+}
+
+TEST(Interval, DivisionByZeroIsUnbounded) {
+    constexpr auto q = Interval{1.0} / Interval{-1.0, 1.0};
+    static_assert(q.lo == -detail::inf && q.hi == detail::inf);
+    static_assert((Interval{1.0} / Interval{0.0}).is_empty());
+}
+
+TEST(Interval, Comparisons) {
+    constexpr Interval a{0.0, 1.0};
+    static_assert((a < Interval{2.0}).is_true());
+    static_assert((a > Interval{2.0}).is_false());
+    constexpr auto mixed = a < Interval{0.5};
+    static_assert(mixed.maybe_true && mixed.maybe_false);
+    static_assert((!(a < Interval{2.0})).is_false());
+    static_assert(((a >= Interval{0.0}) && (a <= Interval{1.0})).is_true());
+}
+
+TEST(Interval, ElementaryFunctionsEnclose) {
+    Interval a{-0.5, 2.0};
+    for (double v : {-0.5, 0.0, 1.0, 2.0}) {
+        EXPECT_TRUE(exp(a).contains(std::exp(v)));
+        EXPECT_TRUE(tanh(a).contains(std::tanh(v)));
+        EXPECT_TRUE(sin(a).contains(std::sin(v)));
+        EXPECT_TRUE(cos(a).contains(std::cos(v)));
+    }
+    // sin peaks at pi / 2 inside a; cos does not dip to -1
+    EXPECT_EQ(sin(a).hi, 1.0);
+    EXPECT_GT(cos(a).lo, -1.0);
+    EXPECT_EQ(sqrt(Interval{-1.0, 4.0}).lo, 0.0);
+    EXPECT_TRUE(log(Interval{-2.0, -1.0}).is_empty());
+    // Even powers of an interval around zero are nonnegative
+    auto sq = pow(Interval{-1.0, 2.0}, Interval{2.0});
+    EXPECT_EQ(sq.lo, 0.0);
+    EXPECT_TRUE(sq.contains(4.0));
+    // (-2)^2 is defined though most of the box is not
+    auto neg = pow(Interval{-2.0, -1.0}, Interval{1.5, 2.5});
+    EXPECT_TRUE(neg.contains(std::pow(-2.0, 2.0)));
+    EXPECT_TRUE(neg.contains(std::pow(-1.0, 2.0)));
+    // No whole exponent: only the nonnegative part of the base has powers
+    EXPECT_TRUE(pow(Interval{-2.0, -1.0}, Interval{1.25, 1.75}).is_empty());
+    auto half = pow(Interval{-1.0, 4.0}, Interval{0.5});
+    EXPECT_TRUE(half.contains(0.0) && half.contains(2.0));
+}
+
+// --- compile_interval ---
+
+TEST(CompileInterval, EnclosesEveryPoint) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = x * x - y / (x + 2.0);
+    constexpr auto f = full_compile<e>();
+    constexpr auto fn = compile_interval<e>();
+    constexpr Interval bx{-1.0, 2.0};
+    constexpr Interval by{0.5, 1.0};
+    constexpr auto r = fn(bx, by);
+    for (double xv = bx.lo; xv <= bx.hi; xv += 0.125)
+        for (double yv = by.lo; yv <= by.hi; yv += 0.125)
+            EXPECT_TRUE(r.contains(f(xv, yv))) << xv << ", " << yv;
+    // Plain arguments are points
+    static_assert(fn(1.0, 3.0).contains(0.0));
+}
+
+TEST(CompileInterval, DecidedConditionsPickAnArm) {
+    // relu(x) over an all-negative box is exactly zero
+    constexpr auto x = Expr::var("x");
+    constexpr auto relu = MCond(x > 0.0, x, Expr::lit(0.0));
+    constexpr auto fn = compile_interval<relu>();
+    constexpr auto neg = fn(Interval{-3.0, -1.0});
+    static_assert(neg.lo == 0.0 && neg.hi == 0.0);
+    constexpr auto pos = fn(Interval{1.0, 2.0});
+    static_assert(pos.lo == 1.0 && pos.hi == 2.0);
+    // Undecided: the hull of both arms
+    constexpr auto both = fn(Interval{-1.0, 2.0});
+    static_assert(both.lo == -1.0 && both.hi == 2.0);
+}
+
+TEST(CompileInterval, PredicatesOverABox) {
+    // 0 <= x && x < 8 for every x in the box
+    constexpr auto x = Expr::var("x");
+    constexpr auto pred = (x >= 0.0) && (x < 8.0);
+    constexpr auto fn = compile_interval<pred>();
+    static_assert(fn(Interval{1.0, 7.5}).is_true());
+    static_assert(fn(Interval{9.0, 10.0}).is_false());
+    constexpr auto straddles = fn(Interval{7.0, 9.0});
+    static_assert(straddles.maybe_true && straddles.maybe_false);
+}
+
+TEST(CompileInterval, Transcendentals) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = exp(x) * sin(x);
+    constexpr auto fn = compile_interval<e>();
+    auto r = fn(Interval{0.0, 1.0});
+    for (double v = 0.0; v <= 1.0; v += 0.0625)
+        EXPECT_TRUE(r.contains(std::exp(v) * std::sin(v))) << v;
+    // pow(x, y) at (-2, 2) is 4, inside a box mostly without a value
+    constexpr auto y = Expr::var("y");
+    constexpr auto p = pow(x, y);
+    auto q = compile_interval<p>()(Interval{-2.0, -1.0}, Interval{1.5, 2.5});
+    EXPECT_TRUE(q.contains(4.0));
+}
@@ -0,0 +1,204 @@
+#include <array>
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/array.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/eval.hpp>
+#include <refmacro/linalg.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+// --- Building ---
+
+TEST(Linalg, Shapes) {
+    constexpr auto A = mvar("A", 2, 3);
+    constexpr auto B = mvar("B", 3, 4);
+    constexpr auto AB = matmul(A, B);
+    constexpr auto s = detail::linalg_shape(AB.ast, AB.id);
+    static_assert(s.rows == 2 && s.cols == 4);
+    constexpr auto t = transpose(AB);
+    constexpr auto st = detail::linalg_shape(t.ast, t.id);
+    static_assert(st.rows == 4 && st.cols == 2);
+    constexpr auto y = matvec(A, avar("x", 3));
+    static_assert(detail::linalg_shape(y.ast, y.id).rows == 2);
+}
+
+TEST(Linalg, ArgumentOrder) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = dot(vec(x, x), matvec(mvar("A", 2, 2), avar("v", 2)));
+    constexpr auto vm = extract_var_map(e.ast, e.id);
+    static_assert(vm.count == 3);
+    static_assert(str_eq(vm.names[0], "x"));
+    static_assert(str_eq(vm.names[1], "A"));
+    static_assert(str_eq(vm.names[2], "v"));
+}
+
+// --- Compiling: fully unrolled ---
+
+TEST(Linalg, Dot) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = dot(vec(x, y, Expr::lit(2.0)), avar("w", 3));
+    constexpr auto fn = math_compile<e>();
+    static_assert(fn(1.0, 3.0, std::array{4.0, 5.0, 6.0}) ==
+                  4.0 + 15.0 + 12.0);
+}
+
+TEST(Linalg, MatVec) {
+    constexpr auto e = matvec(mvar("A", 2, 3), avar("x", 3));
+    constexpr auto fn = math_compile<e>();
+    constexpr auto r =
+        fn(std::array{1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, std::array{1.0, 0.0, 2.0});
+    static_assert(r.size() == 2);
+    static_assert(r[0] == 7.0 && r[1] == 16.0);
+}
+
+TEST(Linalg, MatMulAndTranspose) {
+    constexpr auto A = mvar("A", 2, 3);
+    constexpr auto B = mvar("B", 3, 2);
+    constexpr auto fn = math_compile<matmul(A, B)>();
+    constexpr std::array a{1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+    constexpr std::array b{7.0, 8.0, 9.0, 10.0, 11.0, 12.0};
+    constexpr auto ab = fn(a, b);
+    static_assert(ab.size() == 4);
+    static_assert(ab[0] == 58.0 && ab[1] == 64.0);
+    static_assert(ab[2] == 139.0 && ab[3] == 154.0);
+
+    constexpr auto at = math_compile<transpose(A)>()(a);
+    static_assert(at[0] == 1.0 && at[1] == 4.0 && at[2] == 2.0);
+    static_assert(at[3] == 5.0 && at[4] == 3.0 && at[5] == 6.0);
+}
+
+TEST(Linalg, QuadraticForm) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto p = vec(x, y);
+    constexpr auto e = dot(p, matvec(mvar("A", 2, 2), p));
+    constexpr auto fn = math_compile<e>();
+    // [1 2; 3 4] at (1, 2): 1 + 2*2 + 3*2 + 4*4
+    static_assert(fn(1.0, 2.0, std::array{1.0, 2.0, 3.0, 4.0}) == 27.0);
+}
+
+TEST(Linalg, EightComponents) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e =
+        dot(vec(x, x, x, x, x, x, x, x * 2.0), avar("w", 8));
+    constexpr auto fn = math_compile<e>();
+    constexpr std::array<double, 8> w{1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+    static_assert(fn(1.0, w) == 9.0);
+}
+
+TEST(Linalg, CostModel) {
+    constexpr auto e = matvec(mvar("A", 4, 4), avar("x", 4));
+    static_assert(analyze(e).nodes == 4);
+}
+
+// --- simplify ---
+
+TEST(Linalg, DoubleTransposeCancels) {
+    constexpr auto A = mvar("A", 2, 3);
+    constexpr auto e = simplify(transpose(transpose(A)));
+    static_assert(str_eq(e.ast.nodes[e.id].tag, "mat"));
+}
+
+TEST(Linalg, ProductTimesVectorReassociates) {
+    constexpr auto A = mvar("A", 3, 3);
+    constexpr auto B = mvar("B", 3, 3);
+    constexpr auto e = matvec(matmul(A, B), avar("x", 3));
+    constexpr auto s = simplify(e);
+    // A (B x): no matmul left
+    static_assert(analyze(s).nodes == analyze(e).nodes);
+    static_assert(str_eq(s.ast.nodes[s.ast.nodes[s.id].children[1]].tag,
+                         "matvec"));
+    constexpr std::array a{1.0, 2.0, 0.0, 0.0, 1.0, 3.0, 2.0, 0.0, 1.0};
+    constexpr std::array b{0.0, 1.0, 1.0, 2.0, 0.0, 1.0, 1.0, 1.0, 0.0};
+    constexpr std::array v{1.0, 2.0, 3.0};
+    constexpr auto r0 = math_compile<e>()(a, b, v);
+    constexpr auto r1 = math_compile<s>()(a, b, v);
+    static_assert(r0 == r1);
+}
+
+TEST(Linalg, ProductTimesVectorKeepsCheaperOrder) {
+    // (A B) x with A: 1x8, B: 8x1, x: 1 costs 8 + 1 multiplies;
+    // A (B x) costs 8 + 8
+    constexpr auto A = mvar("A", 1, 8);
+    constexpr auto B = mvar("B", 8, 1);
+    constexpr auto s = simplify(matvec(matmul(A, B), avar("x", 1)));
+    static_assert(str_eq(s.ast.nodes[s.ast.nodes[s.id].children[0]].tag,
+                         "matmul"));
+}
+
+TEST(Linalg, MatrixChainPicksCheaperOrder) {
+    // (A B) C with A: 8x1, B: 1x8, C: 8x1 costs 64 + 64 multiplies;
+    // A (B C) costs 8 + 8
+    constexpr auto A = mvar("A", 8, 1);
+    constexpr auto B = mvar("B", 1, 8);
+    constexpr auto C = mvar("C", 8, 1);
+    constexpr auto s = simplify(matmul(matmul(A, B), C));
+    constexpr auto root = s.ast.nodes[s.id];
+    static_assert(str_eq(s.ast.nodes[root.children[1]].tag, "matmul"));
+    // Already the cheaper order: left alone
+    constexpr auto t = simplify(matmul(A, matmul(B, C)));
+    static_assert(str_eq(t.ast.nodes[t.ast.nodes[t.id].children[1]].tag,
+                         "matmul"));
+}
+
+// --- differentiate / gradient ---
+
+TEST(Linalg, DifferentiateDot) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = dot(vec(x * y, x), avar("w", 2));
+    constexpr auto df = differentiate(f, "x");
+    constexpr std::array w{3.0, 5.0};
+    static_assert(math_compile<df>()(2.0, w) == 2.0 * 3.0 + 5.0);
+    constexpr auto dz = differentiate(f, "z");
+    static_assert(dz.ast.count == 1 && dz.ast.nodes[dz.id].payload == 0.0);
+}
+
+TEST(Linalg, DifferentiateQuadraticForm) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto p = vec(x, y);
+    constexpr auto f = dot(p, matvec(mvar("A", 2, 2), p));
+    constexpr auto df = differentiate(f, "x");
+    // d/dx p'Ap = ((A + A')p)[0] = 2 * 1 + (2 + 3) * 2; dp/dx = vec(1, 0)
+    // has no variables, so the derivative reads A first
+    constexpr std::array a{1.0, 2.0, 3.0, 4.0};
+    static_assert(math_compile<df>()(a, 1.0, 2.0) == 12.0);
+}
+
+TEST(Linalg, GradientQuadraticForm) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto p = vec(x, y);
+    constexpr auto f = dot(p, matvec(mvar("A", 2, 2), p));
+    constexpr std::array a{1.0, 2.0, 3.0, 4.0};
+    constexpr auto g = gradient(f, {"x", "y"});
+    // dp/dx = vec(1, 0) has no variables: the partials read A first
+    static_assert(math_compile<g[0]>()(a, 1.0, 2.0) == 12.0);
+    static_assert(math_compile<g[1]>()(a, 1.0, 2.0) == 5.0 + 2.0 * 8.0);
+}
+
+TEST(Linalg, DifferentiateThroughMatrixProducts) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto A = mvar("A", 2, 2);
+    constexpr auto p = avar("p", 2);
+    constexpr std::array a{1.0, 2.0, 3.0, 4.0};
+    constexpr std::array pv{5.0, 7.0};
+    // d/dx (A v) . p with v = vec(x, y): (A e0) . p
+    constexpr auto f = dot(matmul(A, vec(x, y)), p);
+    static_assert(math_compile<differentiate(f, "x")>()(a, pv) ==
+                  1.0 * 5.0 + 3.0 * 7.0);
+    constexpr auto g = gradient(f, {"x", "y"});
+    static_assert(math_compile<g[0]>()(a, pv) == 1.0 * 5.0 + 3.0 * 7.0);
+    static_assert(math_compile<g[1]>()(a, pv) == 2.0 * 5.0 + 4.0 * 7.0);
+    // v' A p: the variable sits under transposes
+    constexpr auto h = dot(transpose(matmul(transpose(vec(x, y)), A)), p);
+    static_assert(math_compile<differentiate(h, "x")>()(a, pv) ==
+                  1.0 * 5.0 + 2.0 * 7.0);
+    static_assert(math_compile<gradient(h, {"y"})[0]>()(a, pv) ==
+                  3.0 * 5.0 + 4.0 * 7.0);
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/dual.hpp>
+#include <refmacro/eval.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/passes.hpp>
+#include <type_traits>
+
+using namespace refmacro;
+
+// --- Building: the AST does not grow with the trip count ---
+
+TEST(Loops, SizeIndependentOfTripCount) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto small = sum("i", 0, 4, x * i);
+    constexpr auto large = sum("i", 0, 4096, x * i);
+    static_assert(analyze(small).nodes == analyze(large).nodes);
+    static_assert(analyze(large).nodes == 8);
+}
+
+TEST(Loops, LoopVariableIsNotFree) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = sum("i", 0, 3, x * i) + i;
+    constexpr auto vm = extract_var_map(e.ast, e.id);
+    static_assert(vm.count == 2);
+    static_assert(str_eq(vm.names[0], "x"));
+    static_assert(str_eq(vm.names[1], "i")); // the free i after the loop
+}
+
+// --- Compiling to loops ---
+
+TEST(Loops, Sum) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = sum("i", 0, 64, x * i);
+    constexpr auto fn = math_compile<e>();
+    static_assert(fn(2.0) == 2.0 * 2016.0);
+    EXPECT_EQ(fn(0.5), 1008.0);
+}
+
+TEST(Loops, Product) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = product("i", 1, 6, i); // 5!
+    constexpr auto fn = math_compile<e>();
+    static_assert(fn() == 120.0);
+}
+
+TEST(Loops, FoldRange) {
+    // Horner: acc = acc * x + (i + 1) over i in [0, 3) -> x^2 + 2x + 3
+    constexpr auto x = Expr::var("x");
+    constexpr auto acc = Expr::var("acc");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = fold_range("acc", 0.0, "i", 0, 3, acc * x + (i + 1.0));
+    constexpr auto fn = math_compile<e>();
+    static_assert(fn(2.0) == 11.0);
+}
+
+TEST(Loops, RuntimeBounds) {
+    constexpr auto n = Expr::var("n");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = sum("i", Expr::lit(0.0), n, i);
+    constexpr auto fn = math_compile<e>();
+    static_assert(fn(0.0) == 0.0);
+    static_assert(fn(10.0) == 45.0);
+    EXPECT_EQ(fn(100.0), 4950.0);
+}
+
+TEST(Loops, IndexTakesTheEvaluationType) {
+    // The index does not widen a float or int kernel to double
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = sum("i", 0, 4, x * i + 1);
+    constexpr auto fn = math_compile<e>();
+    static_assert(std::is_same_v<decltype(fn(0.5f)), float>);
+    static_assert(fn(0.5f) == 7.0f);
+    static_assert(std::is_same_v<decltype(fn(2)), int>);
+    static_assert(fn(2) == 16);
+    static_assert(std::is_same_v<decltype(fn(0.5)), double>);
+    constexpr auto acc = Expr::var("acc");
+    constexpr auto f = math_compile<fold_range(
+        "acc", x, "i", Expr::lit(0), Expr::lit(3), acc * 2 + i)>();
+    static_assert(std::is_same_v<decltype(f(1.0f)), float>);
+    static_assert(f(1.0f) == 12.0f);
+}
+
+TEST(Loops, EmptyRange) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto s = math_compile<sum("i", 5, 2, i)>();
+    constexpr auto p = math_compile<product("i", 3, 3, i)>();
+    static_assert(s() == 0.0);
+    static_assert(p() == 1.0);
+}
+
+TEST(Loops, UnrollFactorDoesNotChangeResult) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto body = x / (i + 1.0);
+    constexpr auto rolled = math_compile<sum("i", 0, 103, body, 1)>();
+    constexpr auto by4 = math_compile<sum("i", 0, 103, body, 4)>();
+    constexpr auto by8 = math_compile<sum("i", 0, 103, body, 8)>();
+    constexpr auto full = math_compile<sum("i", 0, 103, body, 200)>();
+    static_assert(rolled(3.0) == by4(3.0));
+    static_assert(rolled(3.0) == by8(3.0));
+    static_assert(rolled(3.0) == full(3.0));
+    EXPECT_EQ(rolled(1.5), by4(1.5));
+}
+
+TEST(Loops, UnrollPolicy) {
+    constexpr auto i = Expr::var("i");
+    constexpr auto short_loop = sum("i", 0, 8, i);
+    constexpr auto long_loop = sum("i", 0, 1000, i);
+    constexpr auto forced = sum("i", 0, 1000, i, 4);
+    using Short = NodeRef<short_loop.ast, short_loop.id>;
+    using Long = NodeRef<long_loop.ast, long_loop.id>;
+    using Forced = NodeRef<forced.ast, forced.id>;
+    static_assert(detail::unroll_factor<Short, 0>() == 8); // fully unrolled
+    static_assert(detail::unroll_factor<Long, 0>() == 1);  // left rolled
+    static_assert(detail::unroll_factor<Forced, 0>() == 4);
+}
+
+TEST(Loops, NestedAndLetScoped) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto j = Expr::var("j");
+    constexpr auto y = Expr::var("y");
+    // sum over i < 5 of (sum over i' < i of i' + y), with y = 2x
+    constexpr auto e = let_("y", x * 2.0,
+                            sum("i", 0, 5, sum("i", Expr::lit(0.0), i, i + y)));
+    constexpr auto fn = full_compile<e>();
+    // Inner i shadows outer i in the body; the bound reads the outer one
+    static_assert(fn(1.0) == 0.0 + 2.0 + 5.0 + 9.0 + 14.0);
+    constexpr auto g = sum("i", 0, 3, sum("j", 0, 3, i * j));
+    static_assert(math_compile<g>()() == 9.0);
+}
+
+TEST(Loops, DualThroughLoop) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto e = product("i", 1, 4, x + i); // (x+1)(x+2)(x+3)
+    constexpr auto fn = compile_dual<e>();
+    constexpr auto r = fn(Dual<1>::variable(0.0, 0));
+    static_assert(r.val == 6.0);
+    static_assert(r.d[0] == 11.0); // 2*3 + 1*3 + 1*2
+}
+
+// --- eval ---
+
+TEST(Loops, Eval) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto acc = Expr::var("acc");
+    constexpr auto i = Expr::var("i");
+    static_assert(eval(sum("i", 0, 64, x * i), {2.0}) == 4032.0);
+    static_assert(eval(product("i", 1, 6, i)) == 120.0);
+    static_assert(
+        eval(fold_range("acc", 0.0, "i", 0, 3, acc * x + (i + 1.0)), {2.0}) ==
+        11.0);
+}
+
+// --- differentiate / gradient ---
+
+TEST(Loops, DifferentiateSum) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto f = sum("i", 0, 10, x * x * i);
+    constexpr auto df = differentiate(f, "x");
+    static_assert(eval(df, {3.0}) == 2.0 * 3.0 * 45.0);
+    // i is bound by the loop, so f does not depend on a free i
+    constexpr auto di = differentiate(f, "i");
+    static_assert(di.ast.count == 1 && di.ast.nodes[di.id].payload == 0.0);
+}
+
+TEST(Loops, DifferentiateProduct) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto f = product("i", 1, 4, x + i);
+    constexpr auto df = differentiate(f, "x");
+    static_assert(eval(df, {0.0}) == 11.0);
+    static_assert(math_compile<df>()(1.0) == 26.0); // 3*4 + 2*4 + 2*3
+}
+
+TEST(Loops, DifferentiateFoldRange) {
+    // acc = acc * x + 1, three times from 1: x^3 + x^2 + x + 1
+    constexpr auto x = Expr::var("x");
+    constexpr auto acc = Expr::var("acc");
+    constexpr auto f = fold_range("acc", 1.0, "i", 0, 3, acc * x + 1.0);
+    constexpr auto df = differentiate(f, "x");
+    static_assert(eval(f, {2.0}) == 15.0);
+    static_assert(eval(df, {2.0}) == 3.0 * 4.0 + 2.0 * 2.0 + 1.0);
+    static_assert(math_compile<df>()(2.0) == 17.0);
+}
+
+TEST(Loops, Gradient) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto i = Expr::var("i");
+    constexpr auto f = sum("i", 0, 4, x * i * y) + product("i", 1, 3, x + i);
+    constexpr auto g = gradient(f, {"x", "y"});
+    // df/dx = 6y + (x+2) + (x+1) reads y first; df/dy = 6x reads only x
+    static_assert(eval(g[0], {2.0, 1.0}) == 12.0 + 3.0 + 2.0);
+    static_assert(eval(g[1], {1.0}) == 6.0);
+}
+
+// --- simplify / optimize ---
+
+TEST(Loops, SimplifyLiteralLoops) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    constexpr auto empty = simplify(sum("i", 3, 3, x * i));
+    static_assert(empty.ast.nodes[empty.id].payload == 0.0);
+    constexpr auto once = simplify(sum("i", 2, 3, x * i));
+    static_assert(eval(once, {5.0}) == 10.0);
+    constexpr auto constant = simplify(product("i", 0, 4, Expr::lit(2.0)));
+    static_assert(constant.ast.nodes[constant.id].payload == 16.0);
+}
+
+TEST(Loops, SimplifyKeepsIntegerLiteralKind) {
+    // An integer body folds to an integer literal, a real one stays real
+    constexpr auto ints = simplify(sum("i", 0, 4, Expr::lit(3)));
+    static_assert(is_int_lit(ints.ast.nodes[ints.id]));
+    static_assert(ints.ast.nodes[ints.id].payload == 12.0);
+    constexpr auto pow2 = simplify(product("i", 0, 4, Expr::lit(2)));
+    static_assert(is_int_lit(pow2.ast.nodes[pow2.id]));
+    static_assert(pow2.ast.nodes[pow2.id].payload == 16.0);
+    constexpr auto empty = simplify(product("i", 3, 3, Expr::lit(2)));
+    static_assert(is_int_lit(empty.ast.nodes[empty.id]));
+    static_assert(empty.ast.nodes[empty.id].payload == 1.0);
+    constexpr auto reals = simplify(sum("i", 0, 4, Expr::lit(3.0)));
+    static_assert(!is_int_lit(reals.ast.nodes[reals.id]));
+    // Compiled over int arguments, the folded loop is still an int
+    constexpr auto f = compile<ints>();
+    static_assert(std::is_same_v<decltype(f(1)), int>);
+}
+
+TEST(Loops, CseKeepsLoopVariableInside) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    // (x * i) repeats but mentions i; (x * x) repeats and is invariant
+    constexpr auto e = sum("i", 0, 8, x * i + x * i + x * x) + x * x;
+    constexpr auto r = optimize<O2>(e);
+    constexpr auto fn = math_compile<r>();
+    static_assert(fn(2.0) == math_compile<e>()(2.0));
+    static_assert(eval(r, {2.0}) == eval(e, {2.0}));
+}
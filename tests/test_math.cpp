@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
 #include <refmacro/math.hpp>
+#include <type_traits>
 
 using namespace refmacro;
 
@@ -165,6 +167,67 @@ TEST(Simplify, ConstFold) {
 TEST(Simplify, Nested) {
     static_assert(root_tag(simplify((Expr::var("x") + 0.0) * 1.0)) == "var");
 }
+TEST(Simplify, TranscendentalAtFixedPoints) {
+    static_assert(root_payload(simplify(exp(Expr::lit(0.0)))) == 1.0);
+    static_assert(root_payload(simplify(log(Expr::lit(1.0)))) == 0.0);
+    static_assert(root_payload(simplify(cos(Expr::lit(0.0)))) == 1.0);
+    static_assert(root_payload(simplify(pow(Expr::var("x"), 0.0))) == 1.0);
+}
+TEST(Simplify, LogOfExp) {
+    static_assert(root_tag(simplify(log(exp(Expr::var("x"))))) == "var");
+    static_assert(root_tag(simplify(pow(Expr::var("x"), 1.0))) == "var");
+}
+
+// --- smart constructors ---
+
+TEST(Smart, AdditiveIdentities) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto a = smart::add(x, Expr::lit(0.0));
+    static_assert(str_eq(a.ast.nodes[a.id].tag, "var"));
+    constexpr auto b = smart::sub(Expr::lit(0.0), x);
+    static_assert(str_eq(b.ast.nodes[b.id].tag, "neg"));
+    constexpr auto c = smart::add(Expr::lit(2.0), Expr::lit(3.0));
+    static_assert(c.ast.nodes[c.id].payload == 5.0);
+}
+
+TEST(Smart, MultiplicativeIdentities) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto a = smart::mul(Expr::lit(1.0), x);
+    static_assert(str_eq(a.ast.nodes[a.id].tag, "var"));
+    constexpr auto b = smart::mul(x * x, Expr::lit(0.0));
+    static_assert(str_eq(b.ast.nodes[b.id].tag, "lit"));
+    static_assert(b.ast.nodes[b.id].payload == 0.0);
+    constexpr auto c = smart::div(x, Expr::lit(1.0));
+    static_assert(str_eq(c.ast.nodes[c.id].tag, "var"));
+}
+
+TEST(Smart, NegationAndDivisionByZero) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto a = smart::neg(smart::neg(x));
+    static_assert(str_eq(a.ast.nodes[a.id].tag, "var"));
+    constexpr auto b = smart::neg(Expr::lit(2.0));
+    static_assert(b.ast.nodes[b.id].payload == -2.0);
+    constexpr auto c = smart::div(Expr::lit(1.0), Expr::lit(0.0));
+    static_assert(str_eq(c.ast.nodes[c.id].tag, "div"));
+}
+
+TEST(Smart, ResultTypeMatchesOperator) {
+    constexpr auto x = Expr::var("x");
+    static_assert(
+        std::is_same_v<decltype(smart::add(x, x)), decltype(x + x)>);
+}
+
+TEST(Smart, DifferentiateBuildsNoZeroTerms) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    // d/dx (2 * x) is the literal 2 without a simplify pass
+    constexpr auto d = differentiate(2.0 * x, "x");
+    static_assert(str_eq(d.ast.nodes[d.id].tag, "lit"));
+    static_assert(d.ast.nodes[d.id].payload == 2.0);
+    // d/dx (x * y * y) = y * y: a single product
+    constexpr auto e = differentiate(x * y * y, "x");
+    static_assert(analyze(e).nodes == 3);
+}
 
 // --- differentiate ---
 TEST(Diff, Lit) {
@@ -189,6 +252,61 @@ TEST(Diff, NegVar) {
                   -1.0);
 }
 
+// --- gradient ---
+
+TEST(Gradient, AllPartialsInOnePass) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto z = Expr::var("z");
+    constexpr auto g = gradient(x * y + y * z, {"x", "y", "z"});
+    static_assert(g.count == 3);
+    static constexpr auto dx = g[0];
+    static constexpr auto dy = g[1];
+    static constexpr auto dz = g[2];
+    static_assert(compile<dx>()(3.0) == 3.0); // y
+    static_assert(compile<dy>()(2.0, 5.0) == 7.0); // x + z
+    static_assert(compile<dz>()(4.0) == 4.0); // y
+}
+
+TEST(Gradient, MatchesDifferentiate) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = x * x * y - y / (x + 2.0) + -(x * y);
+    static constexpr auto g = gradient(f, {"x", "y"});
+    static constexpr auto gx = g[0];
+    static constexpr auto gy = g[1];
+    constexpr auto fx = compile<differentiate(f, "x")>();
+    constexpr auto fy = compile<differentiate(f, "y")>();
+    for (double xv : {-1.0, 0.5, 3.0}) {
+        for (double yv : {0.0, 2.0}) {
+            EXPECT_DOUBLE_EQ(compile<gx>()(xv, yv), fx(xv, yv));
+            EXPECT_DOUBLE_EQ(compile<gy>()(xv, yv), fy(xv, yv));
+        }
+    }
+}
+
+TEST(Gradient, ZeroTermsAreNotBuilt) {
+    constexpr auto x = Expr::var("x");
+    // d/dy (x * 3) is identically zero: a single literal
+    constexpr auto g = gradient(x * 3.0, {"x", "y"});
+    static_assert(str_eq(g.ast.nodes[g.roots[1]].tag, "lit"));
+    static_assert(g.ast.nodes[g.roots[1]].payload == 0.0);
+    // d/dx (x * 3) is the literal itself, with no 1 * 3 or 0 * x terms
+    static_assert(g.ast.nodes[g.roots[0]].payload == 3.0);
+}
+
+TEST(Gradient, PartialsShareOneAST) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = (x + y) * (x + y) * (x * y);
+    constexpr auto g = gradient(f, {"x", "y"});
+    constexpr auto dx = differentiate(f, "x");
+    constexpr auto dy = differentiate(f, "y");
+    // Both partials together are smaller than either separate derivative
+    static_assert(g.ast.count < dx.ast.count);
+    static_assert(g.ast.count < dy.ast.count);
+}
+
 // --- Full pipeline: build -> differentiate -> simplify -> compile ---
 TEST(Pipeline, Quadratic) {
     constexpr auto x = Expr::var("x");
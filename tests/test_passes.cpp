@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <refmacro/analyze.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/passes.hpp>
+#include <type_traits>
+
+using namespace refmacro;
+
+// --- Individual passes ---
+
+TEST(Passes, ConstantFolding) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * (Expr::lit(2.0) + Expr::lit(3.0));
+    constexpr auto r = PassManager<O1>::run(e);
+    static_assert(r.report.changed(Pass::fold));
+    static_assert(!r.report.changed(Pass::cse));
+    static_assert(r.expr.ast.nodes[r.expr.id].child_count == 2);
+    static_assert(r.expr.ast.nodes[r.expr.ast.nodes[r.expr.id].children[1]]
+                      .payload == 5.0);
+}
+
+TEST(Passes, AlgebraicIdentities) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = (x * 1.0 + 0.0) - 0.0;
+    constexpr auto r = PassManager<O1>::run(e);
+    static_assert(r.report.changed(Pass::simplify));
+    static_assert(str_eq(r.expr.ast.nodes[r.expr.id].tag, "var"));
+}
+
+TEST(Passes, FoldingEnablesSimplify) {
+    // (2 - 1) * x -> 1 * x -> x, needs two passes in one round
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = (Expr::lit(2.0) - Expr::lit(1.0)) * x;
+    constexpr auto r = optimize<O1>(e);
+    static_assert(str_eq(r.ast.nodes[r.id].tag, "var"));
+}
+
+TEST(Passes, DivisionByZeroIsNotFolded) {
+    constexpr auto e = Expr::lit(1.0) / Expr::lit(0.0);
+    constexpr auto r = PassManager<O1>::run(e);
+    static_assert(!r.report.any());
+}
+
+TEST(Passes, FoldingKeepsLiteralKind) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * (Expr::lit(2) + Expr::lit(3));
+    constexpr auto r = optimize<O1>(e);
+    constexpr auto c = r.ast.nodes[r.ast.nodes[r.id].children[1]];
+    static_assert(c.payload == 5.0 && is_int_lit(c));
+    static_assert(math_compile<r>()(2) == 10);
+    // Integer evaluation would truncate 7 / 2: left for the runtime
+    constexpr auto q = Expr::lit(7) / Expr::lit(2);
+    static_assert(!PassManager<O1>::run(q).report.any());
+    constexpr auto d = optimize<O1>(Expr::lit(8) / Expr::lit(2));
+    static_assert(is_int_lit(d.ast.nodes[d.id]));
+}
+
+TEST(Passes, DeadProgn) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MProgn(x * 2.0, x + 1.0);
+    constexpr auto r = PassManager<O1>::run(e);
+    static_assert(r.report.changed(Pass::dce));
+    static_assert(str_eq(r.expr.ast.nodes[r.expr.id].tag, "add"));
+}
+
+TEST(Passes, DeadCondArms) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e1 = MCond(Expr::lit(0.0), x, y);
+    static_assert(
+        str_eq(optimize<O1>(e1).ast.nodes[optimize<O1>(e1).id].name, "y"));
+    // cond(t, a, a) -> a
+    constexpr auto e2 = MCond(x < y, x + 1.0, x + 1.0);
+    constexpr auto r2 = PassManager<O1>::run(e2);
+    static_assert(r2.report.changed(Pass::dead_cond));
+    static_assert(str_eq(r2.expr.ast.nodes[r2.expr.id].tag, "add"));
+}
+
+// --- Purity ---
+
+constexpr auto Log = defmacro<"log">(
+    [](auto x) { return [=](auto... a) constexpr { return x(a...); }; });
+
+TEST(Passes, ImpureNodesAreKept) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MProgn(Log(x), x) + Log(x) * 0.0;
+    constexpr auto r = PassManager<O2>::run(e);
+    static_assert(!r.report.changed(Pass::dce));
+    static_assert(!r.report.changed(Pass::cse));
+    static_assert(analyze(r.expr).ops_of("log") == 2);
+}
+
+// --- CSE ---
+
+TEST(Passes, CseBindsRepeatedSubtree) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto s = x * y + 1.0;
+    constexpr auto e = s * s - s;
+    constexpr auto r = PassManager<O2>::run(e);
+    static_assert(r.report.changed(Pass::cse));
+    static_assert(str_eq(r.expr.ast.nodes[r.expr.id].tag, "apply"));
+    // s is computed once
+    static_assert(analyze(r.expr).ops_of("mul") == 2);
+    constexpr auto fn = full_compile<r.expr>();
+    constexpr auto ref = full_compile<e>();
+    static_assert(fn(2.0, 3.0) == ref(2.0, 3.0));
+    EXPECT_DOUBLE_EQ(fn(-1.5, 4.0), ref(-1.5, 4.0));
+}
+
+TEST(Passes, CseNested) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto s = x + y;
+    constexpr auto p = s * s;
+    constexpr auto e = p + p;
+    constexpr auto r = optimize<O2>(e);
+    // p bound first, then s inside its value
+    static_assert(analyze(r).ops_of("add") == 2);
+    static_assert(analyze(r).ops_of("mul") == 1);
+    constexpr auto fn = full_compile<r>();
+    static_assert(fn(1.0, 2.0) == 18.0);
+}
+
+TEST(Passes, CseRespectsLetScope) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto t = Expr::var("t");
+    // t * t under the let must not be hoisted above it
+    constexpr auto e = let_("t", x + 1.0, t * t + t * t);
+    constexpr auto r = PassManager<O2>::run(e);
+    static_assert(!r.report.changed(Pass::cse));
+    constexpr auto fn = full_compile<r.expr>();
+    static_assert(fn(2.0) == 18.0);
+}
+
+TEST(Passes, O1DoesNotCse) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = (x * x) + (x * x);
+    static_assert(!PassManager<O1>::run(e).report.any());
+}
+
+// --- Pipeline ---
+
+TEST(Passes, O0IsIdentity) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * 1.0;
+    constexpr auto r = PassManager<O0>::run(e);
+    static_assert(!r.report.any());
+    static_assert(r.expr.id == e.id);
+}
+
+TEST(Passes, FixedPoint) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto r = PassManager<O2>::run(x + 1.0);
+    static_assert(!r.report.any());
+    static_assert(r.report.rounds == 1);
+}
+
+TEST(Passes, DerivativeCleanup) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto f = x * x * x;
+    constexpr auto df = optimize<O2>(differentiate(f, "x"));
+    constexpr auto fn = math_compile<df>();
+    static_assert(fn(2.0) == 12.0);
+    // differentiate already drops 0 and 1 factors; optimize never grows it
+    static_assert(analyze(df).nodes <= analyze(differentiate(f, "x")).nodes);
+    // The textbook product-rule tree shrinks
+    constexpr auto raw = (x * x) * 1.0 + (x * 1.0 + 1.0 * x) * x;
+    static_assert(analyze(optimize<O2>(raw)).nodes < analyze(raw).nodes);
+}
+
+TEST(Passes, PreservesMacros) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = MCond(x > Expr::lit(0.0), x * 1.0, -x);
+    constexpr auto r = optimize<O2>(e);
+    static_assert(std::is_same_v<decltype(r), decltype(e)>);
+    constexpr auto fn = compile<r>();
+    static_assert(fn(-2.0) == 2.0);
+    static_assert(fn(3.0) == 3.0);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/staged.hpp>
+
+using namespace refmacro;
+
+// --- Stage plan ---
+
+TEST(StagePlan, HoistsMaximalUniformSubtrees) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto x = Expr::var("x");
+    // (a * b) * x + (a + b): hoists a*b and a+b, keeps x per row
+    constexpr auto e = a * b * x + (a + b);
+    constexpr auto plan = detail::make_stage_plan<MAdd, MMul>(
+        e.ast, e.id, detail::uniform_var_map<"a", "b">());
+    static_assert(plan.hoisted_count == 2);
+    static_assert(str_eq(e.ast.nodes[plan.hoisted[0]].tag, "mul"));
+    static_assert(str_eq(e.ast.nodes[plan.hoisted[1]].tag, "add"));
+    static_assert(plan.vars.count == 3);
+    static_assert(plan.vars.index_of("x") == 0);
+    static_assert(plan.vars.index_of("%0") == 1);
+    static_assert(plan.vars.index_of("%1") == 2);
+}
+
+TEST(StagePlan, LiteralsStayInResidual) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * 2.0;
+    constexpr auto plan = detail::make_stage_plan<MMul>(
+        e.ast, e.id, detail::uniform_var_map<"a">());
+    static_assert(plan.hoisted_count == 0);
+}
+
+TEST(StagePlan, ConstantSubtreeIsHoisted) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x + Expr::lit(2.0) * Expr::lit(3.0);
+    constexpr auto plan = detail::make_stage_plan<MAdd, MMul>(
+        e.ast, e.id, detail::uniform_var_map<>());
+    static_assert(plan.hoisted_count == 1);
+}
+
+TEST(StagePlan, ShadowedUniformIsNotHoisted) {
+    // let a = x in a * a: the inner a is the let binding, not the uniform
+    constexpr auto a = Expr::var("a");
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = let_("a", x, a * a);
+    constexpr auto plan = detail::make_stage_plan<MMul>(
+        e.ast, e.id, detail::uniform_var_map<"a">());
+    static_assert(plan.hoisted_count == 0);
+}
+
+TEST(StagePlan, ImpureSubtreeIsNotHoisted) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto x = Expr::var("x");
+    // a * a and the divisor a are hoisted; the division may trap, so it
+    // stays in the arm
+    constexpr auto e = MCond(x > 0.0, a * a / a, x);
+    constexpr auto plan = detail::make_stage_plan<MCond, MGt, MMul, MDiv>(
+        e.ast, e.id, detail::uniform_var_map<"a">());
+    static_assert(plan.hoisted_count == 2);
+    static_assert(str_eq(e.ast.nodes[plan.hoisted[0]].tag, "mul"));
+    static_assert(str_eq(e.ast.nodes[plan.hoisted[1]].tag, "var"));
+    constexpr auto row = compile_staged<e, "a">()(2.0);
+    static_assert(row(3.0) == 2.0);
+    static_assert(row(-3.0) == -3.0);
+}
+
+// --- compile_staged ---
+
+TEST(CompileStaged, Polynomial) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = a * b * x + (a + b);
+    constexpr auto stage = compile_staged<e, "a", "b">();
+    constexpr auto row = stage(2.0, 3.0);
+    static_assert(row(1.0) == 11.0);
+    static_assert(row(2.0) == 17.0);
+    EXPECT_DOUBLE_EQ(row(-1.0), -1.0);
+}
+
+TEST(CompileStaged, MatchesCompile) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto c = Expr::var("c");
+    constexpr auto e = (c * c - 1.0) * x + y / (c + 2.0);
+    constexpr auto full = compile<e>();
+    constexpr auto row = compile_staged<e, "c">()(3.0);
+    // full takes (c, x, y) in DFS order; row takes (x, y)
+    for (double xv : {-2.0, 0.0, 1.5})
+        for (double yv : {0.0, 5.0})
+            EXPECT_DOUBLE_EQ(row(xv, yv), full(3.0, xv, yv));
+}
+
+TEST(CompileStaged, UniformOrderFollowsDeclaration) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto b = Expr::var("b");
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = (a - b) * x;
+    constexpr auto stage = compile_staged<e, "b", "a">();
+    static_assert(stage(1.0, 4.0)(2.0) == 6.0); // (4 - 1) * 2
+}
+
+TEST(CompileStaged, AllUniform) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto e = a * a + 1.0;
+    constexpr auto stage = compile_staged<e, "a">();
+    static_assert(stage(3.0)() == 10.0);
+}
+
+TEST(CompileStaged, NoUniforms) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = x * x;
+    constexpr auto stage = compile_staged<e>();
+    static_assert(stage()(4.0) == 16.0);
+}
+
+TEST(CompileStaged, WithControlFlowAndLet) {
+    constexpr auto t = Expr::var("t");
+    constexpr auto x = Expr::var("x");
+    constexpr auto s = Expr::var("s");
+    // let s = t * 2 in cond(x > s, x - s, 0)
+    constexpr auto e =
+        let_("s", t * 2.0, MCond(x > s, x - s, Expr::lit(0.0)));
+    constexpr auto row = compile_staged<e, "t">()(1.5);
+    static_assert(row(5.0) == 2.0);
+    static_assert(row(1.0) == 0.0);
+}
+
+TEST(CompileStaged, LoopBodyInvariantHoisted) {
+    constexpr auto a = Expr::var("a");
+    constexpr auto x = Expr::var("x");
+    constexpr auto i = Expr::var("i");
+    // a * a and the a of a * i are hoisted; i stays in the loop
+    constexpr auto e = sum("i", 0, 4, a * a * x + a * i);
+    constexpr auto plan = detail::make_stage_plan<MSum, MAdd, MMul>(
+        e.ast, e.id, detail::uniform_var_map<"a">());
+    static_assert(plan.hoisted_count == 2);
+    constexpr auto row = compile_staged<e, "a">()(2.0);
+    static_assert(row(1.0) == 16.0 + 12.0);
+}
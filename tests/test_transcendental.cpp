@@ -0,0 +1,146 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include <refmacro/adjoint.hpp>
+#include <refmacro/analyze.hpp>
+#include <refmacro/dual.hpp>
+#include <refmacro/math.hpp>
+
+using namespace refmacro;
+
+namespace {
+
+double rel_err(double got, double want) {
+    return std::abs(got - want) / (std::abs(want) > 1.0 ? std::abs(want) : 1.0);
+}
+
+} // namespace
+
+// --- Precise lowerings ---
+
+TEST(Transcendental, PreciseMatchesLibm) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto e = exp(x) + log(y) * sqrt(y) - sin(x) * cos(x) + tanh(x);
+    constexpr auto fn = compile<e>();
+    double xv = 0.7, yv = 2.5;
+    EXPECT_DOUBLE_EQ(fn(xv, yv), std::exp(xv) + std::log(yv) * std::sqrt(yv) -
+                                     std::sin(xv) * std::cos(xv) +
+                                     std::tanh(xv));
+    constexpr auto p = compile<pow(x, y)>();
+    EXPECT_DOUBLE_EQ(p(2.0, 0.5), std::sqrt(2.0));
+    constexpr auto q = compile<pow(x, 3.0)>();
+    EXPECT_DOUBLE_EQ(q(2.0), 8.0);
+}
+
+// --- Fast lowerings ---
+
+TEST(Transcendental, FastApproximationsAreConstexpr) {
+    static_assert(detail::fast_exp(0.0) == 1.0);
+    static_assert(detail::fast_log(1.0) == 0.0);
+    static_assert(detail::fast_sin(0.0) == 0.0);
+    static_assert(detail::fast_cos(0.0) == 1.0);
+    static_assert(detail::fast_tanh(0.0) == 0.0);
+    static_assert(detail::fast_pow(2.0, 0.0) == 1.0);
+}
+
+TEST(Transcendental, FastExpAndLog) {
+    for (double x = -700.0; x <= 700.0; x += 0.37)
+        EXPECT_LT(std::abs(detail::fast_exp(x) / std::exp(x) - 1.0), 4e-16)
+            << x;
+    for (double x = 1e-300; x < 1e300; x *= 7.3)
+        EXPECT_LT(rel_err(detail::fast_log(x), std::log(x)), 1e-14) << x;
+    EXPECT_EQ(detail::fast_exp(800.0), HUGE_VAL);
+    EXPECT_EQ(detail::fast_exp(-800.0), 0.0);
+    EXPECT_EQ(detail::fast_log(0.0), -HUGE_VAL);
+    EXPECT_TRUE(std::isnan(detail::fast_log(-1.0)));
+}
+
+TEST(Transcendental, FastTrigAndTanh) {
+    for (double x = -1000.0; x <= 1000.0; x += 0.173) {
+        EXPECT_LT(std::abs(detail::fast_sin(x) - std::sin(x)), 1e-14) << x;
+        EXPECT_LT(std::abs(detail::fast_cos(x) - std::cos(x)), 1e-14) << x;
+    }
+    // Relative to tanh x itself, so small results are held to it too
+    for (double x = -20.005; x <= 20.0; x += 0.01)
+        EXPECT_LT(std::abs(detail::fast_tanh(x) / std::tanh(x) - 1.0), 1e-15)
+            << x;
+    for (double x = 1e-300; x < 0.1; x *= 7.3)
+        EXPECT_LT(std::abs(detail::fast_tanh(x) / std::tanh(x) - 1.0), 1e-15)
+            << x;
+    EXPECT_TRUE(std::signbit(detail::fast_tanh(-0.0)));
+    EXPECT_EQ(detail::fast_tanh(HUGE_VAL), 1.0);
+    EXPECT_TRUE(std::isnan(detail::fast_sin(HUGE_VAL)));
+}
+
+TEST(Transcendental, FastBackendSelectsApproximations) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto e = tanh(x * 2.0) + exp(-x) * sin(x);
+    constexpr auto fast = compile<e, backend::fast>();
+    constexpr auto precise = compile<e>();
+    // The fast lowerings are constexpr; libm is not required to be
+    static_assert(fast(0.0) == 0.0);
+    for (double xv : {-3.0, -0.5, 0.01, 1.0, 4.0})
+        EXPECT_NEAR(fast(xv), precise(xv), 1e-13);
+}
+
+// --- Derivatives ---
+
+TEST(Transcendental, DifferentiateChainRule) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto f = sin(x) * exp(x * 2.0) + log(x) - sqrt(x) + tanh(x);
+    constexpr auto df = compile<differentiate(f, "x")>();
+    for (double xv : {0.3, 1.0, 2.5}) {
+        double want = std::cos(xv) * std::exp(2 * xv) +
+                      2 * std::sin(xv) * std::exp(2 * xv) + 1 / xv -
+                      0.5 / std::sqrt(xv) +
+                      (1 - std::tanh(xv) * std::tanh(xv));
+        EXPECT_NEAR(df(xv), want, 1e-12 * std::abs(want));
+    }
+}
+
+TEST(Transcendental, DifferentiatePow) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto cube = compile<differentiate(pow(x, 3.0), "x")>();
+    EXPECT_DOUBLE_EQ(cube(2.0), 12.0);
+    // d/dy x^y = x^y log x
+    constexpr auto dy = compile<differentiate(pow(x, y), "y")>();
+    EXPECT_DOUBLE_EQ(dy(2.0, 3.0), 8.0 * std::log(2.0));
+    // cos' introduces sin, which compiles although f never used it
+    constexpr auto dcos = compile<differentiate(cos(x), "x")>();
+    EXPECT_DOUBLE_EQ(dcos(1.0), -std::sin(1.0));
+}
+
+TEST(Transcendental, GradientSharesPrimal) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    static constexpr auto g = gradient(exp(x * y), {"x", "y"});
+    static constexpr auto gx = g[0];
+    static constexpr auto gy = g[1];
+    EXPECT_DOUBLE_EQ(compile<gx>()(1.0, 2.0), 2.0 * std::exp(2.0));
+    EXPECT_DOUBLE_EQ(compile<gy>()(1.0, 2.0), std::exp(2.0));
+    // exp(x * y) appears once, shared by both partials
+    static_assert(analyze(Expression<64>(g.ast, g.roots[0])).ops_of("exp") ==
+                  1);
+}
+
+TEST(Transcendental, ForwardAndReverseMode) {
+    constexpr auto x = Expr::var("x");
+    constexpr auto y = Expr::var("y");
+    constexpr auto f = pow(x, y) + sin(x) * log(y);
+    auto r = compile_dual<f, 2>()(Dual<2>::variable(1.5, 0),
+                                  Dual<2>::variable(2.0, 1));
+    auto g = compile_gradient<f>()(1.5, 2.0);
+    double dx = 2.0 * 1.5 + std::cos(1.5) * std::log(2.0);
+    double dy = 2.25 * std::log(1.5) + std::sin(1.5) / 2.0;
+    EXPECT_NEAR(r.d[0], dx, 1e-14);
+    EXPECT_NEAR(r.d[1], dy, 1e-14);
+    EXPECT_NEAR(g.grad[0], dx, 1e-14);
+    EXPECT_NEAR(g.grad[1], dy, 1e-14);
+    EXPECT_DOUBLE_EQ(g.value, r.val);
+}
+
+TEST(Transcendental, CostModel) {
+    constexpr auto x = Expr::var("x");
+    static_assert(analyze(exp(x) + x).flops == 21);
+}
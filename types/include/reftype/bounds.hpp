@@ -0,0 +1,342 @@
+#ifndef REFTYPE_BOUNDS_HPP
+#define REFTYPE_BOUNDS_HPP
+
+#include <refmacro/array.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/transforms.hpp>
+#include <reftype/check.hpp>
+#include <reftype/fm/solver.hpp>
+#include <reftype/type_env.hpp>
+
+namespace reftype {
+
+using refmacro::AST;
+using refmacro::Expression;
+using refmacro::str_eq;
+
+// --- elide_bounds_checks: drop the checks the solver proves redundant ---
+//
+// Every checked index(w, i) whose bounds follow from what is known about i
+// becomes an unchecked index_proven read. Known facts are
+//   - the refinement of each Int variable in env: x : {#v : Int | p}
+//     contributes p with #v replaced by x,
+//   - lo <= i < hi for the variable of an enclosing sum, product or
+//     fold_range over [lo, hi),
+//   - x == v for let(x, v) with v an integer expression,
+// and an access is proven when the FM solver shows they imply
+// 0 <= i && i < N. The solver rounds to integers, so only integer
+// expressions take part: sums, differences and integer multiples of Int
+// variables, loop variables and integer literals. Any other index stays
+// checked, as does a fact that mentions a variable not known to be an
+// integer.
+
+namespace detail {
+
+using refmacro::VarMap;
+
+// Facts are copied out of the expression into ASTs of this capacity, so the
+// solver works on short formulas however large the expression is. Bounds
+// and indices of up to max_operand nodes take part.
+inline constexpr std::size_t fact_cap = 64;
+inline constexpr int max_operand = 16;
+using Fact = Expression<fact_cap>;
+
+struct BoundsFacts {
+    static constexpr std::size_t MaxFacts = 8;
+    Fact facts[MaxFacts]{};
+    std::size_t count{0};
+    VarMap<16> ints{}; // variables known to hold integers
+};
+
+template <std::size_t Cap>
+consteval int subtree_size(const AST<Cap>& ast, int id) {
+    int size = 1;
+    for (int c = 0; c < ast.nodes[id].child_count; ++c)
+        size += subtree_size(ast, ast.nodes[id].children[c]);
+    return size;
+}
+
+// The cast nodes typed lowering inserts (see lower_kinds) only change how
+// a value is represented, so facts and indices are read through them.
+template <std::size_t Cap>
+consteval int skip_casts(const AST<Cap>& ast, int id) {
+    while (str_eq(ast.nodes[id].tag, "cast"))
+        id = ast.nodes[id].children[0];
+    return id;
+}
+
+template <std::size_t Cap>
+consteval int copy_fact(AST<fact_cap>& dst, const AST<Cap>& src, int id) {
+    refmacro::ASTNode n = src.nodes[skip_casts(src, id)];
+    for (int c = 0; c < n.child_count; ++c)
+        n.children[c] = copy_fact(dst, src, n.children[c]);
+    return dst.add_node(n);
+}
+
+template <std::size_t Cap>
+consteval Fact to_fact(const AST<Cap>& ast, int id) {
+    Fact f;
+    f.id = copy_fact(f.ast, ast, id);
+    return f;
+}
+
+// Whether the subtree at id is an integer-valued linear expression over the
+// integer variables in ints.
+template <std::size_t Cap>
+consteval bool is_int_linear(const AST<Cap>& ast, int id,
+                             const VarMap<16>& ints) {
+    const auto& n = ast.nodes[skip_casts(ast, id)];
+    auto integral = [](double v) {
+        return v == static_cast<double>(static_cast<long long>(v));
+    };
+    if (str_eq(n.tag, "lit"))
+        return n.payload >= -(1LL << 52) && n.payload <= (1LL << 52) &&
+               integral(n.payload);
+    if (str_eq(n.tag, "var"))
+        return ints.contains(n.name);
+    if ((str_eq(n.tag, "add") || str_eq(n.tag, "sub")) && n.child_count == 2)
+        return is_int_linear(ast, n.children[0], ints) &&
+               is_int_linear(ast, n.children[1], ints);
+    if (str_eq(n.tag, "neg") && n.child_count == 1)
+        return is_int_linear(ast, n.children[0], ints);
+    if (str_eq(n.tag, "mul") && n.child_count == 2 &&
+        (str_eq(ast.nodes[skip_casts(ast, n.children[0])].tag, "lit") ||
+         str_eq(ast.nodes[skip_casts(ast, n.children[1])].tag, "lit")))
+        return is_int_linear(ast, n.children[0], ints) &&
+               is_int_linear(ast, n.children[1], ints);
+    return false;
+}
+
+// Whether the subtree at id is a formula over integer-linear comparisons.
+template <std::size_t Cap>
+consteval bool is_int_formula(const AST<Cap>& ast, int id,
+                              const VarMap<16>& ints) {
+    const auto& n = ast.nodes[id];
+    if ((str_eq(n.tag, "land") || str_eq(n.tag, "lor")) && n.child_count == 2)
+        return is_int_formula(ast, n.children[0], ints) &&
+               is_int_formula(ast, n.children[1], ints);
+    if (str_eq(n.tag, "lnot") && n.child_count == 1)
+        return is_int_formula(ast, n.children[0], ints);
+    if ((str_eq(n.tag, "eq") || str_eq(n.tag, "lt") || str_eq(n.tag, "gt") ||
+         str_eq(n.tag, "le") || str_eq(n.tag, "ge")) &&
+        n.child_count == 2)
+        return is_int_linear(ast, n.children[0], ints) &&
+               is_int_linear(ast, n.children[1], ints);
+    return false;
+}
+
+consteval void add_fact(BoundsFacts& k, const Fact& fact) {
+    if (k.count < BoundsFacts::MaxFacts &&
+        is_int_formula(fact.ast, fact.id, k.ints))
+        k.facts[k.count++] = fact;
+}
+
+// Rebinding name invalidates every fact that mentions it.
+consteval void forget(BoundsFacts& k, const char* name) {
+    std::size_t kept = 0;
+    for (std::size_t f = 0; f < k.count; ++f)
+        if (!refmacro::detail::occurs_free(k.facts[f].ast, k.facts[f].id,
+                                           name))
+            k.facts[kept++] = k.facts[f];
+    k.count = kept;
+    VarMap<16> ints{};
+    for (std::size_t v = 0; v < k.ints.count; ++v)
+        if (!str_eq(k.ints.names[v], name))
+            ints.add(k.ints.names[v]);
+    k.ints = ints;
+}
+
+// Whether the subtree at id is an integer expression the solver can bound.
+template <std::size_t Cap>
+consteval bool is_boundable(const BoundsFacts& k, const AST<Cap>& ast,
+                            int id) {
+    return subtree_size(ast, id) <= max_operand &&
+           is_int_linear(ast, id, k.ints);
+}
+
+// An integer operand of a binder's fact: read in the enclosing scope, so it
+// must not mention the name being bound.
+template <std::size_t Cap>
+consteval bool usable_bound(const BoundsFacts& k, const AST<Cap>& ast, int id,
+                            const char* name) {
+    return is_boundable(k, ast, id) &&
+           !refmacro::detail::occurs_free(ast, id, name);
+}
+
+// i runs over the integers from lo (truncated) up to, not including, hi.
+template <std::size_t Cap>
+consteval void bind_loop_var(BoundsFacts& k, const AST<Cap>& ast, int param,
+                             int lo, int hi) {
+    const char* name = ast.nodes[param].name;
+    bool has_lo = usable_bound(k, ast, lo, name);
+    bool has_hi = usable_bound(k, ast, hi, name);
+    forget(k, name);
+    k.ints.add(name);
+    auto i = Fact::var(name);
+    if (has_lo)
+        add_fact(k, Fact{to_fact(ast, lo) <= i});
+    if (has_hi)
+        add_fact(k, Fact{i < to_fact(ast, hi)});
+}
+
+// Whether the known facts imply goal.
+consteval bool implied(const BoundsFacts& k, const Fact& goal) {
+    // Innermost facts first; any that no longer fit are left out, which
+    // only weakens the premise.
+    Fact premise{};
+    for (std::size_t f = k.count; f > 0; --f) {
+        const Fact& fact = k.facts[f - 1];
+        if (premise.id < 0)
+            premise = fact;
+        else if (premise.ast.count + fact.ast.count < fact_cap)
+            premise = premise && fact;
+    }
+    if (premise.id < 0)
+        return fm::is_valid(goal);
+    return fm::is_valid_implication(premise, goal);
+}
+
+// Whether the Int subtree at id is nonzero for every value the facts allow.
+template <std::size_t Cap>
+consteval bool proven_nonzero(const BoundsFacts& k, const AST<Cap>& ast,
+                              int id) {
+    if (!is_boundable(k, ast, id))
+        return false;
+    Fact v = to_fact(ast, id);
+    return implied(k, (v > Fact::lit(0.0)) || (v < Fact::lit(0.0)));
+}
+
+template <std::size_t Cap>
+consteval bool index_in_bounds(const BoundsFacts& k, const AST<Cap>& ast,
+                               int index_id) {
+    const auto& n = ast.nodes[index_id];
+    int at = n.children[1];
+    if (!is_boundable(k, ast, at))
+        return false;
+    auto i = to_fact(ast, at);
+    auto extent = Fact::lit(ast.nodes[n.children[0]].payload);
+    return implied(k, (Fact::lit(0.0) <= i) && (i < extent));
+}
+
+// Visits every path to each index node: a node reached under several
+// contexts (after cse) is proven only if it is proven under all of them.
+template <std::size_t Cap>
+consteval void prove_walk(const AST<Cap>& ast, int id, const BoundsFacts& k,
+                          bool (&seen)[Cap], bool (&unproven)[Cap]) {
+    const auto& n = ast.nodes[id];
+    auto walk = [&](int child, const BoundsFacts& facts) consteval {
+        prove_walk(ast, child, facts, seen, unproven);
+    };
+    auto binder_param = [&](int lambda) consteval {
+        return ast.nodes[lambda].children[0];
+    };
+    auto binder_body = [&](int lambda) consteval {
+        return ast.nodes[lambda].children[1];
+    };
+
+    // sum / product(lo, hi, lambda(i, body))
+    if ((str_eq(n.tag, "sum") || str_eq(n.tag, "product")) &&
+        n.child_count == 3) {
+        walk(n.children[0], k);
+        walk(n.children[1], k);
+        int fn = n.children[2];
+        BoundsFacts inner = k;
+        bind_loop_var(inner, ast, binder_param(fn), n.children[0],
+                      n.children[1]);
+        walk(binder_body(fn), inner);
+        return;
+    }
+    // fold_range(init, lo, hi, lambda(acc, lambda(i, body)))
+    if (str_eq(n.tag, "fold_range") && n.child_count == 4) {
+        for (int c = 0; c < 3; ++c)
+            walk(n.children[c], k);
+        int outer = n.children[3];
+        int fn = binder_body(outer);
+        BoundsFacts inner = k;
+        forget(inner, ast.nodes[binder_param(outer)].name);
+        bind_loop_var(inner, ast, binder_param(fn), n.children[1],
+                      n.children[2]);
+        walk(binder_body(fn), inner);
+        return;
+    }
+    // apply(lambda(x, body), v): x == v inside body
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+        int fn = n.children[0];
+        walk(n.children[1], k);
+        const char* name = ast.nodes[binder_param(fn)].name;
+        BoundsFacts inner = k;
+        forget(inner, name);
+        if (usable_bound(k, ast, n.children[1], name)) {
+            inner.ints.add(name);
+            add_fact(inner,
+                     Fact{Fact::var(name) == to_fact(ast, n.children[1])});
+        }
+        walk(binder_body(fn), inner);
+        return;
+    }
+    if (str_eq(n.tag, "lambda") && n.child_count == 2) {
+        BoundsFacts inner = k;
+        forget(inner, ast.nodes[n.children[0]].name);
+        walk(n.children[1], inner);
+        return;
+    }
+    for (int c = 0; c < n.child_count; ++c)
+        walk(n.children[c], k);
+    if (str_eq(n.tag, "index") && n.child_count == 2) {
+        seen[id] = true;
+        if (!index_in_bounds(k, ast, id))
+            unproven[id] = true;
+    }
+}
+
+// The facts env states about its Int variables; later bindings shadow
+// earlier ones.
+template <std::size_t Cap>
+consteval BoundsFacts env_facts(const TypeEnv<Cap>& env) {
+    BoundsFacts k{};
+    VarMap<16> names{};
+    for (std::size_t b = env.count; b > 0; --b)
+        names.add(env.names[b - 1]);
+    for (std::size_t v = 0; v < names.count; ++v)
+        if (get_base_kind(env.lookup(names.names[v])) == BaseKind::Int)
+            k.ints.add(names.names[v]);
+    for (std::size_t v = 0; v < names.count; ++v) {
+        auto type = env.lookup(names.names[v]);
+        if (get_base_kind(type) != BaseKind::Int || !is_refined(type))
+            continue;
+        auto pred = get_refined_pred(type);
+        if (subtree_size(pred.ast, pred.id) > static_cast<int>(fact_cap) / 2)
+            continue;
+        auto fact = to_fact(pred.ast, pred.id);
+        for (std::size_t id = 0; id < fact.ast.count; ++id)
+            if (str_eq(fact.ast.nodes[id].tag, "var") &&
+                str_eq(fact.ast.nodes[id].name, "#v"))
+                refmacro::copy_str(fact.ast.nodes[id].name, names.names[v]);
+        add_fact(k, fact);
+    }
+    return k;
+}
+
+} // namespace detail
+
+template <std::size_t Cap, auto... Ms>
+consteval auto elide_bounds_checks(Expression<Cap, Ms...> e,
+                                   const TypeEnv<Cap>& env = {}) {
+    typename refmacro::detail::with_macros<Expression<Cap, Ms...>,
+                                           refmacro::MIndexProven>::type
+        result = e;
+    bool seen[Cap]{};
+    bool unproven[Cap]{};
+    detail::prove_walk(e.ast, e.id, detail::env_facts(env), seen, unproven);
+    for (std::size_t id = 0; id < Cap; ++id)
+        if (seen[id] && !unproven[id])
+            refmacro::copy_str(result.ast.nodes[id].tag, "index_proven");
+    return result;
+}
+
+} // namespace reftype
+
+#endif // REFTYPE_BOUNDS_HPP
@@ -176,7 +176,7 @@ consteval TypeResult<Cap> dispatch_typerule(const Expression<Cap>& expr,
 
 } // namespace detail
 
-// --- Built-in type rules (18 total) ---
+// --- Built-in type rules (19 total) ---
 
 // Annotation (special: inspects child tag for lambda handling)
 inline constexpr auto TRAnn =
@@ -349,6 +349,22 @@ inline constexpr auto TRProgn = def_typerule(
         return decltype(first){second.type, first.valid && second.valid};
     });
 
+// Array read: index(avar, i) with an Int index reads a Real. The array
+// operand is not a value and has no type of its own.
+inline constexpr auto TRIndex = def_typerule(
+    "index", [](const auto& expr, const auto& env, auto synth_rec) {
+        using E = std::remove_cvref_t<decltype(expr)>;
+        constexpr auto Cap = sizeof(expr.ast.nodes) / sizeof(expr.ast.nodes[0]);
+        const auto& node = expr.ast.nodes[expr.id];
+        if (!str_eq(expr.ast.nodes[node.children[0]].tag, "avar"))
+            report_error("indexing a non-array", "index");
+        auto i = synth_rec(E{expr.ast, node.children[1]}, env);
+        if (get_base_kind(i.type) != BaseKind::Int)
+            report_error("non-integer array index", "Int",
+                         kind_name(get_base_kind(i.type)), "index");
+        return decltype(i){treal<Cap>(), i.valid};
+    });
+
 // --- Type synthesis with rule dispatch ---
 
 template <auto... Rules, std::size_t Cap>
@@ -393,7 +409,7 @@ consteval TypeResult<Cap> type_check(const Expression<Cap, Ms...>& e) {
     Expression<Cap> plain = e; // strip macros
     return synth<TRAnn, TRAdd, TRSub, TRMul, TRDiv, TRNeg, TREq, TRLt, TRGt,
                  TRLe, TRGe, TRLand, TRLor, TRLnot, TRCond, TRApply, TRLambda,
-                 TRProgn, ExtraRules...>(plain, TypeEnv<Cap>{});
+                 TRProgn, TRIndex, ExtraRules...>(plain, TypeEnv<Cap>{});
 }
 
 template <auto... ExtraRules, std::size_t Cap = 128, auto... Ms>
@@ -402,7 +418,7 @@ consteval TypeResult<Cap> type_check(const Expression<Cap, Ms...>& e,
     Expression<Cap> plain = e; // strip macros
     return synth<TRAnn, TRAdd, TRSub, TRMul, TRDiv, TRNeg, TREq, TRLt, TRGt,
                  TRLe, TRGe, TRLand, TRLor, TRLnot, TRCond, TRApply, TRLambda,
-                 TRProgn, ExtraRules...>(plain, env);
+                 TRProgn, TRIndex, ExtraRules...>(plain, env);
 }
 
 } // namespace reftype
@@ -0,0 +1,358 @@
+#ifndef REFTYPE_GRADUAL_HPP
+#define REFTYPE_GRADUAL_HPP
+
+#include <cstddef>
+#include <refmacro/array.hpp>
+#include <refmacro/compile.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/transforms.hpp>
+#include <reftype/bounds.hpp>
+#include <reftype/check.hpp>
+#include <reftype/lower.hpp>
+#include <reftype/strip.hpp>
+#include <reftype/subtype.hpp>
+#include <reftype/type_env.hpp>
+#include <reftype/types.hpp>
+#include <stdexcept>
+
+namespace reftype {
+
+using refmacro::AST;
+using refmacro::Expression;
+using refmacro::str_eq;
+
+// --- Gradual refinement checking ---
+//
+// type_check rejects an expression unless the FM solver proves every
+// annotation's refinement. In gradual mode an annotation whose value has
+// the right base type but whose refinement is not proven (the predicate is
+// nonlinear, past the solver's DNF limit, or simply not implied by what
+// the checker synthesizes) is a residual obligation instead of an error:
+//
+//   ann(x * x, {#v : Int | #v >= 0})     residual: x * x is not linear
+//   ann(x, {#v : Int | #v >= 0})         proven when x : {#v | #v > 0}
+//
+// gradual_compile compiles each residual obligation into a check of the
+// predicate on the annotated value, at the annotation, that throws
+// std::domain_error when it fails; proven annotations compile to no code.
+// For an annotated lambda the check is on the body's result. An argument
+// not proven to satisfy the refined parameter type of the function it is
+// applied to is checked the same way, at the application, against the
+// parameter type synthesized for the callee (an annotated lambda or a
+// function-typed variable):
+//
+//   apply(ann(lambda(y, ...), tarr(y, {#v : Int | #v > 0}, ...)), x * x)
+//
+// Base type errors are still compile errors, and annotated expressions are
+// assumed to satisfy their refinements from then on, as in type_check.
+
+// guard(p): throws unless p holds.
+inline constexpr auto MGuard = refmacro::defmacro<"guard">([](auto test) {
+    return [=](auto... a) constexpr {
+        if (!test(a...))
+            throw std::domain_error("guard: refinement does not hold");
+        return true;
+    };
+});
+
+namespace detail {
+
+// sub <: super, or sub <: super's base when super is refined: the
+// refinement is left to a residual check.
+template <std::size_t Cap>
+consteval bool holds_gradually(const Expression<Cap>& sub,
+                               const Expression<Cap>& super) {
+    return is_subtype(sub, super) ||
+           (is_refined(super) && is_subtype(sub, get_refined_base(super)));
+}
+
+} // namespace detail
+
+// Annotation, accepting what holds_gradually accepts.
+inline constexpr auto TRAnnGradual =
+    def_typerule("ann", [](const auto& expr, const auto& env, auto synth_rec) {
+        const auto& node = expr.ast.nodes[expr.id];
+        using E = std::remove_cvref_t<decltype(expr)>;
+        E child_expr{expr.ast, node.children[0]};
+        E declared_type{expr.ast, node.children[1]};
+
+        if (str_eq(expr.ast.nodes[node.children[0]].tag, "lambda") &&
+            is_arrow(declared_type)) {
+            const auto& lambda_node = expr.ast.nodes[node.children[0]];
+            auto param_name = expr.ast.nodes[lambda_node.children[0]].name;
+            E body{expr.ast, lambda_node.children[1]};
+            auto extended_env =
+                env.bind(param_name, get_arrow_input(declared_type));
+            auto body_result = synth_rec(body, extended_env);
+            bool valid = body_result.valid &&
+                         detail::holds_gradually(
+                             body_result.type, get_arrow_output(declared_type));
+            return decltype(body_result){declared_type, valid};
+        }
+
+        auto child_result = synth_rec(child_expr, env);
+        bool valid = child_result.valid &&
+                     detail::holds_gradually(child_result.type, declared_type);
+        return decltype(child_result){declared_type, valid};
+    });
+
+// Application, accepting an argument holds_gradually accepts.
+inline constexpr auto TRApplyGradual = def_typerule(
+    "apply", [](const auto& expr, const auto& env, auto synth_rec) {
+        using E = std::remove_cvref_t<decltype(expr)>;
+        const auto& node = expr.ast.nodes[expr.id];
+        E fn{expr.ast, node.children[0]};
+        E arg{expr.ast, node.children[1]};
+
+        // Let-binding: apply(lambda(x, body), val)
+        if (str_eq(expr.ast.nodes[node.children[0]].tag, "lambda")) {
+            const auto& lambda_node = expr.ast.nodes[node.children[0]];
+            auto param_name = expr.ast.nodes[lambda_node.children[0]].name;
+            E body{expr.ast, lambda_node.children[1]};
+            auto arg_result = synth_rec(arg, env);
+            auto extended_env = env.bind(param_name, arg_result.type);
+            auto body_result = synth_rec(body, extended_env);
+            return decltype(arg_result){body_result.type,
+                                        arg_result.valid && body_result.valid};
+        }
+
+        auto fn_result = synth_rec(fn, env);
+        auto arg_result = synth_rec(arg, env);
+        bool valid = fn_result.valid && arg_result.valid &&
+                     is_arrow(fn_result.type) &&
+                     detail::holds_gradually(arg_result.type,
+                                             get_arrow_input(fn_result.type));
+        if (!is_arrow(fn_result.type))
+            return decltype(fn_result){fn_result.type, false};
+        return decltype(fn_result){get_arrow_output(fn_result.type), valid};
+    });
+
+template <auto... ExtraRules, std::size_t Cap = 128, auto... Ms>
+consteval TypeResult<Cap> type_check_gradual(const Expression<Cap, Ms...>& e,
+                                             const TypeEnv<Cap>& env = {}) {
+    Expression<Cap> plain = e; // strip macros
+    return synth<TRAnnGradual, TRAdd, TRSub, TRMul, TRDiv, TRNeg, TREq, TRLt,
+                 TRGt, TRLe, TRGe, TRLand, TRLor, TRLnot, TRCond,
+                 TRApplyGradual, TRLambda, TRProgn, TRIndex, ExtraRules...>(
+        plain, env);
+}
+
+// --- residual_checks: the annotations left to run time ---
+
+struct ResidualChecks {
+    static constexpr std::size_t MaxSites = 16;
+    int sites[MaxSites]{}; // ann and apply node ids
+    std::size_t count{0};
+
+    consteval void add(int id) {
+        if (count >= MaxSites)
+            throw "residual_checks: too many residual obligations";
+        sites[count++] = id;
+    }
+
+    consteval bool contains(int id) const {
+        for (std::size_t s = 0; s < count; ++s)
+            if (sites[s] == id)
+                return true;
+        return false;
+    }
+};
+
+namespace detail {
+
+// Walks the scopes as synth does, re-synthesizing each annotated value.
+template <auto... ExtraRules, std::size_t Cap>
+consteval void collect_residuals(const AST<Cap>& ast, int id,
+                                 const TypeEnv<Cap>& env,
+                                 ResidualChecks& out) {
+    using E = Expression<Cap>;
+    const auto& n = ast.nodes[id];
+    auto synth_at = [&](int at, const TypeEnv<Cap>& scope) consteval {
+        return type_check_gradual<ExtraRules...>(E{ast, at}, scope).type;
+    };
+
+    if (str_eq(n.tag, "ann") && n.child_count == 2) {
+        E declared{ast, n.children[1]};
+        const auto& child = ast.nodes[n.children[0]];
+        if (str_eq(child.tag, "lambda") && is_arrow(declared)) {
+            auto inner =
+                env.bind(ast.nodes[child.children[0]].name,
+                         get_arrow_input(declared));
+            if (!is_subtype(synth_at(child.children[1], inner),
+                            get_arrow_output(declared)))
+                out.add(id);
+            collect_residuals<ExtraRules...>(ast, child.children[1], inner,
+                                             out);
+            return;
+        }
+        if (!is_subtype(synth_at(n.children[0], env), declared))
+            out.add(id);
+        collect_residuals<ExtraRules...>(ast, n.children[0], env, out);
+        return;
+    }
+    // let: the body sees the bound value's type
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+        const auto& fn = ast.nodes[n.children[0]];
+        auto inner = env.bind(ast.nodes[fn.children[0]].name,
+                              synth_at(n.children[1], env));
+        collect_residuals<ExtraRules...>(ast, n.children[1], env, out);
+        collect_residuals<ExtraRules...>(ast, fn.children[1], inner, out);
+        return;
+    }
+    // Application: the argument against the parameter type
+    if (str_eq(n.tag, "apply") && n.child_count == 2) {
+        auto fn_type = synth_at(n.children[0], env);
+        if (is_arrow(fn_type) && !is_subtype(synth_at(n.children[1], env),
+                                             get_arrow_input(fn_type)))
+            out.add(id);
+    }
+    for (int c = 0; c < n.child_count; ++c)
+        collect_residuals<ExtraRules...>(ast, n.children[c], env, out);
+}
+
+// let #v = value in progn(guard(p), #v), for type = {#v : B | p}.
+template <std::size_t Cap>
+consteval Expression<Cap> guarded(const Expression<Cap>& value,
+                                  const Expression<Cap>& type) {
+    auto v = Expression<Cap>::var("#v");
+    Expression<Cap> check = refmacro::MProgn(MGuard(get_refined_pred(type)), v);
+    return refmacro::let_("#v", value, check);
+}
+
+// Walks the scopes as collect_residuals does, so the parameter type at an
+// application is the one synthesized for its callee: an annotated lambda,
+// a function-typed variable from env, or any other arrow-typed expression.
+template <auto... ExtraRules, std::size_t Cap>
+consteval Expression<Cap> insert_checks(const AST<Cap>& ast, int id,
+                                        const TypeEnv<Cap>& env,
+                                        const ResidualChecks& checks) {
+    using E = Expression<Cap>;
+    const auto& n = ast.nodes[id];
+    auto synth_at = [&](int at, const TypeEnv<Cap>& scope) consteval {
+        return type_check_gradual<ExtraRules...>(E{ast, at}, scope).type;
+    };
+    auto recur = [&](int at, const TypeEnv<Cap>& scope) consteval {
+        return insert_checks<ExtraRules...>(ast, at, scope, checks);
+    };
+
+    if (str_eq(n.tag, "ann") && n.child_count == 2) {
+        E declared;
+        declared.id =
+            refmacro::detail::copy_subtree(declared.ast, ast, n.children[1]);
+        const auto& child = ast.nodes[n.children[0]];
+        E parts[2]{{}, declared};
+        if (str_eq(child.tag, "lambda") && is_arrow(declared)) {
+            auto inner = env.bind(ast.nodes[child.children[0]].name,
+                                  get_arrow_input(declared));
+            auto body = recur(child.children[1], inner);
+            if (checks.contains(id))
+                body = guarded(body, get_arrow_output(declared));
+            E fn[2]{leaf(ast, child.children[0]), body};
+            parts[0] = rebuild(child, fn);
+        } else {
+            parts[0] = recur(n.children[0], env);
+            if (checks.contains(id))
+                parts[0] = guarded(parts[0], declared);
+        }
+        return rebuild(n, parts);
+    }
+    // let: the body sees the bound value's type
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+        const auto& fn = ast.nodes[n.children[0]];
+        auto inner = env.bind(ast.nodes[fn.children[0]].name,
+                              synth_at(n.children[1], env));
+        E lam[2]{leaf(ast, fn.children[0]), recur(fn.children[1], inner)};
+        E parts[2]{rebuild(fn, lam), recur(n.children[1], env)};
+        return rebuild(n, parts);
+    }
+    if (str_eq(n.tag, "apply") && checks.contains(id)) {
+        // collect_residuals only records an application whose callee
+        // synthesizes an arrow type
+        auto fn_type = synth_at(n.children[0], env);
+        E parts[2]{recur(n.children[0], env),
+                   guarded(recur(n.children[1], env),
+                           get_arrow_input(fn_type))};
+        return rebuild(n, parts);
+    }
+    if (n.child_count == 0)
+        return leaf(ast, id);
+    E parts[8]{};
+    for (int c = 0; c < n.child_count; ++c)
+        parts[c] = recur(n.children[c], env);
+    return rebuild(n, parts);
+}
+
+} // namespace detail
+
+template <auto... ExtraRules, std::size_t Cap = 128, auto... Ms>
+consteval ResidualChecks residual_checks(const Expression<Cap, Ms...>& e,
+                                         const TypeEnv<Cap>& env = {}) {
+    ResidualChecks out{};
+    detail::collect_residuals<ExtraRules...>(e.ast, e.id, env, out);
+    return out;
+}
+
+// e with a guard at each residual obligation; the annotations are kept.
+template <auto... ExtraRules, std::size_t Cap = 128, auto... Ms>
+consteval Expression<Cap> insert_residual_checks(
+    const Expression<Cap, Ms...>& e, const TypeEnv<Cap>& env = {}) {
+    return detail::insert_checks<ExtraRules...>(
+        e.ast, e.id, env, residual_checks<ExtraRules...>(e, env));
+}
+
+// --- gradual_compile: typed_compile with residual obligations checked ---
+
+template <auto expr, auto env, auto... Macros>
+    requires requires {
+        env.count;
+        env.lookup("");
+    }
+consteval auto gradual_compile() {
+    static_assert(type_check_gradual(expr, env).valid,
+                  "gradual_compile: type check failed");
+    constexpr auto checked = insert_residual_checks(expr, env);
+    constexpr auto lowered =
+        elide_bounds_checks(lower_kinds(checked, env), env);
+    return detail::compile_with_macros_from<
+        lowered, refmacro::MIndexProven, MCast, MGuard, refmacro::MProgn,
+        Macros...>(expr);
+}
+
+template <auto expr, auto... Macros>
+    requires(sizeof...(Macros) == 0 || (... &&
+                                        requires {
+                                            Macros.tag;
+                                            Macros.fn;
+                                        }))
+consteval auto gradual_compile() {
+    constexpr auto Cap = sizeof(expr.ast.nodes) / sizeof(expr.ast.nodes[0]);
+    return gradual_compile<expr, TypeEnv<Cap>{}, Macros...>();
+}
+
+// gradual_compile with all the macros typed_full_compile uses.
+template <auto expr> consteval auto gradual_full_compile() {
+    using namespace refmacro;
+    return gradual_compile<expr, MAdd, MSub, MMul, MDiv, MNeg, MCond, MLand,
+                           MLor, MLnot, MEq, MLt, MGt, MLe, MGe, MProgn>();
+}
+
+template <auto expr, auto env>
+    requires requires {
+        env.count;
+        env.lookup("");
+    }
+consteval auto gradual_full_compile() {
+    using namespace refmacro;
+    return gradual_compile<expr, env, MAdd, MSub, MMul, MDiv, MNeg, MCond,
+                           MLand, MLor, MLnot, MEq, MLt, MGt, MLe, MGe,
+                           MProgn>();
+}
+
+} // namespace reftype
+
+#endif // REFTYPE_GRADUAL_HPP
@@ -0,0 +1,456 @@
+#ifndef REFTYPE_LOWER_HPP
+#define REFTYPE_LOWER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/macro.hpp>
+#include <refmacro/str_utils.hpp>
+#include <reftype/bounds.hpp>
+#include <reftype/check.hpp>
+#include <reftype/type_env.hpp>
+#include <reftype/types.hpp>
+
+namespace reftype {
+
+using refmacro::AST;
+using refmacro::Expression;
+using refmacro::str_eq;
+
+// --- Representations ---
+//
+// The C++ type a value computes in. Bool, Int and Real values default to
+// bool, int64_t and double; an Int value the solver proves to fit a
+// narrower integer type computes in that one. Each representation holds
+// every value of the ones before it.
+
+enum class Repr { None, Bool, UInt8, Int16, Int32, Int64, Real };
+
+template <Repr R> struct repr_type {
+    using type = double;
+};
+template <> struct repr_type<Repr::Bool> {
+    using type = bool;
+};
+template <> struct repr_type<Repr::UInt8> {
+    using type = std::uint8_t;
+};
+template <> struct repr_type<Repr::Int16> {
+    using type = std::int16_t;
+};
+template <> struct repr_type<Repr::Int32> {
+    using type = std::int32_t;
+};
+template <> struct repr_type<Repr::Int64> {
+    using type = std::int64_t;
+};
+
+template <Repr R> using repr_t = typename repr_type<R>::type;
+
+consteval Repr default_repr(BaseKind kind) {
+    switch (kind) {
+    case BaseKind::Bool:
+        return Repr::Bool;
+    case BaseKind::Int:
+        return Repr::Int64;
+    case BaseKind::Real:
+        return Repr::Real;
+    case BaseKind::None:
+        return Repr::None;
+    }
+    return Repr::None;
+}
+
+consteval BaseKind repr_kind(Repr repr) {
+    if (repr == Repr::None)
+        return BaseKind::None;
+    if (repr == Repr::Bool)
+        return BaseKind::Bool;
+    return repr == Repr::Real ? BaseKind::Real : BaseKind::Int;
+}
+
+// cast(x): x converted to the representation in the payload. A literal is
+// converted from its payload, not from its value in the argument type,
+// which need not hold it.
+inline constexpr auto MCast = refmacro::defmacro<"cast", refmacro::pure_op>(
+    [](refmacro::NodeInfo auto node, auto x) {
+        using Node = decltype(node);
+        constexpr auto repr = static_cast<Repr>(
+            static_cast<int>(Node::payload()));
+        using T = repr_t<repr>;
+        if constexpr (Node::child(0).tag() == "lit")
+            return [](auto...) constexpr {
+                return static_cast<T>(Node::child(0).payload());
+            };
+        else
+            return [=](auto... a) constexpr {
+                return static_cast<T>(x(a...));
+            };
+    });
+
+// --- lower_kinds: carry each node's representation into the lowering ---
+//
+// Strips the annotations of a typed expression, as strip_types does, and
+// inserts cast nodes so that every subtree computes in the representation
+// of the kind the type rules synthesize for it:
+//   - each read of a variable from env is converted where it occurs, so
+//     the caller's argument type does not leak into the arithmetic,
+//   - an Int literal becomes an integer constant,
+//   - a value is widened where the rules accept it at a wider kind: an
+//     annotation, the arms of a cond, and the argument and result of an
+//     annotated lambda.
+// Arithmetic only combines operands of one kind, so Int subtrees are
+// integer code throughout and Bool subtrees are bool. The one exception is
+// division: Int / Int is a double division, as it is without types, so a
+// zero divisor gives inf rather than a trap and a quotient keeps its
+// fraction. The quotient is held as a double, and so is Int arithmetic
+// over it. Which operations are integer code depends only on the
+// expression, never on what the facts below prove.
+// Let-bound and lambda-bound variables already hold their value's
+// representation. The children of a tag the built-in rules do not cover
+// are lowered in place, and it keeps its own payload.
+//
+// An Int intermediate is narrowed to uint8_t, int16_t or int32_t when the
+// FM solver proves its value fits: from the refinements of env's Int
+// variables and integer let bindings, as elide_bounds_checks reads them,
+// for the integer-linear subtrees it can bound. Each operation computes
+// in the widest of its operands' and its own representation, so no
+// intermediate overflows, and the whole expression's value is returned
+// in its kind's default representation.
+
+namespace detail {
+
+template <std::size_t Cap> struct KindedExpr {
+    Expression<Cap> e{};
+    Repr repr{Repr::None};
+};
+
+// The representations of the variables in scope, and what is known about
+// the integers among them. env's variables are read from the caller's
+// arguments; bound ones are computed in the expression.
+struct KindScope {
+    static constexpr std::size_t MaxBindings = 32;
+    char names[MaxBindings][16]{};
+    Repr reprs[MaxBindings]{};
+    bool bound[MaxBindings]{};
+    std::size_t count{0};
+    BoundsFacts facts{};
+
+    consteval KindScope bind(const char* name, Repr repr,
+                             bool is_bound = true) const {
+        if (count >= MaxBindings)
+            throw "lower_kinds: too many bindings";
+        KindScope result = *this;
+        refmacro::copy_str(result.names[count], name, sizeof(names[0]));
+        result.reprs[count] = repr;
+        result.bound[count] = is_bound;
+        ++result.count;
+        if (is_bound)
+            forget(result.facts, name);
+        return result;
+    }
+
+    consteval int find(const char* name) const {
+        for (std::size_t i = count; i > 0; --i)
+            if (str_eq(names[i - 1], name))
+                return static_cast<int>(i - 1);
+        return -1;
+    }
+};
+
+template <std::size_t Cap>
+consteval KindScope env_kinds(const TypeEnv<Cap>& env) {
+    KindScope scope{};
+    for (std::size_t b = 0; b < env.count; ++b)
+        scope = scope.bind(env.names[b],
+                           default_repr(get_base_kind(env.types[b])), false);
+    scope.facts = env_facts(env);
+    return scope;
+}
+
+struct IntRange {
+    Repr repr;
+    double lo;
+    double hi;
+};
+
+inline constexpr IntRange narrow_ints[] = {
+    {Repr::UInt8, 0.0, 255.0},
+    {Repr::Int16, -32768.0, 32767.0},
+    {Repr::Int32, -2147483648.0, 2147483647.0},
+};
+
+// The narrowest integer representation the facts prove the Int subtree at
+// id fits.
+template <std::size_t Cap>
+consteval Repr proven_int_repr(const BoundsFacts& k, const AST<Cap>& ast,
+                               int id) {
+    if (!is_boundable(k, ast, id))
+        return Repr::Int64;
+    auto v = to_fact(ast, id);
+    for (const IntRange& r : narrow_ints)
+        if (implied(k, (Fact::lit(r.lo) <= v) && (v <= Fact::lit(r.hi))))
+            return r.repr;
+    return Repr::Int64;
+}
+
+// The representation of a literal: Real unless synth gives it Int, and
+// then the narrowest integer type holding it.
+consteval Repr literal_repr(double v) {
+    constexpr double ll_max = static_cast<double>(1LL << 52);
+    if (!(v >= -ll_max && v <= ll_max) ||
+        v != static_cast<double>(static_cast<long long>(v)))
+        return Repr::Real;
+    for (const IntRange& r : narrow_ints)
+        if (v >= r.lo && v <= r.hi)
+            return r.repr;
+    return Repr::Int64;
+}
+
+consteval Repr widest(Repr a, Repr b) { return a < b ? b : a; }
+
+template <std::size_t Cap>
+consteval Expression<Cap> cast_to(const Expression<Cap>& e, Repr repr) {
+    Expression<Cap> result = e;
+    result.id = result.ast.add_tagged_node("cast", {e.id});
+    result.ast.nodes[result.id].payload = static_cast<int>(repr);
+    return result;
+}
+
+// x as repr; an unknown representation is left alone.
+template <std::size_t Cap>
+consteval Expression<Cap> convert(const KindedExpr<Cap>& x, Repr repr) {
+    if (x.repr == Repr::None || repr == Repr::None || x.repr == repr)
+        return x.e;
+    return cast_to(x.e, repr);
+}
+
+// x at kind: converted to kind's default representation only where the
+// kinds differ. A Real value of Int kind (a quotient) stays Real.
+template <std::size_t Cap>
+consteval KindedExpr<Cap> widen(const KindedExpr<Cap>& x, BaseKind kind) {
+    if (x.repr == Repr::None || kind == BaseKind::None ||
+        repr_kind(x.repr) == kind ||
+        (x.repr == Repr::Real && kind == BaseKind::Int))
+        return x;
+    return {cast_to(x.e, default_repr(kind)), default_repr(kind)};
+}
+
+// A copy of node with the given children.
+template <std::size_t Cap>
+consteval Expression<Cap> rebuild(refmacro::ASTNode node,
+                                  const Expression<Cap>* children) {
+    Expression<Cap> result = children[0];
+    node.children[0] = result.id;
+    for (int i = 1; i < node.child_count; ++i)
+        node.children[i] = children[i].id + result.ast.merge(children[i].ast);
+    result.id = result.ast.add_node(node);
+    return result;
+}
+
+template <std::size_t Cap>
+consteval Expression<Cap> leaf(const AST<Cap>& ast, int id) {
+    Expression<Cap> e;
+    e.id = e.ast.add_node(ast.nodes[id]);
+    return e;
+}
+
+// An Int operation on the given operands, whose value fits target. It
+// computes in the widest representation involved: C++ promotes integers
+// narrower than int on its own, so only a 64-bit operation needs its
+// operands converted.
+template <std::size_t Cap>
+consteval KindedExpr<Cap> int_op(const refmacro::ASTNode& n,
+                                 const KindedExpr<Cap>* operands,
+                                 Repr target) {
+    Repr compute = target;
+    for (int c = 0; c < n.child_count; ++c)
+        compute = widest(compute, operands[c].repr);
+    Expression<Cap> parts[2]{};
+    for (int c = 0; c < n.child_count; ++c)
+        parts[c] = compute == Repr::Int64 ? convert(operands[c], compute)
+                                          : operands[c].e;
+    auto e = rebuild(n, parts);
+    Repr natural = widest(compute, Repr::Int32);
+    return {natural == target ? e : cast_to(e, target), target};
+}
+
+template <std::size_t Cap>
+consteval KindedExpr<Cap> lower_kinds_at(const AST<Cap>& ast, int id,
+                                         const KindScope& scope);
+
+// lambda(x, body) with x held at repr; the body is taken at body_kind
+// (None: as computed).
+template <std::size_t Cap>
+consteval KindedExpr<Cap> lower_lambda(const AST<Cap>& ast, int id,
+                                       const KindScope& scope, Repr repr,
+                                       BaseKind body_kind) {
+    const auto& fn = ast.nodes[id];
+    const char* name = ast.nodes[fn.children[0]].name;
+    auto body = widen(
+        lower_kinds_at(ast, fn.children[1], scope.bind(name, repr)),
+        body_kind);
+    Expression<Cap> parts[2]{leaf(ast, fn.children[0]), body.e};
+    return {rebuild(fn, parts), body.repr};
+}
+
+// let(x, v) = apply(lambda(x, body), v): x holds v at param_kind (None:
+// v's own) and the body's value is taken at body_kind. An integer v is
+// also a fact about x.
+template <std::size_t Cap>
+consteval KindedExpr<Cap> lower_let(const AST<Cap>& ast, int id, int lambda,
+                                    const KindScope& scope,
+                                    BaseKind param_kind, BaseKind body_kind) {
+    const auto& n = ast.nodes[id];
+    int arg = n.children[1];
+    auto value = widen(lower_kinds_at(ast, arg, scope), param_kind);
+    const auto& fn = ast.nodes[lambda];
+    const char* name = ast.nodes[fn.children[0]].name;
+    KindScope inner = scope.bind(name, value.repr);
+    if (repr_kind(value.repr) == BaseKind::Int &&
+        usable_bound(scope.facts, ast, arg, name)) {
+        inner.facts.ints.add(name);
+        add_fact(inner.facts, Fact{Fact::var(name) == to_fact(ast, arg)});
+    }
+    auto body =
+        widen(lower_kinds_at(ast, fn.children[1], inner), body_kind);
+    Expression<Cap> fn_parts[2]{leaf(ast, fn.children[0]), body.e};
+    Expression<Cap> parts[2]{rebuild(fn, fn_parts), value.e};
+    return {rebuild(n, parts), body.repr};
+}
+
+template <std::size_t Cap>
+consteval KindedExpr<Cap> lower_kinds_at(const AST<Cap>& ast, int id,
+                                         const KindScope& scope) {
+    const auto& n = ast.nodes[id];
+    auto is = [&](const char* tag) consteval { return str_eq(n.tag, tag); };
+    auto binary = [&](Repr repr) consteval -> KindedExpr<Cap> {
+        Expression<Cap> parts[2]{lower_kinds_at(ast, n.children[0], scope).e,
+                                 lower_kinds_at(ast, n.children[1], scope).e};
+        return {rebuild(n, parts), repr};
+    };
+
+    if (is("lit")) {
+        auto lit = leaf(ast, id);
+        Repr repr = literal_repr(n.payload);
+        if (repr == Repr::Real) {
+            refmacro::copy_str(lit.ast.nodes[lit.id].name, "");
+            return {lit, repr};
+        }
+        refmacro::copy_str(lit.ast.nodes[lit.id].name, refmacro::int_lit_kind);
+        return {cast_to(lit, repr), repr};
+    }
+    if (is("var")) {
+        int b = scope.find(n.name);
+        if (b < 0)
+            return {leaf(ast, id), Repr::None};
+        Repr repr = scope.reprs[b];
+        if (scope.bound[b] || repr == Repr::None)
+            return {leaf(ast, id), repr};
+        if (repr == Repr::Int64)
+            repr = proven_int_repr(scope.facts, ast, id);
+        return {cast_to(leaf(ast, id), repr), repr};
+    }
+    if (is("tint") || is("tbool") || is("treal") || is("tref") || is("tarr"))
+        throw "lower_kinds: bare type node outside annotation";
+    if (is("ann") && n.child_count == 2) {
+        int inner = n.children[0];
+        if (str_eq(ast.nodes[inner].tag, "lambda"))
+            return lower_kinds_at(ast, inner, scope);
+        return widen(lower_kinds_at(ast, inner, scope),
+                     get_base_kind(Expression<Cap>{ast, n.children[1]}));
+    }
+    if ((is("add") || is("sub") || is("mul") || is("div") || is("neg")) &&
+        n.child_count == (is("neg") ? 1 : 2)) {
+        KindedExpr<Cap> operands[2]{};
+        for (int c = 0; c < n.child_count; ++c)
+            operands[c] = lower_kinds_at(ast, n.children[c], scope);
+        BaseKind kind = repr_kind(operands[0].repr);
+        bool numeric = true, quotient = is("div");
+        for (int c = 0; c < n.child_count; ++c) {
+            BaseKind k = repr_kind(operands[c].repr);
+            numeric = numeric && (k == BaseKind::Int || k == BaseKind::Real);
+            quotient = quotient || operands[c].repr == Repr::Real;
+            if (k != kind)
+                kind = BaseKind::None;
+        }
+        // A division, or Int arithmetic over a quotient: in double
+        if (numeric && quotient) {
+            Expression<Cap> parts[2]{};
+            for (int c = 0; c < n.child_count; ++c)
+                parts[c] = convert(operands[c], Repr::Real);
+            return {rebuild(n, parts), Repr::Real};
+        }
+        if (kind == BaseKind::Int)
+            return int_op(n, operands,
+                          proven_int_repr(scope.facts, ast, id));
+        Expression<Cap> parts[2]{operands[0].e, operands[1].e};
+        return {rebuild(n, parts), default_repr(kind)};
+    }
+    if ((is("eq") || is("lt") || is("gt") || is("le") || is("ge") ||
+         is("land") || is("lor")) &&
+        n.child_count == 2)
+        return binary(Repr::Bool);
+    if (is("lnot") && n.child_count == 1) {
+        auto x = lower_kinds_at(ast, n.children[0], scope);
+        return {rebuild(n, &x.e), Repr::Bool};
+    }
+    if (is("cond") && n.child_count == 3) {
+        auto test = lower_kinds_at(ast, n.children[0], scope);
+        auto then_ = lower_kinds_at(ast, n.children[1], scope);
+        auto else_ = lower_kinds_at(ast, n.children[2], scope);
+        // The join of the arms
+        Repr repr = widest(then_.repr, else_.repr);
+        if (then_.repr == Repr::None || else_.repr == Repr::None)
+            repr = Repr::None;
+        Expression<Cap> parts[3]{test.e, convert(then_, repr),
+                                 convert(else_, repr)};
+        return {rebuild(n, parts), repr};
+    }
+    if (is("apply") && n.child_count == 2) {
+        int fn = n.children[0];
+        const auto& f = ast.nodes[fn];
+        if (str_eq(f.tag, "lambda"))
+            return lower_let(ast, id, fn, scope, BaseKind::None,
+                             BaseKind::None);
+        Expression<Cap> type{ast, f.children[1]};
+        if (str_eq(f.tag, "ann") &&
+            str_eq(ast.nodes[f.children[0]].tag, "lambda") && is_arrow(type))
+            return lower_let(ast, id, f.children[0], scope,
+                             get_base_kind(get_arrow_input(type)),
+                             get_base_kind(get_arrow_output(type)));
+    }
+    if (is("lambda") && n.child_count == 2)
+        return lower_lambda(ast, id, scope, Repr::None, BaseKind::None);
+    if (is("progn") && n.child_count == 2) {
+        auto second = lower_kinds_at(ast, n.children[1], scope);
+        Expression<Cap> parts[2]{lower_kinds_at(ast, n.children[0], scope).e,
+                                 second.e};
+        return {rebuild(n, parts), second.repr};
+    }
+    if (is("index") && n.child_count == 2)
+        return binary(Repr::Real);
+
+    // Any other node: its children are lowered in place.
+    if (n.child_count == 0)
+        return {leaf(ast, id), Repr::None};
+    Expression<Cap> parts[8]{};
+    for (int c = 0; c < n.child_count; ++c)
+        parts[c] = lower_kinds_at(ast, n.children[c], scope).e;
+    return {rebuild(n, parts), Repr::None};
+}
+
+} // namespace detail
+
+template <std::size_t Cap = 128, auto... Ms>
+consteval Expression<Cap> lower_kinds(const Expression<Cap, Ms...>& e,
+                                      const TypeEnv<Cap>& env = {}) {
+    auto lowered = detail::lower_kinds_at(e.ast, e.id, detail::env_kinds(env));
+    return detail::convert(lowered,
+                           default_repr(repr_kind(lowered.repr)));
+}
+
+} // namespace reftype
+
+#endif // REFTYPE_LOWER_HPP
@@ -5,14 +5,21 @@
 //
 // Provides: type AST nodes, type environment, constraint sets,
 // subtype checking (with FM solver), bidirectional type checker,
-// type annotation stripping, and the typed compile pipeline.
+// type annotation stripping, kind-directed lowering, bounds-check elision,
+// refinement-driven simplification, the typed compile pipeline,
+// lookup-table compilation over proven domains, and gradual checking.
 
+#include <reftype/bounds.hpp>
 #include <reftype/check.hpp>
 #include <reftype/constraints.hpp>
 #include <reftype/fm/fm.hpp>
+#include <reftype/gradual.hpp>
+#include <reftype/lower.hpp>
 #include <reftype/pretty.hpp>
+#include <reftype/simplify.hpp>
 #include <reftype/strip.hpp>
 #include <reftype/subtype.hpp>
+#include <reftype/table.hpp>
 #include <reftype/type_env.hpp>
 #include <reftype/typerule.hpp>
 #include <reftype/types.hpp>
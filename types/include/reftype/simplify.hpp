@@ -0,0 +1,156 @@
+#ifndef REFTYPE_SIMPLIFY_HPP
+#define REFTYPE_SIMPLIFY_HPP
+
+#include <refmacro/control.hpp>
+#include <refmacro/expr.hpp>
+#include <refmacro/math.hpp>
+#include <refmacro/transforms.hpp>
+#include <reftype/bounds.hpp>
+#include <reftype/lower.hpp>
+#include <reftype/type_env.hpp>
+
+namespace reftype {
+
+using refmacro::AST;
+using refmacro::Expression;
+using refmacro::str_eq;
+
+// --- simplify_with: simplify using what the refinements prove ---
+//
+// refmacro's simplify() only knows syntactic identities. simplify_with
+// also folds what the FM solver proves from the facts elide_bounds_checks
+// collects (env's Int refinements, enclosing loop ranges and integer let
+// bindings):
+//   - cond(c, a, b) => a when the facts imply c, b when they imply !c;
+//     otherwise a is simplified knowing c and b knowing !c,
+//   - e / e => 1 for an integer e the facts prove nonzero,
+// and then applies simplify(). Only integer-linear conditions and
+// operands take part, as for bounds checks; anything else is left alone.
+//
+//   env: x : {#v : Int | #v > 0}
+//   simplify_with(cond(x > 0, a, b), env)  =>  a
+//   simplify_with(x / x, env)              =>  1
+
+namespace detail {
+
+template <std::size_t Cap>
+consteval Expression<Cap> fold_proven(const AST<Cap>& ast, int id,
+                                      const BoundsFacts& k);
+
+// A binder lambda(x, body) whose body is folded under inner.
+template <std::size_t Cap>
+consteval Expression<Cap> fold_binder(const AST<Cap>& ast, int id,
+                                      const BoundsFacts& inner) {
+    const auto& fn = ast.nodes[id];
+    Expression<Cap> parts[2]{leaf(ast, fn.children[0]),
+                             fold_proven(ast, fn.children[1], inner)};
+    return rebuild(fn, parts);
+}
+
+// cond(c, a, b) for a condition the solver can read.
+template <std::size_t Cap>
+consteval Expression<Cap> fold_cond(const AST<Cap>& ast, int id,
+                                    const BoundsFacts& k) {
+    const auto& n = ast.nodes[id];
+    int c = n.children[0];
+    Fact test = to_fact(ast, c);
+    Fact negated = !test;
+    if (implied(k, test))
+        return fold_proven(ast, n.children[1], k);
+    if (implied(k, negated))
+        return fold_proven(ast, n.children[2], k);
+    BoundsFacts then_k = k;
+    add_fact(then_k, test);
+    BoundsFacts else_k = k;
+    add_fact(else_k, negated);
+    Expression<Cap> parts[3]{fold_proven(ast, c, k),
+                             fold_proven(ast, n.children[1], then_k),
+                             fold_proven(ast, n.children[2], else_k)};
+    return rebuild(n, parts);
+}
+
+template <std::size_t Cap>
+consteval Expression<Cap> fold_proven(const AST<Cap>& ast, int id,
+                                      const BoundsFacts& k) {
+    const auto& n = ast.nodes[id];
+    auto binder_param = [&](int lambda) consteval {
+        return ast.nodes[lambda].children[0];
+    };
+
+    if (str_eq(n.tag, "cond") && n.child_count == 3 &&
+        subtree_size(ast, n.children[0]) <= 2 * max_operand &&
+        is_int_formula(ast, n.children[0], k.ints))
+        return fold_cond(ast, id, k);
+    if (str_eq(n.tag, "div") && n.child_count == 2 &&
+        refmacro::detail::trees_equal(ast, n.children[0], ast,
+                                      n.children[1]) &&
+        proven_nonzero(k, ast, n.children[0]))
+        return Expression<Cap>::lit(1.0, true);
+
+    // The binders extend the facts as in prove_walk
+    Expression<Cap> parts[8]{};
+    if ((str_eq(n.tag, "sum") || str_eq(n.tag, "product")) &&
+        n.child_count == 3) {
+        int fn = n.children[2];
+        BoundsFacts inner = k;
+        bind_loop_var(inner, ast, binder_param(fn), n.children[0],
+                      n.children[1]);
+        parts[0] = fold_proven(ast, n.children[0], k);
+        parts[1] = fold_proven(ast, n.children[1], k);
+        parts[2] = fold_binder(ast, fn, inner);
+        return rebuild(n, parts);
+    }
+    if (str_eq(n.tag, "fold_range") && n.child_count == 4) {
+        int outer = n.children[3];
+        int fn = ast.nodes[outer].children[1];
+        BoundsFacts inner = k;
+        forget(inner, ast.nodes[binder_param(outer)].name);
+        bind_loop_var(inner, ast, binder_param(fn), n.children[1],
+                      n.children[2]);
+        for (int c = 0; c < 3; ++c)
+            parts[c] = fold_proven(ast, n.children[c], k);
+        Expression<Cap> acc[2]{leaf(ast, binder_param(outer)),
+                               fold_binder(ast, fn, inner)};
+        parts[3] = rebuild(ast.nodes[outer], acc);
+        return rebuild(n, parts);
+    }
+    if (str_eq(n.tag, "apply") && n.child_count == 2 &&
+        str_eq(ast.nodes[n.children[0]].tag, "lambda")) {
+        int fn = n.children[0];
+        const char* name = ast.nodes[binder_param(fn)].name;
+        BoundsFacts inner = k;
+        forget(inner, name);
+        if (usable_bound(k, ast, n.children[1], name)) {
+            inner.ints.add(name);
+            add_fact(inner,
+                     Fact{Fact::var(name) == to_fact(ast, n.children[1])});
+        }
+        parts[0] = fold_binder(ast, fn, inner);
+        parts[1] = fold_proven(ast, n.children[1], k);
+        return rebuild(n, parts);
+    }
+    if (str_eq(n.tag, "lambda") && n.child_count == 2) {
+        BoundsFacts inner = k;
+        forget(inner, ast.nodes[binder_param(id)].name);
+        return fold_binder(ast, id, inner);
+    }
+
+    if (n.child_count == 0)
+        return leaf(ast, id);
+    for (int c = 0; c < n.child_count; ++c)
+        parts[c] = fold_proven(ast, n.children[c], k);
+    return rebuild(n, parts);
+}
+
+} // namespace detail
+
+template <std::size_t Cap, auto... Ms>
+consteval Expression<Cap, Ms...> simplify_with(Expression<Cap, Ms...> e,
+                                               const TypeEnv<Cap>& env = {}) {
+    return refmacro::simplify(
+        detail::fold_proven(e.ast, e.id, detail::env_facts(env)));
+}
+
+} // namespace reftype
+
+#endif // REFTYPE_SIMPLIFY_HPP
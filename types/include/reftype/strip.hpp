@@ -6,7 +6,9 @@
 #include <refmacro/expr.hpp>
 #include <refmacro/math.hpp>
 #include <refmacro/transforms.hpp>
+#include <reftype/bounds.hpp>
 #include <reftype/check.hpp>
+#include <reftype/lower.hpp>
 
 namespace reftype {
 
@@ -79,6 +81,12 @@ consteval auto compile_with_macros_from(Expression<Cap, Embedded...>) {
 
 // --- typed_compile: type check + strip + compile in one step ---
 //
+// Each subtree computes in the representation of its kind (see
+// lower_kinds): an Int expression returns an int64_t, a Bool one a bool,
+// and the arguments of env's variables are converted to their kinds. Array
+// reads whose bounds the refinements prove are compiled unchecked
+// (see elide_bounds_checks).
+//
 // Usage:
 //   constexpr auto f = typed_compile<expr, MAdd, MSub, ...>();
 //
@@ -99,8 +107,9 @@ template <auto expr, auto... Macros>
 consteval auto typed_compile() {
     constexpr auto result = type_check(expr);
     static_assert(result.valid, "typed_compile: type check failed");
-    constexpr auto stripped = strip_types(expr);
-    return detail::compile_with_macros_from<stripped, Macros...>(expr);
+    constexpr auto lowered = elide_bounds_checks(lower_kinds(expr));
+    return detail::compile_with_macros_from<lowered, refmacro::MIndexProven,
+                                            MCast, Macros...>(expr);
 }
 
 template <auto expr, auto env, auto... Macros>
@@ -111,8 +120,9 @@ template <auto expr, auto env, auto... Macros>
 consteval auto typed_compile() {
     constexpr auto result = type_check(expr, env);
     static_assert(result.valid, "typed_compile: type check failed");
-    constexpr auto stripped = strip_types(expr);
-    return detail::compile_with_macros_from<stripped, Macros...>(expr);
+    constexpr auto lowered = elide_bounds_checks(lower_kinds(expr, env), env);
+    return detail::compile_with_macros_from<lowered, refmacro::MIndexProven,
+                                            MCast, Macros...>(expr);
 }
 
 // --- typed_full_compile: type check + strip + compile with all macros ---
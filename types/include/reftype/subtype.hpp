@@ -77,7 +77,8 @@ consteval bool nodes_equal(const refmacro::AST<CapA>& ast_a, int id_a,
         return false;
     if (a.payload != b.payload)
         return false;
-    if (!str_eq(a.name, b.name))
+    // A literal's name is its numeric kind, which only compile reads
+    if (!str_eq(a.tag, "lit") && !str_eq(a.name, b.name))
         return false;
     if (a.child_count != b.child_count)
         return false;
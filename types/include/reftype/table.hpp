@@ -0,0 +1,234 @@
+#ifndef REFTYPE_TABLE_HPP
+#define REFTYPE_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <refmacro/compile.hpp>
+#include <refmacro/expr.hpp>
+#include <reftype/bounds.hpp>
+#include <reftype/lower.hpp>
+#include <reftype/strip.hpp>
+#include <reftype/type_env.hpp>
+#include <type_traits>
+#include <utility>
+
+namespace reftype {
+
+using refmacro::Expression;
+
+// --- compile_table: precompute an expression over its proven domain ---
+//
+// When every argument of a typed expression is a Bool, or an Int whose
+// refinement bounds it to a small range, compile_table<expr, env, ...>()
+// evaluates the typed_compile result at each point of the domain during
+// compilation and returns a function that reads the answer from a static
+// table:
+//
+//   env: x : {#v : Int | 0 <= #v && #v < 256}
+//   constexpr auto f = compile_table<classify(x), env, MAdd, ...>();
+//   f(17); // one load
+//
+// The FM solver finds each Int's range from the refinements, as
+// elide_bounds_checks reads them. Entries are stored in the narrowest
+// representation that holds them all, and the function returns the
+// representation of the expression's kind, as typed_compile does. Arguments
+// outside the refined domain are a caller error and are not checked.
+//
+// Expressions with a Real or array argument, an Int the solver cannot
+// bound, or a domain of more than table_budget points are compiled with
+// typed_compile instead.
+
+inline constexpr std::size_t table_budget = 4096;
+
+namespace detail {
+
+// The domain of each argument, in extract_var_map order.
+struct TableDomain {
+    long long lo[8]{};
+    long long size[8]{};
+    std::size_t count{0};
+    std::size_t entries{1};
+    bool fits{true};
+};
+
+// The greatest c in [lo, hi] with the facts implying v >= c, given that
+// they imply v >= lo.
+consteval long long proven_min(const BoundsFacts& k, const Fact& v,
+                               long long lo, long long hi) {
+    while (lo < hi) {
+        long long mid = lo + (hi - lo + 1) / 2;
+        if (implied(k, v >= Fact::lit(static_cast<double>(mid))))
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// The least c in [lo, hi] with the facts implying v <= c, given that they
+// imply v <= hi.
+consteval long long proven_max(const BoundsFacts& k, const Fact& v,
+                               long long lo, long long hi) {
+    while (lo < hi) {
+        long long mid = lo + (hi - lo) / 2;
+        if (implied(k, v <= Fact::lit(static_cast<double>(mid))))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return hi;
+}
+
+// The number of values the facts allow the Int variable name, or 0 when
+// they do not bound it to at most budget of them.
+consteval long long proven_extent(const BoundsFacts& k, const char* name,
+                                  std::size_t budget, long long& lo) {
+    const IntRange& int32 = narrow_ints[2];
+    auto v = Fact::var(name);
+    if (!implied(k, (Fact::lit(int32.lo) <= v) && (v <= Fact::lit(int32.hi))))
+        return 0;
+    auto min = static_cast<long long>(int32.lo);
+    auto max = static_cast<long long>(int32.hi);
+    lo = proven_min(k, v, min, max);
+    long long last = lo + static_cast<long long>(budget) - 1;
+    if (!implied(k, v <= Fact::lit(static_cast<double>(last))))
+        return 0;
+    return proven_max(k, v, lo, last) - lo + 1;
+}
+
+template <std::size_t Cap>
+consteval TableDomain table_domain(const Expression<Cap>& e,
+                                   const TypeEnv<Cap>& env) {
+    TableDomain d{};
+    auto vm = refmacro::extract_var_map(e.ast, e.id);
+    auto k = env_facts(env);
+    for (std::size_t v = 0; v < vm.count && d.fits; ++v) {
+        BaseKind kind = get_base_kind(env.lookup(vm.names[v]));
+        long long lo = 0;
+        long long size = 0;
+        if (kind == BaseKind::Bool)
+            size = 2;
+        else if (kind == BaseKind::Int)
+            size = proven_extent(k, vm.names[v], table_budget, lo);
+        d.fits = size > 0 &&
+                 d.entries * static_cast<std::size_t>(size) <= table_budget;
+        d.lo[d.count] = lo;
+        d.size[d.count++] = size;
+        if (d.fits)
+            d.entries *= static_cast<std::size_t>(size);
+    }
+    return d;
+}
+
+template <auto expr, auto env>
+inline constexpr TableDomain domain_of =
+    table_domain(lower_kinds(expr, env), env);
+
+// The value at point i of the domain: the last argument varies fastest.
+template <TableDomain d, typename F, std::size_t... V>
+consteval auto table_entry(const F& f, std::size_t i,
+                           std::index_sequence<V...>) {
+    std::int64_t args[sizeof...(V) + 1]{};
+    for (std::size_t v = d.count; v > 0; --v) {
+        auto size = static_cast<std::size_t>(d.size[v - 1]);
+        args[v - 1] = d.lo[v - 1] + static_cast<long long>(i % size);
+        i /= size;
+    }
+    return f(args[V]...);
+}
+
+template <auto expr, auto env, auto... Macros>
+consteval auto table_values() {
+    constexpr auto f = typed_compile<expr, env, Macros...>();
+    constexpr auto d = domain_of<expr, env>;
+    using Args = std::make_index_sequence<d.count>;
+    using R = decltype(table_entry<d>(f, 0, Args{}));
+    std::array<R, d.entries> values{};
+    for (std::size_t i = 0; i < d.entries; ++i)
+        values[i] = table_entry<d>(f, i, Args{});
+    return values;
+}
+
+// The narrowest representation holding every value.
+template <typename T, std::size_t N>
+consteval Repr entry_repr(const std::array<T, N>& values) {
+    if constexpr (!std::is_same_v<T, std::int64_t>) {
+        return std::is_same_v<T, bool> ? Repr::Bool : Repr::Real;
+    } else {
+        // Compared as integers: past 2^52 literal_repr would call them Real
+        Repr repr = Repr::UInt8;
+        for (T v : values) {
+            Repr fits = Repr::Int64;
+            for (const IntRange& r : narrow_ints)
+                if (v >= static_cast<T>(r.lo) && v <= static_cast<T>(r.hi)) {
+                    fits = r.repr;
+                    break;
+                }
+            repr = widest(repr, fits);
+        }
+        return repr;
+    }
+}
+
+template <auto values> consteval auto narrow_table() {
+    using T = repr_t<entry_repr(values)>;
+    std::array<T, values.size()> table{};
+    for (std::size_t i = 0; i < values.size(); ++i)
+        table[i] = static_cast<T>(values[i]);
+    return table;
+}
+
+template <auto expr, auto env, auto... Macros>
+inline constexpr auto lookup_table =
+    narrow_table<table_values<expr, env, Macros...>()>();
+
+} // namespace detail
+
+template <auto expr, auto env, auto... Macros>
+    requires requires {
+        env.count;
+        env.lookup("");
+    }
+consteval auto compile_table() {
+    static_assert(type_check(expr, env).valid,
+                  "compile_table: type check failed");
+    constexpr auto d = detail::domain_of<expr, env>;
+    if constexpr (!d.fits) {
+        return typed_compile<expr, env, Macros...>();
+    } else {
+        using R = typename decltype(detail::table_values<expr, env,
+                                                         Macros...>())::
+            value_type;
+        return [](auto... args) constexpr -> R {
+            static_assert(sizeof...(args) == d.count,
+                          "compile_table: wrong number of arguments");
+            const auto& domain = detail::domain_of<expr, env>;
+            const auto& table = detail::lookup_table<expr, env, Macros...>;
+            std::size_t at = 0;
+            std::size_t v = 0;
+            ((at = at * static_cast<std::size_t>(domain.size[v]) +
+                   static_cast<std::size_t>(static_cast<long long>(args) -
+                                            domain.lo[v]),
+              ++v),
+             ...);
+            return static_cast<R>(table[at]);
+        };
+    }
+}
+
+// compile_table with all the macros typed_full_compile uses.
+template <auto expr, auto env>
+    requires requires {
+        env.count;
+        env.lookup("");
+    }
+consteval auto full_compile_table() {
+    using namespace refmacro;
+    return compile_table<expr, env, MAdd, MSub, MMul, MDiv, MNeg, MCond, MLand,
+                         MLor, MLnot, MEq, MLt, MGt, MLe, MGe, MProgn>();
+}
+
+} // namespace reftype
+
+#endif // REFTYPE_TABLE_HPP
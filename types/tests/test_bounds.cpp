@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <refmacro/array.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <reftype/bounds.hpp>
+#include <reftype/strip.hpp>
+#include <reftype/types.hpp>
+#include <stdexcept>
+
+using refmacro::avar;
+using refmacro::Expression;
+using refmacro::index;
+using refmacro::str_eq;
+using refmacro::sum;
+using reftype::elide_bounds_checks;
+using reftype::TInt;
+using reftype::tref;
+using reftype::TReal;
+using reftype::type_check;
+using reftype::TypeEnv;
+using reftype::typed_full_compile;
+
+using E = Expression<128>;
+
+// Checked and proven reads in e.
+struct ReadCounts {
+    int checked{0};
+    int proven{0};
+};
+
+template <auto... Ms>
+consteval ReadCounts reads(const Expression<128, Ms...>& e) {
+    ReadCounts r{};
+    for (std::size_t id = 0; id < e.ast.count; ++id) {
+        if (str_eq(e.ast.nodes[id].tag, "index"))
+            ++r.checked;
+        if (str_eq(e.ast.nodes[id].tag, "index_proven"))
+            ++r.proven;
+    }
+    return r;
+}
+
+// {#v : Int | lo <= #v && #v < hi}
+consteval E int_range(double lo, double hi) {
+    auto v = E::var("#v");
+    return tref(TInt, (E::lit(lo) <= v) && (v < E::lit(hi)));
+}
+
+// ============================================================
+// Facts from literals and loops
+// ============================================================
+
+TEST(BoundsElision, LiteralIndex) {
+    static constexpr auto w = avar<128>("w", 4);
+    static constexpr auto in = elide_bounds_checks(index(w, 3));
+    static constexpr auto out = elide_bounds_checks(index(w, 4));
+    static_assert(reads(in).proven == 1);
+    static_assert(reads(out).checked == 1);
+}
+
+TEST(BoundsElision, LoopVariable) {
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto fits = elide_bounds_checks(sum("i", 0, 8, index(w, i)));
+    static constexpr auto over = elide_bounds_checks(sum("i", 0, 9, index(w, i)));
+    static_assert(reads(fits).proven == 1 && reads(fits).checked == 0);
+    static_assert(reads(over).proven == 0 && reads(over).checked == 1);
+}
+
+TEST(BoundsElision, Stencil) {
+    // w[i] + w[i + 1] over i < 7, and w[i - 1] over 1 <= i < 8
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto fwd = elide_bounds_checks(
+        sum("i", 0, 7, index(w, i) + index(w, i + E::lit(1))));
+    static constexpr auto back =
+        elide_bounds_checks(sum("i", 1, 8, index(w, i - E::lit(1))));
+    static constexpr auto wide =
+        elide_bounds_checks(sum("i", 0, 8, index(w, i + E::lit(1))));
+    static_assert(reads(fwd).proven == 2);
+    static_assert(reads(back).proven == 1);
+    static_assert(reads(wide).checked == 1);
+}
+
+TEST(BoundsElision, ShadowingDropsFacts) {
+    // The let rebinds i to a value the loop bounds say nothing about
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto e = elide_bounds_checks(
+        sum("i", 0, 8, refmacro::let_("i", i + E::lit(20), index(w, i))));
+    static_assert(reads(e).checked == 1);
+}
+
+TEST(BoundsElision, LetBoundIndex) {
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto j = E::var("j");
+    static constexpr auto e = elide_bounds_checks(
+        sum("i", 0, 4, refmacro::let_("j", i * E::lit(2), index(w, j))));
+    static_assert(reads(e).proven == 1);
+}
+
+// ============================================================
+// Facts from refinements in the environment
+// ============================================================
+
+TEST(BoundsElision, RefinedVariable) {
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto in_range = TypeEnv<128>{}.bind("i", int_range(0, 8));
+    static constexpr auto too_wide = TypeEnv<128>{}.bind("i", int_range(0, 9));
+    static_assert(reads(elide_bounds_checks(index(w, i), in_range)).proven == 1);
+    static_assert(reads(elide_bounds_checks(index(w, i), too_wide)).checked ==
+                  1);
+    static_assert(reads(elide_bounds_checks(index(w, i))).checked == 1);
+}
+
+TEST(BoundsElision, RefinedLoopBound) {
+    // n <= 8 bounds every i < n
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto n = E::var("n");
+    static constexpr auto env =
+        TypeEnv<128>{}.bind("n", tref(TInt, E::var("#v") <= E::lit(8)));
+    static constexpr auto e =
+        elide_bounds_checks(sum("i", E::lit(0), n, index(w, i)), env);
+    static_assert(reads(e).proven == 1);
+}
+
+TEST(BoundsElision, RealVariablesDoNotTakePart) {
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto i = E::var("i");
+    static constexpr auto env = TypeEnv<128>{}.bind(
+        "i", tref(TReal, (E::lit(0) <= E::var("#v")) &&
+                             (E::var("#v") < E::lit(8))));
+    static_assert(reads(elide_bounds_checks(index(w, i), env)).checked == 1);
+}
+
+// ============================================================
+// Typed pipeline
+// ============================================================
+
+TEST(BoundsElision, TypeRule) {
+    static constexpr auto w = avar<128>("w", 8);
+    static constexpr auto env = TypeEnv<128>{}.bind("i", TInt);
+    static constexpr auto r = type_check(index(w, E::var("i")), env);
+    static_assert(r.valid);
+    static_assert(str_eq(r.type.ast.nodes[r.type.id].tag, "treal"));
+}
+
+TEST(BoundsElision, TypedCompile) {
+    static constexpr auto w = avar<128>("w", 4);
+    static constexpr auto i = E::var("i");
+    static constexpr auto e = index(w, i) * E::lit(2.5);
+    static constexpr auto proven_env =
+        TypeEnv<128>{}.bind("i", int_range(0, 4));
+    static constexpr auto open_env = TypeEnv<128>{}.bind("i", TInt);
+    constexpr auto fast = typed_full_compile<e, proven_env>();
+    constexpr auto safe = typed_full_compile<e, open_env>();
+    std::array<double, 4> data{1.0, 2.0, 3.0, 4.0};
+    static_assert(fast(std::array{1.0, 2.0, 3.0, 4.0}, 3.0) == 10.0);
+    EXPECT_EQ(safe(data, 1.0), 5.0);
+    EXPECT_THROW(safe(data, 4.0), std::out_of_range);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <reftype/gradual.hpp>
+#include <reftype/types.hpp>
+#include <stdexcept>
+
+using refmacro::Expression;
+using refmacro::str_eq;
+using reftype::ann;
+using reftype::gradual_full_compile;
+using reftype::insert_residual_checks;
+using reftype::residual_checks;
+using reftype::tarr;
+using reftype::TInt;
+using reftype::TReal;
+using reftype::tref;
+using reftype::type_check;
+using reftype::type_check_gradual;
+using reftype::TypeEnv;
+
+using E = Expression<128>;
+
+// Nodes tagged tag in e.
+template <auto... Ms>
+consteval int count_tag(const Expression<128, Ms...>& e, const char* tag) {
+    int count = 0;
+    for (std::size_t id = 0; id < e.ast.count; ++id)
+        if (str_eq(e.ast.nodes[id].tag, tag))
+            ++count;
+    return count;
+}
+
+consteval E nonneg() { return tref(TInt, E::var("#v") >= E::lit(0)); }
+consteval E pos() { return tref(TInt, E::var("#v") > E::lit(0)); }
+
+static constexpr auto x = E::var("x");
+static constexpr auto ints = TypeEnv<128>{}.bind("x", TInt);
+static constexpr auto pos_x = TypeEnv<128>{}.bind("x", pos());
+
+// ============================================================
+// Obligations
+// ============================================================
+
+TEST(Gradual, ProvenAnnotationsNeedNoCheck) {
+    static constexpr auto e = ann(x, nonneg()) + E::lit(1);
+    static_assert(type_check(e, pos_x).valid);
+    static_assert(residual_checks(e, pos_x).count == 0);
+    static_assert(count_tag(insert_residual_checks(e, pos_x), "guard") == 0);
+}
+
+TEST(Gradual, UnprovenRefinementIsResidual) {
+    // x * x is not linear: the solver cannot prove it nonnegative
+    static constexpr auto e = ann(x * x, nonneg());
+    static_assert(!type_check(e, ints).valid);
+    static_assert(type_check_gradual(e, ints).valid);
+    constexpr auto checks = residual_checks(e, ints);
+    static_assert(checks.count == 1);
+    static_assert(str_eq(e.ast.nodes[checks.sites[0]].tag, "ann"));
+    static_assert(count_tag(insert_residual_checks(e, ints), "guard") == 1);
+}
+
+TEST(Gradual, BaseTypeErrorsStayErrors) {
+    static constexpr auto env = TypeEnv<128>{}.bind("r", TReal);
+    static constexpr auto e = ann(E::var("r"), nonneg());
+    static_assert(!type_check_gradual(e, env).valid);
+}
+
+TEST(Gradual, OnlyUnprovenSitesAreChecked) {
+    static constexpr auto e = ann(x, pos()) + ann(x - E::lit(1), nonneg());
+    static_assert(residual_checks(e, pos_x).count == 1);
+    static_assert(residual_checks(e, ints).count == 2);
+    static_assert(count_tag(insert_residual_checks(e, pos_x), "guard") == 1);
+}
+
+TEST(Gradual, LambdaResults) {
+    // ((y : Int) -> {#v : Int | #v >= 0})(x) with body y * y
+    static constexpr auto y = E::var("y");
+    static constexpr auto fn =
+        ann(refmacro::lambda<128>("y", y * y), tarr("y", TInt, nonneg()));
+    static constexpr auto e = refmacro::apply(fn, x);
+    static_assert(residual_checks(e, ints).count == 1);
+    constexpr auto f = gradual_full_compile<e, ints>();
+    static_assert(f(-3) == 9);
+}
+
+TEST(Gradual, UnprovenArgumentIsResidual) {
+    // ((y : {#v : Int | #v > 0}) -> Int)(x * x)
+    static constexpr auto y = E::var("y");
+    static constexpr auto fn = ann(refmacro::lambda<128>("y", y - E::lit(1)),
+                                   tarr("y", pos(), TInt));
+    static constexpr auto e = refmacro::apply(fn, x * x);
+    static_assert(!type_check(e, ints).valid);
+    static_assert(type_check_gradual(e, ints).valid);
+    constexpr auto checks = residual_checks(e, ints);
+    static_assert(checks.count == 1);
+    static_assert(str_eq(e.ast.nodes[checks.sites[0]].tag, "apply"));
+    // A proven argument needs no check
+    static constexpr auto proven = refmacro::apply(fn, x);
+    static_assert(residual_checks(proven, pos_x).count == 0);
+}
+
+TEST(Gradual, ArgumentToFunctionTypedVariable) {
+    // f : (y : {#v : Int | #v > 0}) -> Int from env, applied to x * x
+    static constexpr auto env = ints.bind("f", tarr("y", pos(), TInt));
+    static constexpr auto e = refmacro::apply(E::var("f"), x * x);
+    static_assert(type_check_gradual(e, env).valid);
+    static_assert(residual_checks(e, env).count == 1);
+    // The guard checks the argument against f's parameter type
+    constexpr auto checked = insert_residual_checks(e, env);
+    static_assert(count_tag(checked, "guard") == 1);
+    constexpr auto root = checked.ast.nodes[checked.id];
+    static_assert(str_eq(checked.ast.nodes[root.children[0]].tag, "var"));
+    static_assert(str_eq(checked.ast.nodes[root.children[1]].tag, "apply"));
+}
+
+// ============================================================
+// Compiled checks
+// ============================================================
+
+TEST(Gradual, ChecksRunAtTheAnnotation) {
+    // Not provable, and false for some x: checked at run time
+    static constexpr auto e = ann(x - E::lit(3), nonneg()) * E::lit(2);
+    constexpr auto f = gradual_full_compile<e, ints>();
+    static_assert(f(5) == 4);
+    EXPECT_EQ(f(3), 0);
+    EXPECT_THROW(f(2), std::domain_error);
+}
+
+TEST(Gradual, ChecksRunAtTheApplication) {
+    static constexpr auto y = E::var("y");
+    static constexpr auto fn = ann(refmacro::lambda<128>("y", y * E::lit(2)),
+                                   tarr("y", pos(), TInt));
+    static constexpr auto e = refmacro::apply(fn, x - E::lit(3));
+    constexpr auto f = gradual_full_compile<e, ints>();
+    static_assert(f(5) == 4);
+    EXPECT_EQ(f(4), 2);
+    EXPECT_THROW(f(3), std::domain_error);
+}
+
+TEST(Gradual, ProvenProgramsCompileAsTyped) {
+    static constexpr auto e = ann(x + E::lit(1), TInt) * x;
+    constexpr auto f = gradual_full_compile<e, pos_x>();
+    constexpr auto g = reftype::typed_full_compile<e, pos_x>();
+    static_assert(f(4) == g(4));
+    static_assert(count_tag(insert_residual_checks(e, pos_x), "guard") == 0);
+}
@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <refmacro/array.hpp>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <reftype/lower.hpp>
+#include <reftype/strip.hpp>
+#include <reftype/types.hpp>
+#include <type_traits>
+
+using refmacro::avar;
+using refmacro::Expression;
+using refmacro::index;
+using refmacro::str_eq;
+using reftype::ann;
+using reftype::lower_kinds;
+using reftype::Repr;
+using reftype::tarr;
+using reftype::TBool;
+using reftype::TInt;
+using reftype::TReal;
+using reftype::tref;
+using reftype::typed_full_compile;
+using reftype::TypeEnv;
+
+using E = Expression<128>;
+
+// Cast nodes to repr in e.
+template <auto... Ms>
+consteval int casts_to(const Expression<128, Ms...>& e, Repr repr) {
+    int count = 0;
+    for (std::size_t id = 0; id < e.ast.count; ++id)
+        if (str_eq(e.ast.nodes[id].tag, "cast") &&
+            e.ast.nodes[id].payload == static_cast<int>(repr))
+            ++count;
+    return count;
+}
+
+static constexpr auto ints = TypeEnv<128>{}.bind("x", TInt).bind("y", TInt);
+
+// ============================================================
+// Representation per kind
+// ============================================================
+
+TEST(LowerKinds, IntComputesInInt64) {
+    static constexpr auto e = E::var("x") * E::var("y") + E::lit(1);
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(std::is_same_v<decltype(f(3, 4)), std::int64_t>);
+    // Arguments are converted to Int on entry
+    static_assert(std::is_same_v<decltype(f(3.0, 4.0)), std::int64_t>);
+    static_assert(f(3.0, 4.0) == 13);
+    EXPECT_EQ(f(3, 4), 13);
+}
+
+TEST(LowerKinds, IntLiteralsIgnoreTheArgumentType) {
+    // 2^40 does not fit the int arguments; it is built as int64_t
+    static constexpr auto e = E::var("x") * E::lit(1LL << 40);
+    static constexpr auto env = TypeEnv<128>{}.bind("x", TInt);
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(f(3) == std::int64_t{3} << 40);
+    EXPECT_EQ(f(-1), -(std::int64_t{1} << 40));
+}
+
+// {#v : Int | #v > 0}
+static constexpr auto positive = tref(TInt, E::var("#v") > E::lit(0));
+static constexpr auto positive_y = TypeEnv<128>{}.bind("x", TInt).bind(
+    "y", positive);
+
+TEST(LowerKinds, IntDivisionIsReal) {
+    static constexpr auto e = E::var("x") / E::var("y");
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(std::is_same_v<decltype(f(7, 2)), double>);
+    static_assert(f(7, 2) == 3.5);
+    static_assert(f(-7, 2) == -3.5);
+    EXPECT_EQ(f(1, 0), std::numeric_limits<double>::infinity());
+    // What the facts prove about the divisor does not change the value
+    constexpr auto g = typed_full_compile<e, positive_y>();
+    static_assert(std::is_same_v<decltype(g(7, 2)), double>);
+    static_assert(g(7, 2) == 3.5);
+    // Int arithmetic over a quotient stays in double
+    static constexpr auto sum = e + E::lit(1);
+    constexpr auto h = typed_full_compile<sum, positive_y>();
+    static_assert(h(7, 2) == 4.5);
+    // Whole literals are typed Int and divide as they do untyped
+    static constexpr auto half = E::lit(1.0) / E::lit(2.0);
+    static_assert(typed_full_compile<half>()() == 0.5);
+}
+
+TEST(LowerKinds, ComparisonsAreBool) {
+    static constexpr auto e = (E::var("x") > E::lit(0)) && (E::var("y") < 10);
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(std::is_same_v<decltype(f(1, 2)), bool>);
+    static_assert(f(1, 2));
+    static_assert(!f(0, 2));
+}
+
+TEST(LowerKinds, RealStaysDouble) {
+    static constexpr auto env = TypeEnv<128>{}.bind("r", TReal);
+    static constexpr auto e = E::var("r") * E::lit(0.5);
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(std::is_same_v<decltype(f(3)), double>);
+    static_assert(f(3) == 1.5); // an int argument is read as a Real
+}
+
+// ============================================================
+// Widening points
+// ============================================================
+
+TEST(LowerKinds, AnnotationWidens) {
+    static constexpr auto e = ann(E::var("x") * E::var("y"), TReal);
+    static constexpr auto lowered = lower_kinds(e, ints);
+    static_assert(str_eq(lowered.ast.nodes[lowered.id].tag, "cast"));
+    static_assert(casts_to(lowered, Repr::Real) == 1);
+    // The product is still integer arithmetic
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(std::is_same_v<decltype(f(7, 2)), double>);
+    static_assert(f(7, 2) == 14.0);
+}
+
+TEST(LowerKinds, CondJoinsArms) {
+    static constexpr auto env =
+        TypeEnv<128>{}.bind("p", TBool).bind("x", TInt).bind("r", TReal);
+    static constexpr auto e =
+        refmacro::MCond(E::var("p"), E::var("x"), E::var("r"));
+    static constexpr auto lowered = lower_kinds(e, env);
+    static_assert(casts_to(lowered, Repr::Real) == 2); // x, and r's read
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(std::is_same_v<decltype(f(true, 2, 0.5)), double>);
+    static_assert(f(true, 2, 0.5) == 2.0);
+    static_assert(f(false, 2, 0.5) == 0.5);
+}
+
+TEST(LowerKinds, AnnotatedLambdaWidensArgument) {
+    // ((y : Real) -> Real)(x) with x : Int
+    static constexpr auto fn = ann(
+        refmacro::lambda<128>("y", E::var("y") * E::lit(0.5)),
+        tarr("y", TReal, TReal));
+    static constexpr auto e = refmacro::apply(fn, E::var("x"));
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(f(3, 0) == 1.5);
+}
+
+TEST(LowerKinds, LetKeepsKind) {
+    static constexpr auto e = refmacro::let_<128>(
+        "z", E::var("x") * E::lit(2), E::var("z") + E::var("y"));
+    static constexpr auto lowered = lower_kinds(e, ints);
+    // x, y, and the literal widened for the 64-bit multiply; z already
+    // holds an Int
+    static_assert(casts_to(lowered, Repr::Int64) == 3);
+    constexpr auto f = typed_full_compile<e, ints>();
+    static_assert(std::is_same_v<decltype(f(3, 1)), std::int64_t>);
+    static_assert(f(3, 1) == 7);
+}
+
+// ============================================================
+// Narrow integers from refinements
+// ============================================================
+
+// {#v : Int | lo <= #v && #v < hi}
+consteval E int_range(double lo, double hi) {
+    auto v = E::var("#v");
+    return tref(TInt, (E::lit(lo) <= v) && (v < E::lit(hi)));
+}
+
+TEST(LowerKinds, NarrowsProvenIntermediates) {
+    static constexpr auto env = TypeEnv<128>{}
+                                    .bind("i", int_range(0, 16))
+                                    .bind("j", int_range(0, 16));
+    static constexpr auto e = E::var("i") * E::lit(4) + E::var("j");
+    static constexpr auto lowered = lower_kinds(e, env);
+    // Every intermediate is at most 75: only the result is widened
+    static_assert(casts_to(lowered, Repr::UInt8) == 5);
+    static_assert(casts_to(lowered, Repr::Int64) == 1);
+    static_assert(casts_to(lowered, Repr::Int16) == 0);
+    static_assert(str_eq(lowered.ast.nodes[lowered.id].tag, "cast"));
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(std::is_same_v<decltype(f(15, 15)), std::int64_t>);
+    static_assert(f(15, 15) == 75);
+    EXPECT_EQ(f(3, 2), 14);
+}
+
+TEST(LowerKinds, PicksTheNarrowestFittingType) {
+    static constexpr auto env = TypeEnv<128>{}.bind("i", int_range(0, 256));
+    static constexpr auto i = E::var("i");
+    // Up to 25500: both intermediates are int16_t
+    static constexpr auto e16 = lower_kinds(i * E::lit(100) - E::lit(1), env);
+    static_assert(casts_to(e16, Repr::Int16) == 2);
+    // Up to 51000: past int16_t, so both stay in the int the operation
+    // computes in
+    static constexpr auto e = i * E::lit(200) - E::lit(1);
+    static constexpr auto e32 = lower_kinds(e, env);
+    static_assert(casts_to(e32, Repr::Int16) == 0);
+    static_assert(casts_to(e32, Repr::Int64) == 1); // the result
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(f(255) == 50999);
+    static_assert(f(0) == -1);
+}
+
+TEST(LowerKinds, LetBindingsAreFacts) {
+    static constexpr auto env = TypeEnv<128>{}.bind("i", int_range(0, 10));
+    static constexpr auto e = refmacro::let_<128>(
+        "z", E::var("i") + E::lit(1), E::var("z") * E::var("z"));
+    static constexpr auto lowered = lower_kinds(e, env);
+    // z is at most 10; z * z is not linear and stays 64-bit
+    static_assert(casts_to(lowered, Repr::Int16) == 0);
+    static_assert(casts_to(lowered, Repr::Int32) == 0);
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(f(9) == 100);
+}
+
+TEST(LowerKinds, UnprovenProductsDoNotOverflow) {
+    // Both reads fit int32_t; their product is computed in 64 bits
+    static constexpr auto env = TypeEnv<128>{}
+                                    .bind("i", int_range(0, 1 << 20))
+                                    .bind("j", int_range(0, 1 << 20));
+    static constexpr auto e = E::var("i") * E::var("j");
+    constexpr auto f = typed_full_compile<e, env>();
+    constexpr std::int64_t big = (1 << 20) - 1;
+    static_assert(f(big, big) == big * big);
+}
+
+// ============================================================
+// Interaction with bounds-check elision
+// ============================================================
+
+TEST(LowerKinds, CastsDoNotHideProofs) {
+    static constexpr auto w = avar<128>("w", 4);
+    static constexpr auto i = E::var("i");
+    static constexpr auto v = E::var("#v");
+    static constexpr auto env = TypeEnv<128>{}.bind(
+        "i", tref(TInt, (E::lit(0) <= v) && (v < E::lit(3))));
+    static constexpr auto e = index(w, i + E::lit(1));
+    static constexpr auto elided =
+        reftype::elide_bounds_checks(lower_kinds(e, env), env);
+    static_assert(str_eq(elided.ast.nodes[elided.id].tag, "index_proven"));
+    constexpr auto f = typed_full_compile<e, env>();
+    static_assert(f(std::array{1.0, 2.0, 3.0, 4.0}, 2) == 4.0);
+}
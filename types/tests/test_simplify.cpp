@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <reftype/simplify.hpp>
+#include <reftype/types.hpp>
+
+using refmacro::Expression;
+using refmacro::MCond;
+using refmacro::str_eq;
+using refmacro::sum;
+using reftype::simplify_with;
+using reftype::TInt;
+using reftype::tref;
+using reftype::TypeEnv;
+
+using E = Expression<128>;
+
+// Nodes tagged tag in e.
+template <auto... Ms>
+consteval int count_tag(const Expression<128, Ms...>& e, const char* tag) {
+    int count = 0;
+    for (std::size_t id = 0; id < e.ast.count; ++id)
+        if (str_eq(e.ast.nodes[id].tag, tag))
+            ++count;
+    return count;
+}
+
+static constexpr auto x = E::var("x");
+static constexpr auto y = E::var("y");
+static constexpr auto pos_x =
+    TypeEnv<128>{}.bind("x", tref(TInt, E::var("#v") > E::lit(0)));
+
+// ============================================================
+// Conditions
+// ============================================================
+
+TEST(SimplifyWith, ProvenConditionPicksTheBranch) {
+    static constexpr auto then_ = simplify_with(MCond(x > 0, y, -y), pos_x);
+    static_assert(str_eq(then_.ast.nodes[then_.id].tag, "var"));
+    static constexpr auto else_ = simplify_with(MCond(x < 1, -y, y), pos_x);
+    static_assert(str_eq(else_.ast.nodes[else_.id].name, "y"));
+    static_assert(count_tag(else_, "neg") == 0);
+}
+
+TEST(SimplifyWith, UnprovenConditionStays) {
+    static constexpr auto e = MCond(x > 5, y, -y);
+    static_assert(count_tag(simplify_with(e, pos_x), "cond") == 1);
+    // Without the refinement nothing is known about x
+    static constexpr auto plain = TypeEnv<128>{}.bind("x", TInt);
+    static_assert(count_tag(simplify_with(MCond(x > 0, y, -y), plain),
+                            "cond") == 1);
+}
+
+TEST(SimplifyWith, ArmsKnowTheirSideOfTheCondition) {
+    static constexpr auto plain = TypeEnv<128>{}.bind("x", TInt);
+    // Inside x > 5, x > 0 holds; inside !(x > 5), x < 10 does
+    static constexpr auto e =
+        MCond(x > 5, MCond(x > 0, y, -y), MCond(x < 10, y + 1.0, y));
+    static constexpr auto s = simplify_with(e, plain);
+    static_assert(count_tag(s, "cond") == 1);
+    static_assert(count_tag(s, "neg") == 0);
+    static_assert(count_tag(s, "add") == 1);
+}
+
+TEST(SimplifyWith, LetAndLoopFacts) {
+    // let z = x + 1 in cond(z > 1, ...) with x > 0
+    static constexpr auto z = E::var("z");
+    static constexpr auto let_expr =
+        refmacro::let_<128>("z", x + E::lit(1), MCond(z > 1, z, -z));
+    static_assert(count_tag(simplify_with(let_expr, pos_x), "cond") == 0);
+    // 0 <= i < 8 inside the loop
+    static constexpr auto i = E::var("i");
+    static constexpr auto loop = sum("i", 0, 8, MCond(i < 8, i * y, y));
+    static_assert(count_tag(simplify_with(loop), "cond") == 0);
+}
+
+// ============================================================
+// Side conditions
+// ============================================================
+
+TEST(SimplifyWith, SelfDivisionOfNonzero) {
+    static constexpr auto s = simplify_with(x / x, pos_x);
+    static_assert(str_eq(s.ast.nodes[s.id].tag, "lit"));
+    static_assert(s.ast.nodes[s.id].payload == 1.0);
+    static constexpr auto shifted = simplify_with((x + 2) / (x + 2), pos_x);
+    static_assert(str_eq(shifted.ast.nodes[shifted.id].tag, "lit"));
+    // x - 1 may be zero
+    static_assert(count_tag(simplify_with((x - 1) / (x - 1), pos_x), "div") ==
+                  1);
+}
+
+TEST(SimplifyWith, CompiledResultUnchanged) {
+    static constexpr auto e = MCond(x > 0, y * (x / x), y - 1.0) + y;
+    static constexpr auto s = simplify_with(e, pos_x);
+    static_assert(count_tag(s, "cond") == 0);
+    static_assert(count_tag(s, "div") == 0);
+    constexpr auto f = refmacro::full_compile<e>();
+    constexpr auto g = refmacro::full_compile<s>(); // reads only y
+    static_assert(f(3.0, 2.5) == 5.0);
+    static_assert(g(2.5) == 5.0);
+    EXPECT_EQ(f(7.0, -1.0), g(-1.0));
+}
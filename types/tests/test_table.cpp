@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <refmacro/control.hpp>
+#include <refmacro/math.hpp>
+#include <reftype/strip.hpp>
+#include <reftype/table.hpp>
+#include <reftype/types.hpp>
+#include <type_traits>
+
+using refmacro::Expression;
+using refmacro::MCond;
+using reftype::ann;
+using reftype::full_compile_table;
+using reftype::TBool;
+using reftype::TInt;
+using reftype::TReal;
+using reftype::tref;
+using reftype::typed_full_compile;
+using reftype::TypeEnv;
+using reftype::detail::domain_of;
+
+using E = Expression<128>;
+
+// {#v : Int | lo <= #v && #v < hi}
+consteval E int_range(double lo, double hi) {
+    auto v = E::var("#v");
+    return tref(TInt, (E::lit(lo) <= v) && (v < E::lit(hi)));
+}
+
+static constexpr auto x = E::var("x");
+static constexpr auto y = E::var("y");
+static constexpr auto byte_x = TypeEnv<128>{}.bind("x", int_range(0, 256));
+
+// ============================================================
+// Domains
+// ============================================================
+
+TEST(CompileTable, DomainsFromRefinements) {
+    static constexpr auto env = TypeEnv<128>{}
+                                    .bind("x", int_range(-3, 5))
+                                    .bind("p", TBool)
+                                    .bind("y", int_range(10, 13));
+    static constexpr auto e = MCond(E::var("p"), x, y);
+    constexpr auto d = domain_of<e, env>;
+    static_assert(d.fits && d.count == 3 && d.entries == 8 * 2 * 3);
+    static_assert(d.lo[0] == 0 && d.size[0] == 2); // p
+    static_assert(d.lo[1] == -3 && d.size[1] == 8);
+    static_assert(d.lo[2] == 10 && d.size[2] == 3);
+}
+
+TEST(CompileTable, NoTableWithoutASmallDomain) {
+    static constexpr auto big = TypeEnv<128>{}.bind("x", int_range(0, 5000));
+    static_assert(!domain_of<x + E::lit(1), big>.fits);
+    // 256 * 256 points is over the budget
+    static constexpr auto bytes = byte_x.bind("y", int_range(0, 256));
+    static_assert(!domain_of<x + y, bytes>.fits);
+    static constexpr auto unrefined = TypeEnv<128>{}.bind("x", TInt);
+    static_assert(!domain_of<x + E::lit(1), unrefined>.fits);
+    static constexpr auto real = byte_x.bind("y", TReal);
+    static_assert(!domain_of<ann(x, TReal) + y, real>.fits);
+}
+
+// ============================================================
+// Lookups
+// ============================================================
+
+TEST(CompileTable, ClassifiesByteInputs) {
+    static constexpr auto e = MCond(x < 32, E::lit(0),
+                                    MCond(x < 127, E::lit(1), E::lit(2)));
+    constexpr auto table = full_compile_table<e, byte_x>();
+    constexpr auto direct = typed_full_compile<e, byte_x>();
+    static_assert(std::is_same_v<decltype(table(7)), std::int64_t>);
+    static_assert(table(7) == 0 && table(65) == 1 && table(200) == 2);
+    // 256 one-byte entries
+    static_assert(sizeof(reftype::detail::lookup_table<e, byte_x, MCond,
+                                                       refmacro::MLt>) == 256);
+    for (int v = 0; v < 256; ++v)
+        EXPECT_EQ(table(v), direct(v)) << v;
+}
+
+TEST(CompileTable, MatchesTypedCompile) {
+    // Int division is a double division in the table too
+    static constexpr auto env = TypeEnv<128>{}
+                                    .bind("x", int_range(-8, 8))
+                                    .bind("y", int_range(1, 5));
+    static constexpr auto e = (x * E::lit(7) - y) / y;
+    constexpr auto table = full_compile_table<e, env>();
+    constexpr auto direct = typed_full_compile<e, env>();
+    static_assert(table(-8, 3) == direct(-8, 3));
+    static_assert(table(7, 4) == 11.25);
+    for (int i = -8; i < 8; ++i)
+        for (int j = 1; j < 5; ++j)
+            EXPECT_EQ(table(i, j), direct(i, j)) << i << ", " << j;
+}
+
+TEST(CompileTable, WideIntEntriesStayExact) {
+    // 2^53 * x + x has no exact double for any x > 0
+    static constexpr auto e =
+        x * E::lit(1LL << 40) * E::lit(1LL << 13) + x;
+    constexpr auto table = full_compile_table<e, byte_x>();
+    constexpr auto direct = typed_full_compile<e, byte_x>();
+    static_assert(std::is_same_v<decltype(table(7)), std::int64_t>);
+    static_assert(table(255) == (std::int64_t{255} << 53) + 255);
+    static_assert(sizeof(reftype::detail::lookup_table<e, byte_x>) ==
+                  256 * sizeof(std::int64_t));
+    for (int v = 0; v < 256; ++v)
+        EXPECT_EQ(table(v), direct(v)) << v;
+}
+
+TEST(CompileTable, BoolAndRealResults) {
+    static constexpr auto env = byte_x.bind("p", TBool);
+    static constexpr auto test = MCond(E::var("p"), x > 9, x < 3);
+    constexpr auto is = full_compile_table<test, env>();
+    // Arguments in extract_var_map order: p, then x
+    static_assert(std::is_same_v<decltype(is(true, 1)), bool>);
+    static_assert(is(true, 10) && !is(false, 10) && is(false, 2));
+
+    static constexpr auto half = ann(x, TReal) * E::lit(0.5);
+    constexpr auto f = full_compile_table<half, byte_x>();
+    static_assert(std::is_same_v<decltype(f(1)), double>);
+    static_assert(f(255) == 127.5);
+}
+
+TEST(CompileTable, FallsBackToTypedCompile) {
+    static constexpr auto env = TypeEnv<128>{}.bind("x", int_range(0, 5000));
+    static constexpr auto e = x * E::lit(3);
+    constexpr auto f = full_compile_table<e, env>();
+    static_assert(f(4999) == 14997);
+    EXPECT_EQ(f(1000), 3000);
+}